@@ -0,0 +1,15 @@
+#ifndef BUILD_H
+#define BUILD_H
+/***************************************************************************************
+ * Build
+ ***************************************************************************************
+ * Options every module of the sketch sees. A Dev Build talks on Serial, sends telemetry
+ * and profiles the hot paths with Timer1. Production builds define PRODUCTION_BUILD, or
+ * comment out DEV_BUILD below: the profiler then compiles to nothing and Timer1 stays
+ * off in PRR.
+ **************************************************************************************/
+#ifndef PRODUCTION_BUILD
+#define DEV_BUILD
+#endif
+
+#endif /* BUILD_H */
@@ -0,0 +1,1103 @@
+/***************************************************************************************
+ * Includes
+ **************************************************************************************/
+#include "Display.h"
+
+#ifdef DISPLAY_HOST
+#include <stdio.h>
+#include <string.h>
+#define PROGMEM
+#define pgm_read_byte(address)  (*(const uint8_t *)(address))
+unsigned long millis(void);
+void delay(unsigned long ms);
+void wdt_reset(void);
+#else
+#include <Arduino.h>
+#include <SPI.h>
+#include <avr/pgmspace.h>
+#include <avr/wdt.h>
+#include "Power.h"
+#endif
+
+/***************************************************************************************
+ * Macros
+ **************************************************************************************/
+#define DISPLAY_WIDTH           200u
+#define DISPLAY_HEIGHT          200u
+#define DISPLAY_ROW_BYTES       (DISPLAY_WIDTH / 8u)
+#define DISPLAY_ITEM_COUNT      4u      /* Two eyes, mouth and mode icon */
+#define DISPLAY_SPI_CLOCK       4000000 /* Highest clock of SPI at 8MHz */
+#define DISPLAY_RESET_TIME      10      /* Miliseconds of reset pulse and after it */
+#define DISPLAY_RESET_TIMEOUT   100u    /* Miliseconds BUSY may stay high after a reset, it takes about 10 */
+#define DISPLAY_REFRESH_TIMEOUT 3000u   /* Miliseconds a refresh may take, a full one takes about 2000; well below the watchdog */
+
+#define DISPLAY_REFRESH_PARTIAL 0u
+#define DISPLAY_REFRESH_FULL    1u
+#define DISPLAY_REFRESH_NONE    0xFFu
+#define DISPLAY_NOMINAL_MILLIVOLTS  3700u
+#define DISPLAY_ENERGY_PARTIAL  5920u   /* Microjoules until measured: 400ms at 3.7V and 4mA */
+#define DISPLAY_ENERGY_FULL     29600u  /* Microjoules until measured: 2s at 3.7V and 4mA */
+#define DISPLAY_MERGE_SLACK     4u      /* Rectangles merge if their union is at most 1/4 bigger than both */
+
+#define FNV_OFFSET_32           2166136261UL
+#define FNV_PRIME_32            16777619UL
+
+/* SSD1681 commands */
+#define SSD1681_DRIVER_OUTPUT   0x01u
+#define SSD1681_DEEP_SLEEP      0x10u   /* Data 0x01: mode 1, needs a reset to wake up */
+#define SSD1681_DATA_ENTRY      0x11u
+#define SSD1681_SW_RESET        0x12u
+#define SSD1681_TEMP_SENSOR     0x18u
+#define SSD1681_ACTIVATE        0x20u
+#define SSD1681_UPDATE_CONTROL  0x22u
+#define SSD1681_WRITE_RAM_NEW   0x24u
+#define SSD1681_WRITE_RAM_OLD   0x26u   /* Partial refresh only drives pixels which differ from this */
+#define SSD1681_BORDER          0x3Cu
+#define SSD1681_RAM_X_RANGE     0x44u
+#define SSD1681_RAM_Y_RANGE     0x45u
+#define SSD1681_RAM_X_COUNTER   0x4Eu
+#define SSD1681_RAM_Y_COUNTER   0x4Fu
+
+#define SSD1681_UPDATE_FULL     0xF7u
+#define SSD1681_UPDATE_PARTIAL  0xFCu
+
+/***************************************************************************************
+ * Types
+ **************************************************************************************/
+/* One sprite on the screen; x and width are in bytes so rows start on a RAM byte */
+typedef struct
+{
+    const uint8_t *bits;    /* PROGMEM, 1 is ink, rows of widthBytes */
+    uint8_t x;              /* Bytes */
+    uint8_t y;              /* Pixels */
+    uint8_t widthBytes;     /* Of the sprite, before scaling */
+    uint8_t height;         /* Of the sprite, before scaling */
+    uint8_t scale;          /* Each sprite pixel is drawn as scale x scale pixels */
+} displayItem_t;
+
+/* Part of the screen, x in bytes, both ends included */
+typedef struct
+{
+    uint8_t x0;
+    uint8_t x1;
+    uint8_t y0;
+    uint8_t y1;
+} displayRect_t;
+
+/***************************************************************************************
+ * Sprites
+ **************************************************************************************/
+/* Eyes, 16x16 drawn 4 times bigger */
+static const uint8_t displayEyeOpen[] PROGMEM =
+{
+    0x00, 0x00,
+    0x03, 0xC0,
+    0x0F, 0xF0,
+    0x1F, 0xF8,
+    0x3F, 0xFC,
+    0x3F, 0xFC,
+    0x7F, 0xFE,
+    0x7F, 0xFE,
+    0x7F, 0xFE,
+    0x7F, 0xFE,
+    0x3F, 0xFC,
+    0x3F, 0xFC,
+    0x1F, 0xF8,
+    0x0F, 0xF0,
+    0x03, 0xC0,
+    0x00, 0x00,
+};
+
+static const uint8_t displayEyeHappy[] PROGMEM =
+{
+    0x00, 0x00,
+    0x00, 0x00,
+    0x00, 0x00,
+    0x00, 0x00,
+    0x03, 0xC0,
+    0x0F, 0xF0,
+    0x1C, 0x38,
+    0x38, 0x1C,
+    0x30, 0x0C,
+    0x60, 0x06,
+    0x60, 0x06,
+    0x00, 0x00,
+    0x00, 0x00,
+    0x00, 0x00,
+    0x00, 0x00,
+    0x00, 0x00,
+};
+
+static const uint8_t displayEyeHalf[] PROGMEM =
+{
+    0x00, 0x00,
+    0x00, 0x00,
+    0x00, 0x00,
+    0x00, 0x00,
+    0x00, 0x00,
+    0x00, 0x00,
+    0x00, 0x00,
+    0x7F, 0xFE,
+    0x7F, 0xFE,
+    0x7F, 0xFE,
+    0x3F, 0xFC,
+    0x3F, 0xFC,
+    0x1F, 0xF8,
+    0x0F, 0xF0,
+    0x03, 0xC0,
+    0x00, 0x00,
+};
+
+static const uint8_t displayEyeClosed[] PROGMEM =
+{
+    0x00, 0x00,
+    0x00, 0x00,
+    0x00, 0x00,
+    0x00, 0x00,
+    0x00, 0x00,
+    0x00, 0x00,
+    0x00, 0x00,
+    0x00, 0x00,
+    0x60, 0x06,
+    0x38, 0x1C,
+    0x1F, 0xF8,
+    0x07, 0xE0,
+    0x00, 0x00,
+    0x00, 0x00,
+    0x00, 0x00,
+    0x00, 0x00,
+};
+
+/* Mouths, 40x8 drawn 3 times bigger */
+static const uint8_t displayMouthSmile[] PROGMEM =
+{
+    0x00, 0x00, 0x00, 0x00, 0x00,
+    0x30, 0x00, 0x00, 0x00, 0x0C,
+    0x1C, 0x00, 0x00, 0x00, 0x38,
+    0x07, 0x80, 0x00, 0x01, 0xE0,
+    0x01, 0xFE, 0x00, 0x7F, 0x80,
+    0x00, 0x3F, 0xFF, 0xFC, 0x00,
+    0x00, 0x03, 0xFF, 0xC0, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00,
+};
+
+static const uint8_t displayMouthFlat[] PROGMEM =
+{
+    0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00,
+    0x01, 0xFF, 0xFF, 0xFF, 0x80,
+    0x01, 0xFF, 0xFF, 0xFF, 0x80,
+    0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00,
+};
+
+static const uint8_t displayMouthFrown[] PROGMEM =
+{
+    0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x03, 0xFF, 0xC0, 0x00,
+    0x00, 0x3F, 0xFF, 0xFC, 0x00,
+    0x01, 0xFE, 0x00, 0x7F, 0x80,
+    0x07, 0x80, 0x00, 0x01, 0xE0,
+    0x1C, 0x00, 0x00, 0x00, 0x38,
+    0x30, 0x00, 0x00, 0x00, 0x0C,
+    0x00, 0x00, 0x00, 0x00, 0x00,
+};
+
+static const uint8_t displayMouthSleep[] PROGMEM =
+{
+    0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x3C, 0x00, 0x00,
+    0x00, 0x00, 0x42, 0x00, 0x00,
+    0x00, 0x00, 0x42, 0x00, 0x00,
+    0x00, 0x00, 0x3C, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00,
+};
+
+/* Mode icons, 8x8 drawn 2 times bigger */
+static const uint8_t displayIconAutomate[] PROGMEM =
+{
+    0x18,
+    0x24,
+    0x42,
+    0x42,
+    0x7E,
+    0x42,
+    0x42,
+    0x00,
+};
+
+static const uint8_t displayIconManual[] PROGMEM =
+{
+    0x42,
+    0x66,
+    0x5A,
+    0x42,
+    0x42,
+    0x42,
+    0x42,
+    0x00,
+};
+
+static const uint8_t * const displayEyes[DISPLAY_MOOD_COUNT] =
+{
+    displayEyeHappy,
+    displayEyeOpen,
+    displayEyeHalf,
+    displayEyeClosed,
+};
+
+static const uint8_t * const displayMouths[DISPLAY_MOOD_COUNT] =
+{
+    displayMouthSmile,
+    displayMouthFlat,
+    displayMouthFrown,
+    displayMouthSleep,
+};
+
+static const uint8_t * const displayIcons[] =
+{
+    displayIconAutomate,
+    displayIconManual,
+};
+
+/***************************************************************************************
+ * Variables
+ **************************************************************************************/
+static uint8_t displayShownMood = DISPLAY_MOOD_UNKNOWN;     /* On the panel, or being refreshed */
+static uint8_t displayShownIcon = DISPLAY_ICON_AUTOMATE;
+static uint8_t displayWantedMood = DISPLAY_MOOD_UNKNOWN;    /* Last asked by Display_Show() */
+static uint8_t displayWantedIcon = DISPLAY_ICON_AUTOMATE;
+static uint8_t displayRefresh = DISPLAY_REFRESH_NONE;       /* DISPLAY_REFRESH_* running */
+static uint8_t displayForce = 0u;                           /* 1 to refresh without waiting for the budget */
+static uint8_t displayPartials = 0u;                        /* Partial refreshes since the last full one */
+static displayRect_t displayRects[DISPLAY_ITEM_COUNT];      /* Dirty rectangles of the refresh */
+static uint8_t displayRectCount = 0u;
+static uint32_t displayRefreshStart = 0u;                   /* millis() when the refresh started */
+static volatile uint32_t displayBusyEnd = 0u;               /* millis() when BUSY fell after it, 0 until then */
+static uint8_t displayAbsent = 0u;                          /* 1 once BUSY got stuck, the panel is left alone */
+static uint32_t displayBudget = DISPLAY_BUDGET_MAX;         /* Microjoules the display may use now */
+static uint32_t displayBudgetTime = 0u;                     /* millis() of the last budget refill */
+static uint32_t displayEnergy[2] = { DISPLAY_ENERGY_PARTIAL, DISPLAY_ENERGY_FULL };   /* Microjoules per refresh */
+static uint16_t displayBatteryMilliVolts = DISPLAY_NOMINAL_MILLIVOLTS;
+static uint32_t displayStatsStart = 0u;                     /* millis() of Display_Init() */
+static uint16_t displayRefreshes = 0u;
+static uint16_t displaySkipped = 0u;
+static uint32_t displayEnergyTotal = 0u;                    /* Microjoules of all refreshes */
+
+#ifdef DISPLAY_HOST
+/* Emulated panel: both RAMs, the address counters of the SSD1681 and the pixels shown */
+static uint8_t displayHostRam[2][DISPLAY_ROW_BYTES * DISPLAY_HEIGHT];
+static uint8_t displayHostPanel[DISPLAY_ROW_BYTES * DISPLAY_HEIGHT];
+static uint8_t displayHostCommand;
+static uint8_t displayHostArgs[4];
+static uint8_t displayHostArgCount;
+static uint8_t displayHostXStart, displayHostXEnd, displayHostX;
+static uint8_t displayHostYStart, displayHostYEnd, displayHostY;
+static uint8_t displayHostUpdate;
+static uint32_t displayHostBusyUntil = 0u;
+static uint8_t displayHostBusyStuck = 0u;                   /* 1 emulates a missing or hanging panel */
+static uint16_t displayHostFrames = 0u;
+static uint16_t displayHostBytes = 0u;                      /* New RAM bytes written since the last refresh */
+#endif
+
+#ifdef DISPLAY_HOST
+/***************************************************************************************
+ * Function: Display_HostRefresh()
+ ***************************************************************************************
+ * Description: Update the emulated pixels like the panel does and save them as
+ *              display_NNN_full.pbm or _partial.pbm. A partial refresh only drives the
+ *              pixels where the new RAM differs from the old one.
+ **************************************************************************************/
+static void Display_HostRefresh(void)
+{
+    char name[32];
+    uint16_t changed = 0u;
+    uint8_t full = (SSD1681_UPDATE_FULL == displayHostUpdate);
+    FILE *file;
+
+    for(uint16_t index = 0u; index < sizeof(displayHostPanel); index++)
+    {
+        uint8_t drive = full ? 0xFFu : (displayHostRam[0][index] ^ displayHostRam[1][index]);
+        uint8_t pixels = (displayHostPanel[index] & ~drive) | (displayHostRam[0][index] & drive);
+        uint8_t diff = pixels ^ displayHostPanel[index];
+
+        while(diff)
+        {
+            changed += diff & 1u;
+            diff >>= 1;
+        }
+        displayHostPanel[index] = pixels;
+    }
+
+    snprintf(name, sizeof(name), "display_%03u_%s.pbm", displayHostFrames++, full ? "full" : "partial");
+    file = fopen(name, "wb");
+    if(NULL != file)
+    {
+        /* Panel RAM has 1 for white, PBM has 1 for black */
+        fprintf(file, "P4\n%u %u\n", DISPLAY_WIDTH, DISPLAY_HEIGHT);
+        for(uint16_t index = 0u; index < sizeof(displayHostPanel); index++)
+        {
+            fputc((uint8_t)~displayHostPanel[index], file);
+        }
+        fclose(file);
+    }
+    printf("%s: %u bytes sent, %u pixels changed\n", name, displayHostBytes, changed);
+    displayHostBytes = 0u;
+
+    displayHostBusyUntil = millis() + (full ? 2000u : 400u);
+}
+
+static void Display_Begin(void) {}
+static void Display_End(void) {}
+static uint8_t Display_Busy(void) { return (displayHostBusyStuck || (millis() < displayHostBusyUntil)) ? 1u : 0u; }
+static void Display_Reset(void) {}
+static void Display_ArmBusyEdge(void) { displayBusyEnd = displayHostBusyUntil; }
+static void Display_DisarmBusyEdge(void) {}
+
+static void Display_Command(uint8_t command)
+{
+    displayHostCommand = command;
+    displayHostArgCount = 0u;
+
+    if(SSD1681_ACTIVATE == command)
+    {
+        Display_HostRefresh();
+    }
+}
+
+static void Display_Data(uint8_t data)
+{
+    switch(displayHostCommand)
+    {
+        case SSD1681_WRITE_RAM_NEW:
+        case SSD1681_WRITE_RAM_OLD:
+            displayHostRam[SSD1681_WRITE_RAM_OLD == displayHostCommand][(displayHostY * DISPLAY_ROW_BYTES) + displayHostX] = data;
+            displayHostBytes += (SSD1681_WRITE_RAM_NEW == displayHostCommand);
+            displayHostX++;
+            if(displayHostX > displayHostXEnd)
+            {
+                displayHostX = displayHostXStart;
+                displayHostY = (displayHostY >= displayHostYEnd) ? displayHostYStart : (displayHostY + 1u);
+            }
+            break;
+        case SSD1681_UPDATE_CONTROL:
+            displayHostUpdate = data;
+            break;
+        default:
+            /* Keep arguments, X and Y ranges fit in the first bytes */
+            if(displayHostArgCount < sizeof(displayHostArgs))
+            {
+                displayHostArgs[displayHostArgCount++] = data;
+            }
+            if(SSD1681_RAM_X_RANGE == displayHostCommand)
+            {
+                displayHostXStart = displayHostArgs[0];
+                displayHostXEnd = displayHostArgs[1];
+            }
+            if(SSD1681_RAM_Y_RANGE == displayHostCommand)
+            {
+                displayHostYStart = displayHostArgs[0];
+                displayHostYEnd = displayHostArgs[2];
+            }
+            displayHostX = (SSD1681_RAM_X_COUNTER == displayHostCommand) ? displayHostArgs[0] : displayHostX;
+            displayHostY = (SSD1681_RAM_Y_COUNTER == displayHostCommand) ? displayHostArgs[0] : displayHostY;
+            break;
+    }
+}
+
+const uint8_t *Display_HostPanel(void)
+{
+    return displayHostPanel;
+}
+
+void Display_HostBusyStuck(uint8_t stuck)
+{
+    displayHostBusyStuck = stuck;
+}
+#else
+/***************************************************************************************
+ * Function: Display_Begin()
+ ***************************************************************************************
+ * Description: Select the panel for a batch of commands and data.
+ **************************************************************************************/
+static void Display_Begin(void)
+{
+    /* SPI is stopped between batches; beginTransaction() sets it up again */
+    Power_Hold(POWER_SPI, POWER_HOLDER_DISPLAY);
+    SPI.beginTransaction(SPISettings(DISPLAY_SPI_CLOCK, MSBFIRST, SPI_MODE0));
+    digitalWrite(DISPLAY_PIN_CS, LOW);
+}
+
+/***************************************************************************************
+ * Function: Display_End()
+ ***************************************************************************************
+ * Description: Release the panel and SPI.
+ **************************************************************************************/
+static void Display_End(void)
+{
+    digitalWrite(DISPLAY_PIN_CS, HIGH);
+    SPI.endTransaction();
+    Power_Release(POWER_SPI, POWER_HOLDER_DISPLAY);
+}
+
+/***************************************************************************************
+ * Function: Display_Busy()
+ ***************************************************************************************
+ * Return: 1 while the panel is refreshing or resetting, 0 otherwise
+ **************************************************************************************/
+static uint8_t Display_Busy(void)
+{
+    return (HIGH == digitalRead(DISPLAY_PIN_BUSY)) ? 1u : 0u;
+}
+
+/***************************************************************************************
+ * Function: Display_ArmBusyEdge()
+ ***************************************************************************************
+ * Description: Catch the end of the refresh just started with the pin change interrupt
+ *              of BUSY.
+ **************************************************************************************/
+static void Display_ArmBusyEdge(void)
+{
+    displayBusyEnd = 0u;
+    PCIFR = _BV(digitalPinToPCICRbit(DISPLAY_PIN_BUSY));
+    *digitalPinToPCMSK(DISPLAY_PIN_BUSY) |= _BV(digitalPinToPCMSKbit(DISPLAY_PIN_BUSY));
+    *digitalPinToPCICR(DISPLAY_PIN_BUSY) |= _BV(digitalPinToPCICRbit(DISPLAY_PIN_BUSY));
+}
+
+/***************************************************************************************
+ * Function: Display_DisarmBusyEdge()
+ ***************************************************************************************
+ * Description: Stop watching BUSY. Nothing else uses pin changes of port C.
+ **************************************************************************************/
+static void Display_DisarmBusyEdge(void)
+{
+    *digitalPinToPCMSK(DISPLAY_PIN_BUSY) &= ~_BV(digitalPinToPCMSKbit(DISPLAY_PIN_BUSY));
+    *digitalPinToPCICR(DISPLAY_PIN_BUSY) &= ~_BV(digitalPinToPCICRbit(DISPLAY_PIN_BUSY));
+}
+
+/***************************************************************************************
+ * Function: ISR(PCINT1_vect)
+ ***************************************************************************************
+ * Description: BUSY (A2, PCINT10) changed while a refresh runs; when it fell the
+ *              refresh is over. The time is taken here and not when Display_Task()
+ *              gets to it, which may be a whole loop later.
+ **************************************************************************************/
+ISR(PCINT1_vect)
+{
+    if(!Display_Busy())
+    {
+        displayBusyEnd = millis();
+        Display_DisarmBusyEdge();
+    }
+}
+
+/***************************************************************************************
+ * Function: Display_Reset()
+ ***************************************************************************************
+ * Description: Hardware reset, the only way out of deep sleep. Deep sleep mode 1 keeps
+ *              both RAMs, so only the registers must be set again.
+ **************************************************************************************/
+static void Display_Reset(void)
+{
+    digitalWrite(DISPLAY_PIN_RESET, LOW);
+    delay(DISPLAY_RESET_TIME);
+    digitalWrite(DISPLAY_PIN_RESET, HIGH);
+    delay(DISPLAY_RESET_TIME);
+}
+
+/***************************************************************************************
+ * Function: Display_Command()
+ ***************************************************************************************
+ * Description: Send a command byte; the bytes sent after it are its data.
+ * Parameters:
+ *  - command[in]   :   SSD1681_* command
+ **************************************************************************************/
+static void Display_Command(uint8_t command)
+{
+    digitalWrite(DISPLAY_PIN_DC, LOW);
+    SPI.transfer(command);
+    digitalWrite(DISPLAY_PIN_DC, HIGH);
+}
+
+/***************************************************************************************
+ * Function: Display_Data()
+ ***************************************************************************************
+ * Description: Send a data byte of the last command.
+ * Parameters:
+ *  - data[in]   :   Byte to send
+ **************************************************************************************/
+static void Display_Data(uint8_t data)
+{
+    SPI.transfer(data);
+}
+#endif /* DISPLAY_HOST */
+
+/***************************************************************************************
+ * Function: Display_WaitReset()
+ ***************************************************************************************
+ * Description: Wait for BUSY to fall after a reset. A panel which stays busy is missing
+ *              or hangs, it is marked absent and left alone from then on.
+ * Return: 0 when the panel is ready, 1 when it timed out
+ **************************************************************************************/
+static uint8_t Display_WaitReset(void)
+{
+    uint32_t start = millis();
+
+    while(Display_Busy())
+    {
+        if(DISPLAY_RESET_TIMEOUT < (millis() - start))
+        {
+            displayAbsent = 1u;
+            return 1u;
+        }
+        delay(1);
+    }
+
+    return 0u;
+}
+
+/***************************************************************************************
+ * Function: Display_Wake()
+ ***************************************************************************************
+ * Description: Reset the panel out of deep sleep and set it up to take rows, top to
+ *              bottom.
+ * Return: 0 when the panel is set up, 1 when it didn't come out of reset
+ **************************************************************************************/
+static uint8_t Display_Wake(void)
+{
+    Display_Reset();
+    if(Display_WaitReset())
+    {
+        return 1u;
+    }
+
+    Display_Begin();
+    Display_Command(SSD1681_SW_RESET);
+    Display_End();
+    if(Display_WaitReset())
+    {
+        return 1u;
+    }
+
+    Display_Begin();
+    Display_Command(SSD1681_DRIVER_OUTPUT);
+    Display_Data(DISPLAY_HEIGHT - 1u);
+    Display_Data(0x00u);
+    Display_Data(0x00u);
+    Display_Command(SSD1681_DATA_ENTRY);
+    Display_Data(0x03u);                    /* X and Y increment */
+    Display_Command(SSD1681_BORDER);
+    Display_Data(0x05u);                    /* White border */
+    Display_Command(SSD1681_TEMP_SENSOR);
+    Display_Data(0x80u);                    /* Internal sensor */
+    Display_End();
+
+    return 0u;
+}
+
+/***************************************************************************************
+ * Function: Display_Scene()
+ ***************************************************************************************
+ * Description: List the sprites of a screen.
+ * Parameters:
+ *  - mood[in]    :   DISPLAY_MOOD_*, DISPLAY_MOOD_UNKNOWN gives an empty screen
+ *  - icon[in]    :   DISPLAY_ICON_*
+ *  - items[out]  :   Room for DISPLAY_ITEM_COUNT sprites
+ * Return: Number of sprites
+ **************************************************************************************/
+static uint8_t Display_Scene(uint8_t mood, uint8_t icon, displayItem_t *items)
+{
+    if(DISPLAY_MOOD_COUNT <= mood)
+    {
+        return 0u;
+    }
+
+    /* Eyes, 64x64 at x 24 and 112 */
+    items[0] = { displayEyes[mood], 3u, 48u, 2u, 16u, 4u };
+    items[1] = { displayEyes[mood], 14u, 48u, 2u, 16u, 4u };
+    /* Mouth, 120x24 in the middle */
+    items[2] = { displayMouths[mood], 5u, 136u, 5u, 8u, 3u };
+    /* Mode icon, 16x16 in the top right corner */
+    items[3] = { displayIcons[icon], 22u, 8u, 1u, 8u, 2u };
+
+    return DISPLAY_ITEM_COUNT;
+}
+
+/***************************************************************************************
+ * Function: Display_RenderRow()
+ ***************************************************************************************
+ * Description: Compose one row of the screen from the sprites which cross it.
+ * Parameters:
+ *  - items[in]   :   Sprites of the screen
+ *  - count[in]   :   Number of sprites
+ *  - y[in]       :   Row to compose
+ *  - row[out]    :   DISPLAY_ROW_BYTES bytes, 1 is ink
+ **************************************************************************************/
+static void Display_RenderRow(const displayItem_t *items, uint8_t count, uint8_t y, uint8_t *row)
+{
+    memset(row, 0, DISPLAY_ROW_BYTES);
+
+    for(uint8_t item = 0u; item < count; item++)
+    {
+        const displayItem_t *sprite = &items[item];
+
+        /* Check if the sprite crosses this row */
+        if((y < sprite->y) || (y >= (sprite->y + (sprite->height * sprite->scale))))
+        {
+            continue;
+        }
+
+        const uint8_t *bits = sprite->bits + (((y - sprite->y) / sprite->scale) * sprite->widthBytes);
+        uint8_t pixel = sprite->x * 8u;
+
+        /* Each sprite bit becomes scale pixels */
+        for(uint8_t column = 0u; column < sprite->widthBytes; column++)
+        {
+            uint8_t spriteByte = pgm_read_byte(bits + column);
+
+            for(uint8_t mask = 0x80u; 0u != mask; mask >>= 1)
+            {
+                if(spriteByte & mask)
+                {
+                    for(uint8_t repeat = 0u; repeat < sprite->scale; repeat++)
+                    {
+                        row[pixel >> 3] |= 0x80u >> (pixel & 7u);
+                        pixel++;
+                    }
+                }
+                else
+                {
+                    pixel += sprite->scale;
+                }
+            }
+        }
+    }
+}
+
+/***************************************************************************************
+ * Function: Display_HashRect()
+ ***************************************************************************************
+ * Description: Hash what a screen shows inside a rectangle.
+ * Parameters:
+ *  - mood[in]   :   DISPLAY_MOOD_* of the screen
+ *  - icon[in]   :   DISPLAY_ICON_* of the screen
+ *  - rect[in]   :   Part of the screen to hash
+ * Return: FNV-1a hash of the rendered bytes
+ **************************************************************************************/
+static uint32_t Display_HashRect(uint8_t mood, uint8_t icon, const displayRect_t *rect)
+{
+    displayItem_t items[DISPLAY_ITEM_COUNT];
+    uint8_t count = Display_Scene(mood, icon, items);
+    uint8_t row[DISPLAY_ROW_BYTES];
+    uint32_t hash = FNV_OFFSET_32;
+
+    for(uint8_t y = rect->y0; y <= rect->y1; y++)
+    {
+        Display_RenderRow(items, count, y, row);
+        for(uint8_t column = rect->x0; column <= rect->x1; column++)
+        {
+            hash = (hash ^ row[column]) * FNV_PRIME_32;
+        }
+    }
+
+    return hash;
+}
+
+/***************************************************************************************
+ * Function: Display_WriteRect()
+ ***************************************************************************************
+ * Description: Stream a rectangle of a screen into one of the panel RAMs, row by row.
+ * Parameters:
+ *  - ram[in]    :   SSD1681_WRITE_RAM_NEW or SSD1681_WRITE_RAM_OLD
+ *  - mood[in]   :   DISPLAY_MOOD_* of the screen
+ *  - icon[in]   :   DISPLAY_ICON_* of the screen
+ *  - rect[in]   :   Part of the screen to send
+ **************************************************************************************/
+static void Display_WriteRect(uint8_t ram, uint8_t mood, uint8_t icon, const displayRect_t *rect)
+{
+    displayItem_t items[DISPLAY_ITEM_COUNT];
+    uint8_t count = Display_Scene(mood, icon, items);
+    uint8_t row[DISPLAY_ROW_BYTES];
+
+    Display_Begin();
+    Display_Command(SSD1681_RAM_X_RANGE);
+    Display_Data(rect->x0);
+    Display_Data(rect->x1);
+    Display_Command(SSD1681_RAM_Y_RANGE);
+    Display_Data(rect->y0);
+    Display_Data(0x00u);
+    Display_Data(rect->y1);
+    Display_Data(0x00u);
+    Display_Command(SSD1681_RAM_X_COUNTER);
+    Display_Data(rect->x0);
+    Display_Command(SSD1681_RAM_Y_COUNTER);
+    Display_Data(rect->y0);
+    Display_Data(0x00u);
+    Display_Command(ram);
+    for(uint8_t y = rect->y0; y <= rect->y1; y++)
+    {
+        Display_RenderRow(items, count, y, row);
+
+        /* Panel RAM has 1 for white */
+        for(uint8_t column = rect->x0; column <= rect->x1; column++)
+        {
+            Display_Data(~row[column]);
+        }
+    }
+    Display_End();
+}
+
+/***************************************************************************************
+ * Function: Display_RectArea()
+ ***************************************************************************************
+ * Return: Bytes of panel RAM covered by the rectangle
+ **************************************************************************************/
+static uint16_t Display_RectArea(const displayRect_t *rect)
+{
+    return (uint16_t)(rect->x1 - rect->x0 + 1u) * (uint16_t)(rect->y1 - rect->y0 + 1u);
+}
+
+/***************************************************************************************
+ * Function: Display_AddRect()
+ ***************************************************************************************
+ * Description: Add a dirty rectangle. It is merged with the ones it overlaps or which
+ *              are so close that sending them together costs about the same.
+ * Parameters:
+ *  - rect[in]   :   Dirty rectangle
+ **************************************************************************************/
+static void Display_AddRect(displayRect_t rect)
+{
+    uint8_t index = 0u;
+
+    while(index < displayRectCount)
+    {
+        displayRect_t *other = &displayRects[index];
+        displayRect_t merged;
+
+        merged.x0 = (rect.x0 < other->x0) ? rect.x0 : other->x0;
+        merged.x1 = (rect.x1 > other->x1) ? rect.x1 : other->x1;
+        merged.y0 = (rect.y0 < other->y0) ? rect.y0 : other->y0;
+        merged.y1 = (rect.y1 > other->y1) ? rect.y1 : other->y1;
+
+        if((Display_RectArea(&merged) * DISPLAY_MERGE_SLACK) <=
+           ((Display_RectArea(&rect) + Display_RectArea(other)) * (DISPLAY_MERGE_SLACK + 1u)))
+        {
+            /* Take the other one out and try the union again, it may reach more */
+            rect = merged;
+            displayRectCount--;
+            displayRects[index] = displayRects[displayRectCount];
+            index = 0u;
+        }
+        else
+        {
+            index++;
+        }
+    }
+
+    displayRects[displayRectCount++] = rect;
+}
+
+/***************************************************************************************
+ * Function: Display_FindDirty()
+ ***************************************************************************************
+ * Description: Find the rectangles which differ between the shown and the wanted
+ *              screen. Sprites which changed but render the same, are dropped by hash.
+ * Parameters:
+ *  - kind[in]   :   DISPLAY_REFRESH_* which will be used
+ **************************************************************************************/
+static void Display_FindDirty(uint8_t kind)
+{
+    displayItem_t shown[DISPLAY_ITEM_COUNT];
+    displayItem_t wanted[DISPLAY_ITEM_COUNT];
+    uint8_t shownCount = Display_Scene(displayShownMood, displayShownIcon, shown);
+    uint8_t wantedCount = Display_Scene(displayWantedMood, displayWantedIcon, wanted);
+    uint8_t index = 0u;
+
+    displayRectCount = 0u;
+
+    /* Full refresh sends the whole screen */
+    if((DISPLAY_REFRESH_FULL == kind) || (shownCount != wantedCount))
+    {
+        displayRects[0] = { 0u, DISPLAY_ROW_BYTES - 1u, 0u, DISPLAY_HEIGHT - 1u };
+        displayRectCount = 1u;
+        return;
+    }
+
+    /* Sprites keep their place, only the image can change */
+    for(uint8_t item = 0u; item < wantedCount; item++)
+    {
+        if(shown[item].bits != wanted[item].bits)
+        {
+            Display_AddRect({ wanted[item].x, (uint8_t)(wanted[item].x + (wanted[item].widthBytes * wanted[item].scale) - 1u),
+                              wanted[item].y, (uint8_t)(wanted[item].y + (wanted[item].height * wanted[item].scale) - 1u) });
+        }
+    }
+
+    /* Drop what renders the same */
+    while(index < displayRectCount)
+    {
+        if(Display_HashRect(displayShownMood, displayShownIcon, &displayRects[index]) ==
+           Display_HashRect(displayWantedMood, displayWantedIcon, &displayRects[index]))
+        {
+            displayRectCount--;
+            displayRects[index] = displayRects[displayRectCount];
+        }
+        else
+        {
+            index++;
+        }
+    }
+}
+
+/***************************************************************************************
+ * Function: Display_Refresh()
+ ***************************************************************************************
+ * Description: Send the dirty rectangles of the wanted screen and start refreshing.
+ *              The old RAM holds the shown screen, so a partial refresh only flips the
+ *              pixels which changed.
+ * Parameters:
+ *  - kind[in]   :   DISPLAY_REFRESH_* to use
+ **************************************************************************************/
+static void Display_Refresh(uint8_t kind)
+{
+    if(Display_Wake())
+    {
+        return;
+    }
+
+    for(uint8_t index = 0u; index < displayRectCount; index++)
+    {
+        Display_WriteRect(SSD1681_WRITE_RAM_NEW, displayWantedMood, displayWantedIcon, &displayRects[index]);
+    }
+
+    Display_Begin();
+    Display_Command(SSD1681_UPDATE_CONTROL);
+    Display_Data((DISPLAY_REFRESH_FULL == kind) ? SSD1681_UPDATE_FULL : SSD1681_UPDATE_PARTIAL);
+    Display_Command(SSD1681_ACTIVATE);
+    Display_End();
+
+    displayRefreshStart = millis();
+    Display_ArmBusyEdge();
+    displayRefresh = kind;
+    displayPartials = (DISPLAY_REFRESH_FULL == kind) ? 0u : (displayPartials + 1u);
+    displayShownMood = displayWantedMood;
+    displayShownIcon = displayWantedIcon;
+}
+
+/***************************************************************************************
+ * Function: Display_Finish()
+ ***************************************************************************************
+ * Description: The refresh is done. Account its energy, copy the new rectangles into
+ *              the old RAM for the next partial refresh and put the panel to sleep.
+ *              The refresh lasted until BUSY fell, not until the loop noticed it.
+ **************************************************************************************/
+static void Display_Finish(void)
+{
+    uint32_t end = (0u != displayBusyEnd) ? displayBusyEnd : millis();
+    /* Microjoules = mV * mA * ms / 1000 */
+    uint32_t energy = ((uint32_t)displayBatteryMilliVolts * DISPLAY_REFRESH_MILLIAMPS * (end - displayRefreshStart)) / 1000u;
+
+    displayEnergy[displayRefresh] = ((displayEnergy[displayRefresh] * 3u) + energy) / 4u;
+    displayBudget = (displayBudget > energy) ? (displayBudget - energy) : 0u;
+    displayEnergyTotal += energy;
+    displayRefreshes++;
+
+    for(uint8_t index = 0u; index < displayRectCount; index++)
+    {
+        Display_WriteRect(SSD1681_WRITE_RAM_OLD, displayShownMood, displayShownIcon, &displayRects[index]);
+    }
+
+    /* The image stays without power */
+    Display_Begin();
+    Display_Command(SSD1681_DEEP_SLEEP);
+    Display_Data(0x01u);
+    Display_End();
+    displayRefresh = DISPLAY_REFRESH_NONE;
+}
+
+/***************************************************************************************
+ * Function: Display_Init()
+ ***************************************************************************************
+ * Description: Setup the pins. Nothing is drawn until Display_Show() is called.
+ **************************************************************************************/
+void Display_Init(void)
+{
+#ifndef DISPLAY_HOST
+    pinMode(DISPLAY_PIN_CS, OUTPUT);
+    digitalWrite(DISPLAY_PIN_CS, HIGH);
+    pinMode(DISPLAY_PIN_DC, OUTPUT);
+    pinMode(DISPLAY_PIN_RESET, OUTPUT);
+    digitalWrite(DISPLAY_PIN_RESET, HIGH);
+    pinMode(DISPLAY_PIN_BUSY, INPUT);
+    Power_Hold(POWER_DIGITAL_A2, POWER_HOLDER_DISPLAY);
+    SPI.begin();
+#endif
+
+    displayStatsStart = millis();
+    displayBudgetTime = millis();
+}
+
+/***************************************************************************************
+ * Function: Display_Show()
+ ***************************************************************************************
+ * Description: Ask for a screen. The panel is refreshed only if it shows something
+ *              else and the budget allows it; until then the newest screen waits.
+ * Parameters:
+ *  - mood[in]   :   DISPLAY_MOOD_* to show
+ *  - icon[in]   :   DISPLAY_ICON_* of the explore mode
+ **************************************************************************************/
+void Display_Show(uint8_t mood, uint8_t icon)
+{
+    displayWantedMood = mood;
+    displayWantedIcon = icon;
+
+    Display_Task();
+}
+
+/***************************************************************************************
+ * Function: Display_SetBattery()
+ ***************************************************************************************
+ * Description: Battery voltage used to estimate the energy of the refreshes.
+ * Parameters:
+ *  - batteryMilliVolts[in]   :   Battery voltage
+ **************************************************************************************/
+void Display_SetBattery(uint16_t batteryMilliVolts)
+{
+    displayBatteryMilliVolts = batteryMilliVolts;
+}
+
+/***************************************************************************************
+ * Function: Display_Task()
+ ***************************************************************************************
+ * Description: Refill the energy budget, finish a refresh and start the next one when
+ *              the budget allows it. Doesn't wait for the panel, call it every loop.
+ *              Does nothing once the panel was found absent.
+ **************************************************************************************/
+void Display_Task(void)
+{
+    uint32_t now = millis();
+    uint32_t seconds = (now - displayBudgetTime) / 1000u;
+    uint8_t kind;
+
+    /* Refill in whole seconds so nothing is lost to rounding */
+    displayBudgetTime += seconds * 1000u;
+    displayBudget += seconds * DISPLAY_BUDGET_PER_SECOND;
+    displayBudget = (DISPLAY_BUDGET_MAX < displayBudget) ? DISPLAY_BUDGET_MAX : displayBudget;
+
+    if(displayAbsent)
+    {
+        return;
+    }
+
+    if(DISPLAY_REFRESH_NONE != displayRefresh)
+    {
+        if(Display_Busy() && (DISPLAY_REFRESH_TIMEOUT >= (now - displayRefreshStart)))
+        {
+            return;
+        }
+        else if(Display_Busy())
+        {
+            /* Refresh never ended, the panel hangs or is gone */
+            Display_DisarmBusyEdge();
+            displayRefresh = DISPLAY_REFRESH_NONE;
+            displayAbsent = 1u;
+            return;
+        }
+        Display_Finish();
+    }
+
+    if((displayWantedMood == displayShownMood) && (displayWantedIcon == displayShownIcon))
+    {
+        return;
+    }
+
+    /* Wait for the budget, the first refresh and forced ones go at once */
+    kind = ((DISPLAY_MOOD_UNKNOWN == displayShownMood) || (DISPLAY_FULL_REFRESH_EVERY <= displayPartials)) ?
+           DISPLAY_REFRESH_FULL : DISPLAY_REFRESH_PARTIAL;
+    if(!displayForce && (DISPLAY_MOOD_UNKNOWN != displayShownMood) &&
+       (((now - displayRefreshStart) < DISPLAY_MIN_INTERVAL) || (displayBudget < displayEnergy[kind])))
+    {
+        return;
+    }
+
+    Display_FindDirty(kind);
+    if(0u == displayRectCount)
+    {
+        /* Looks the same, nothing to refresh */
+        displaySkipped++;
+        displayShownMood = displayWantedMood;
+        displayShownIcon = displayWantedIcon;
+    }
+    else
+    {
+        Display_Refresh(kind);
+    }
+}
+
+/***************************************************************************************
+ * Function: Display_Wait()
+ ***************************************************************************************
+ * Description: Show the wanted screen now, without waiting for the budget, and put the
+ *              panel to sleep. Used before the Robot sleeps. A hanging panel is given
+ *              up after DISPLAY_REFRESH_TIMEOUT. The watchdog is kept alive meanwhile,
+ *              a refresh still running may be followed by the wanted one.
+ **************************************************************************************/
+void Display_Wait(void)
+{
+    displayForce = 1u;
+    Display_Task();
+    while(DISPLAY_REFRESH_NONE != displayRefresh)
+    {
+        wdt_reset();
+        delay(1);
+        Display_Task();
+    }
+    displayForce = 0u;
+}
+
+/***************************************************************************************
+ * Function: Display_GetStats()
+ ***************************************************************************************
+ * Description: Refresh statistics for telemetry.
+ * Parameters:
+ *  - stats[out]   :   Refreshes per hour, skipped refreshes and energy per refresh
+ **************************************************************************************/
+void Display_GetStats(displayStats_t *stats)
+{
+    uint32_t seconds = (millis() - displayStatsStart) / 1000u;
+
+    stats->refreshesPerHour = (0u == seconds) ? displayRefreshes : (uint16_t)(((uint32_t)displayRefreshes * 3600u) / seconds);
+    stats->skipped = displaySkipped;
+    stats->energyPerRefresh = (0u == displayRefreshes) ? 0u : (displayEnergyTotal / displayRefreshes);
+}
+
+#ifdef DISPLAY_HOST
+/***************************************************************************************
+ * Function: Display_HostRender()
+ ***************************************************************************************
+ * Description: Render a whole screen like a full refresh would show it, to compare the
+ *              emulated panel with.
+ * Parameters:
+ *  - mood[in]    :   DISPLAY_MOOD_* of the screen
+ *  - icon[in]    :   DISPLAY_ICON_* of the screen
+ *  - image[out]  :   DISPLAY_ROW_BYTES * DISPLAY_HEIGHT bytes, panel RAM format
+ **************************************************************************************/
+void Display_HostRender(uint8_t mood, uint8_t icon, uint8_t *image)
+{
+    displayItem_t items[DISPLAY_ITEM_COUNT];
+    uint8_t count = Display_Scene(mood, icon, items);
+
+    for(uint8_t y = 0u; y < DISPLAY_HEIGHT; y++)
+    {
+        Display_RenderRow(items, count, y, &image[y * DISPLAY_ROW_BYTES]);
+        for(uint8_t column = 0u; column < DISPLAY_ROW_BYTES; column++)
+        {
+            image[(y * DISPLAY_ROW_BYTES) + column] = ~image[(y * DISPLAY_ROW_BYTES) + column];
+        }
+    }
+}
+#endif /* DISPLAY_HOST */
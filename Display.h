@@ -0,0 +1,68 @@
+#ifndef DISPLAY_H
+#define DISPLAY_H
+/***************************************************************************************
+ * Display
+ ***************************************************************************************
+ * Draws the emotions of the Robot on a 1.54" 200x200 SPI e-paper with an SSD1681
+ * controller. There is no framebuffer: the screen is a function of the mood and of the
+ * mode icon, so each row is composed from PROGMEM sprites while it is streamed.
+ * A refresh costs more energy than anything else, so the panel is refreshed only when
+ * the mood or the mode changes, partially most of the time, and sleeps in between.
+ * Only the rectangles whose sprites changed are sent, and refreshes are held back until
+ * DISPLAY_MIN_INTERVAL passed and the energy budget has room for them.
+ * Define DISPLAY_HOST to build on a PC: the panel is emulated and every refresh is
+ * saved as a PBM image. The PC program provides millis(), delay() and wdt_reset().
+ * A panel whose BUSY stays high is given up; the Robot runs on without a display.
+ **************************************************************************************/
+#include <stdint.h>
+
+/* Pins, D10 - D13 are the SPI pins */
+#define DISPLAY_PIN_CS          10
+#define DISPLAY_PIN_DC          8       /* Low for commands, high for data */
+#define DISPLAY_PIN_RESET       A1
+#define DISPLAY_PIN_BUSY        A2      /* High while the panel refreshes */
+
+/* Moods */
+#define DISPLAY_MOOD_HAPPY      0u      /* Battery is full */
+#define DISPLAY_MOOD_CALM       1u
+#define DISPLAY_MOOD_TIRED      2u      /* Battery is getting low */
+#define DISPLAY_MOOD_SLEEPING   3u
+#define DISPLAY_MOOD_COUNT      4u
+#define DISPLAY_MOOD_UNKNOWN    0xFFu   /* Panel content is not known, after boot */
+
+/* Mode icons */
+#define DISPLAY_ICON_AUTOMATE   0u
+#define DISPLAY_ICON_MANUAL     1u
+
+#define DISPLAY_FULL_REFRESH_EVERY  20u /* Partial refreshes before a full one clears the ghosting */
+
+/* Refresh budget; refreshes wait until both the interval and the energy allow them */
+#define DISPLAY_MIN_INTERVAL        10000u  /* Miliseconds between two refreshes, unless the Robot goes to sleep */
+#define DISPLAY_REFRESH_MILLIAMPS   4u      /* Panel current while refreshing */
+#define DISPLAY_BUDGET_PER_SECOND   40u     /* Microjoules, about 24 partial refreshes an hour */
+#define DISPLAY_BUDGET_MAX          60000u  /* Microjoules which can be saved up, 2 full refreshes */
+
+/* Sent on telemetry */
+typedef struct
+{
+    uint16_t refreshesPerHour;  /* Since Display_Init() */
+    uint16_t skipped;           /* Refreshes skipped because the content didn't change */
+    uint32_t energyPerRefresh;  /* Microjoules, estimated from battery voltage and refresh time */
+} displayStats_t;
+
+void Display_Init(void);
+void Display_Show(uint8_t mood, uint8_t icon);
+void Display_SetBattery(uint16_t batteryMilliVolts);
+void Display_Task(void);
+void Display_Wait(void);
+void Display_GetStats(displayStats_t *stats);
+
+#ifdef DISPLAY_HOST
+/* Emulated panel, see tools/displaysim.cpp */
+#define DISPLAY_HOST_IMAGE_SIZE     ((200u / 8u) * 200u)
+const uint8_t *Display_HostPanel(void);
+void Display_HostRender(uint8_t mood, uint8_t icon, uint8_t *image);
+void Display_HostBusyStuck(uint8_t stuck);
+#endif
+
+#endif /* DISPLAY_H */
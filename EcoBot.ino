@@ -2,8 +2,16 @@
  * Includes
  **************************************************************************************/
 #include "Notes.h"
+#include "Build.h"
 #include "IRremote.h"
+#include "IRremoteInt.h"
+#include "Profiler.h"
+#include "Display.h"
+#include "Energy.h"
+#include "Power.h"
 #include <LowPower.h>
+#include <EEPROM.h>
+#include <avr/wdt.h>
 
 /***************************************************************************************
  * Macros
@@ -14,14 +22,19 @@
 #define DELAY_1_SECOND  1000
 #define DELAY_DEFAULT   DELAY_1_SECOND
 #define SERIAL_BRATE    115200
+#ifdef DEV_BUILD
 static byte devStuff = E_OK;
+#else
+static byte devStuff = E_NOT_OK;
+#endif
 /* General Stuff end */
 
 /* Motor Stuff */
-#define PIN_MA_ENABLE         3
+/* Both enables are Timer0 PWM pins(OC0A, OC0B); Timer2 runs the IR Receiver in CTC mode and can't PWM D3 */
+#define PIN_MA_ENABLE         6
 #define PIN_MA_PHASE          4
 #define PIN_MB_ENABLE         5
-#define PIN_MB_PHASE          6
+#define PIN_MB_PHASE          3
 #define PIN_DRV8834_SLEEP     7
 
 #define DRV8834_MOTOR_A             1u
@@ -33,10 +46,67 @@ static byte devStuff = E_OK;
 #define DRV8834_POWER_HALF          127u
 #define DRV8834_POWER_NONE          0u
 #define DRV8834_WAKEUP_WAIT         1     /* Miliseconds until DRV8834 should be fully working after wakeup */
+#define DRV8834_IDLE_SLEEP_TIME     3000  /* Miliseconds with both motors stopped before the DRV8834 sleeps */
+#define DRV8834_STATE_ASLEEP        0u
+#define DRV8834_STATE_WAKING        1u    /* Waiting DRV8834_WAKEUP_WAIT, the motor powers are pending */
+#define DRV8834_STATE_AWAKE         2u
+#define DRV8834_BRAKE_TIME          50    /* Miliseconds a braked motor needs to stand still before it is reversed */
 #define DRV8834_WALK_TIME           100
 #define DRV8834_BREAK_TIMEOUT       115   /* Lower than this and the timeout is too short */
+
+static byte motorDriverState = DRV8834_STATE_ASLEEP;
+static unsigned long motorDriverTime = 0u;  /* Start of the wake up, or when the last motor stopped */
+static byte motorRunning = 0u;              /* DRV8834_MOTOR_* bits of the motors with power */
+static byte motorPending = 0u;              /* DRV8834_MOTOR_* bits of the motors waiting for the wake up */
+static byte motorPendingPower[2];           /* Power of Motor A and B once the DRV8834 is awake */
+static byte motorDirections = DRV8834_MOTOR_BOTH;   /* DRV8834_MOTOR_* bits of the motors set to Forward */
+static byte motorReversing = 0u;            /* DRV8834_MOTOR_* bits of the motors braking before they are reversed */
+static byte motorReversePower[2];           /* Power of Motor A and B once reversed */
+static unsigned long motorStopTime[2] = {0u, 0u};   /* When Motor A and B last lost their power */
 /* Motor Stuff end */
 
+/* Drive Stuff */
+/* Differential drive: Motor A is the left wheel, Motor B the right one. Velocities are Q8 fixed point,
+ * DRIVE_SPEED_FULL is full power forward on both wheels. Angular velocity is the speed each wheel
+ * adds on its side, positive turns left */
+#define DRIVE_SPEED_FULL            256     /* 1.0 in Q8 */
+#define DRIVE_SPEED_HALF            128
+#define DRIVE_SPEED_NONE            0
+#define DRIVE_TRIM_UNITY            256u    /* 1.0 in Q8 */
+#define DRIVE_TRIM_A                256u    /* Lower the trim of the faster motor so the Robot drives straight */
+#define DRIVE_TRIM_B                256u
+#define DRIVE_WHEEL_A               0u
+#define DRIVE_WHEEL_B               1u
+
+static const uint16_t driveTrim[2] = { DRIVE_TRIM_A, DRIVE_TRIM_B };
+/* Drive Stuff end */
+
+/* Motion Stuff */
+/* Queue of timed motion steps, run by Motion_Task() on millis() deadlines */
+#define MOTION_QUEUE_SIZE           8u
+#define MOTION_DRIVE                0u      /* Drive straight, speed is Q8 linear velocity */
+#define MOTION_ROTATE               1u      /* Rotate in place, speed is Q8 angular velocity */
+#define MOTION_PAUSE                2u      /* Stand still */
+#define MOTION_BRAKE                3u      /* Stop, done at once */
+
+/* Called when a step is done, it may queue the next steps */
+typedef void (*motionDone_t)(void);
+
+typedef struct
+{
+    byte kind;
+    int16_t speed;
+    uint16_t duration;          /* Miliseconds */
+    motionDone_t done;          /* NULL when nobody waits for it */
+} motionStep_t;
+
+static motionStep_t motionQueue[MOTION_QUEUE_SIZE];
+static byte motionHead = 0u;
+static byte motionCount = 0u;
+static byte motionStarted = E_NOT_OK;   /* E_OK once the step at motionHead runs */
+static unsigned long motionStart;
+/* Motion Stuff end */
+
 /* Exploration Stuff */
 #define EXPLORE_AUTOMATE  0u    /* Autonomous driving */
 #define EXPLORE_MANUAL    1u    /* Manual driving from IR */
@@ -44,6 +114,39 @@ static byte devStuff = E_OK;
 static byte exploreState = EXPLORE_AUTOMATE;
 /* Exploration Stuff end */
 
+/* Beacon Stuff */
+/* Beacons are NEC frames: BEACON_ADDRESS, ~BEACON_ADDRESS, data, ~data
+ * data holds the kind of beacon in the upper 3 bits and its ID in the lower 5 bits */
+#define BEACON_ADDRESS          0xECu   /* Reserved NEC address, no remote uses it */
+#define BEACON_KIND_ECOBOT      0u      /* Another EcoBot saying hello */
+#define BEACON_KIND_CHARGER     1u      /* Charging spot */
+#define BEACON_KIND_SUN         2u      /* Sunny spot, good for the Solar Panel */
+#define BEACON_OWN_ID           1u      /* ID this robot broadcasts, 0 - 31 */
+#define BEACON_PERIOD           500     /* Miliseconds between own broadcasts */
+
+#define BEACON_STATE_IDLE       0u      /* Listening for a beacon to home on */
+#define BEACON_STATE_ROTATE     1u      /* Scan: rotate one step */
+#define BEACON_STATE_LISTEN     2u      /* Scan: stand still and count beacon frames */
+#define BEACON_STATE_TURN       3u      /* Rotate to the best bearing */
+#define BEACON_STATE_APPROACH   4u      /* Drive towards the beacon */
+#define BEACON_STATE_DOCKED     5u      /* Beacon reached */
+
+#define BEACON_SCAN_STEPS       12u     /* Steps in a full rotation, about 30 degrees each */
+#define BEACON_STEP_TIME        DRV8834_WALK_TIME   /* Miliseconds of rotation for one step */
+#define BEACON_LISTEN_TIME      1500    /* Miliseconds to count frames on each step, 3 beacon periods */
+#define BEACON_APPROACH_TIME    2000    /* Miliseconds to drive before scanning again, less the wider it is heard */
+#define BEACON_LOST_TIMEOUT     30000   /* Miliseconds without a frame before homing is given up */
+#define BEACON_FULL_COUNT       3u      /* Frames per listen window when every beacon was heard */
+#define BEACON_DOCKED_STEPS     9u      /* Scan steps hearing every frame once close, far away only the steps facing it do; see tools/beaconsim.cpp */
+
+static byte beaconState = BEACON_STATE_IDLE;
+static byte beaconTarget;                           /* Kind and ID byte of the homed beacon */
+static byte beaconStep;                             /* Scan step being measured */
+static byte beaconHits[BEACON_SCAN_STEPS];          /* Frames received on each scan step */
+static unsigned long beaconTime;                    /* Start of the current state */
+static unsigned long beaconLastHeard;               /* Last time the homed beacon was received */
+/* Beacon Stuff end */
+
 /* IR Stuff */
 #define PIN_IR_RECEIVER_POWER   A0    /* Power the IR Receiver with this pin */
 #define PIN_IR_RECEIVER_DATA    9     /* Read data from IR Receiver with this pin */
@@ -53,23 +156,550 @@ static byte exploreState = EXPLORE_AUTOMATE;
 #define IR_VALUE_LEFT           0xFF10EF    /* Rotate Left */
 #define IR_VALUE_RIGHT          0xFF5AA5    /* Rotate Right */
 #define IR_VALUE_MODE           0xFF38C7    /* Switch between Manual and Automate Exploring */
+#define IR_VALUE_LEARN          0xFF9867    /* Start learning a new Remote */
 
 IRrecv irrecv(PIN_IR_RECEIVER_DATA);
 decode_results results;
+#ifdef IR_SEND_ASYNC
+IRsend irsend;      /* Beacon; IR LED is on TIMER_PWM_PIN */
+#endif
 /* IR Stuff end */
 
+/* EEPROM Stuff */
+#define EEPROM_ADDRESS_KEYMAP   0u      /* KEYMAP_EEPROM_SIZE bytes */
+#define EEPROM_ADDRESS_SUPERVISOR 32u   /* sizeof(supervisorCounters_t) bytes */
+#define EEPROM_ADDRESS_BATTERY  48u     /* sizeof(batteryCalibration_t) bytes */
+#define EEPROM_ADDRESS_CRUISE   52u     /* sizeof(cruiseCalibration_t) bytes */
+#define EEPROM_ADDRESS_LOG      512u    /* LOG_EEPROM_SIZE bytes, upper half is kept for the log */
+/* EEPROM Stuff end */
+
+/* Keymap Stuff */
+#define KEYMAP_ACTION_NONE      0u
+#define KEYMAP_ACTION_FORWARD   1u
+#define KEYMAP_ACTION_BACKWARD  2u
+#define KEYMAP_ACTION_LEFT      3u
+#define KEYMAP_ACTION_RIGHT     4u
+#define KEYMAP_ACTION_MODE      5u
+#define KEYMAP_ACTION_LEARN     6u
+#define KEYMAP_ACTION_COUNT     6u      /* Number of actions that can be mapped, NONE excluded */
+
+#define KEYMAP_TABLE_BITS       3u
+#define KEYMAP_TABLE_SIZE       (1u << KEYMAP_TABLE_BITS)   /* Must stay bigger than KEYMAP_ACTION_COUNT */
+#define KEYMAP_HASH_MULTIPLIER  2654435761UL                /* Knuth multiplicative hash */
+#define KEYMAP_LEARN_INACTIVE   0xFFu
+#define KEYMAP_BLINK_TIME       100     /* Miliseconds the LED goes off for an accepted code */
+#define KEYMAP_EEPROM_MAGIC     0xECu
+#define KEYMAP_EEPROM_SIZE      (1u + (KEYMAP_ACTION_COUNT * sizeof(unsigned long)) + 1u)   /* Magic + Codes + Checksum */
+
+/* One slot of the RAM lookup table; empty slots have action KEYMAP_ACTION_NONE */
+typedef struct
+{
+    unsigned long code;
+    byte action;
+} keymapEntry_t;
+
+static keymapEntry_t keymapTable[KEYMAP_TABLE_SIZE];
+static unsigned long keymapCodes[KEYMAP_ACTION_COUNT];      /* Code of each action, index is action - 1 */
+static byte keymapLearnIndex = KEYMAP_LEARN_INACTIVE;       /* Index of the action waiting for a code */
+static byte keymapBlinking = E_NOT_OK;                      /* E_OK while the LED blinks for an accepted code */
+static unsigned long keymapBlinkTime;
+/* Keymap Stuff end */
+
+/* Log Stuff */
+/* Events are queued in RAM and written to a circular log in EEPROM in batches, see tools/eventlog.py
+ * Every slot is written once per lap of the log, so the wear is spread over all of them */
+#define LOG_EVENT_BOOT          1u      /* Data: reset flags from MCUSR */
+#define LOG_EVENT_WATCHDOG      2u      /* Data: reset flags from MCUSR */
+#define LOG_EVENT_SLEEP         3u      /* Data: battery voltage in mV */
+#define LOG_EVENT_WAKE          4u      /* Data: seconds slept */
+#define LOG_EVENT_BATTERY_LOW   5u      /* Data: battery voltage in mV */
+#define LOG_EVENT_BATTERY_OK    6u      /* Data: battery voltage in mV */
+#define LOG_EVENT_MODE          7u      /* Data: new EXPLORE_* state */
+#define LOG_EVENT_BROWNOUT      8u      /* Data: reset flags from MCUSR */
+#define LOG_EVENT_SAFE_STATE    9u      /* Data: faults in a row */
+#define LOG_EVENT_WAKE_IR       10u     /* Data: battery voltage in mV, the remote ended hibernation on a low battery */
+#define LOG_EVENT_WAKE_INSOMNIA 11u     /* Data: battery voltage in mV, Insomnia ended hibernation on a low battery */
+
+#define LOG_RECORD_COUNT        48u     /* Slots in EEPROM */
+#define LOG_EEPROM_SIZE         (LOG_RECORD_COUNT * sizeof(logRecord_t))
+#define LOG_EEPROM_MAGIC        0x5Au   /* Checksum seed, so a zeroed slot is not valid */
+#define LOG_SEQUENCE_EMPTY      0xFFFFu /* Sequence of an erased slot */
+#define LOG_QUEUE_SIZE          4u      /* Events kept in RAM before they are written */
+#define LOG_FLUSH_PERIOD        60000   /* Miliseconds, queued events are written at least this often */
+
+/* One event; the sequence tells the order of the slots in EEPROM */
+typedef struct
+{
+    uint32_t time;          /* Seconds since boot, sleep included */
+    uint16_t sequence;
+    uint16_t data;
+    byte type;              /* LOG_EVENT_* */
+    byte checksum;          /* XOR of the other bytes and LOG_EEPROM_MAGIC */
+} logRecord_t;
+
+static logRecord_t logQueue[LOG_QUEUE_SIZE];
+static byte logQueued = 0u;                 /* Events waiting in logQueue */
+static byte logSlot = 0u;                   /* Next slot to write in EEPROM */
+static uint16_t logSequence = 0u;           /* Sequence of the next event */
+static uint32_t logSleptSeconds = 0u;       /* Seconds spent in power down, millis() doesn't count them */
+/* Log Stuff end */
+
+/* Supervisor Stuff */
+/* Longest stretches between two kicks of the watchdog, Supervisor_Task() kicks it once per loop:
+ * - Motor_TestMotor() when Robot_Testing() runs it: 2s of run and pause
+ * - Robot_Sleep(): Log_Flush() up to 136ms(4 records of 10 bytes, 3.4ms per EEPROM byte), the display
+ *   wake up up to 120ms, sending the image about 50ms and delay(100) of Dev Builds, below 0.5s.
+ *   Display_Wait() kicks it while the panel refreshes, a hanging one is given up after 3s
+ * - Cruise_ReadMilliVolts() without the divider: 140ms
+ * 4s is twice the longest of them */
+#define SUPERVISOR_WATCHDOG_TIMEOUT WDTO_4S
+#define SUPERVISOR_EEPROM_MAGIC     0xECu
+#define SUPERVISOR_RESET_CAUSES     4u          /* PORF, EXTRF, BORF and WDRF are bits 0 - 3 of MCUSR */
+#define SUPERVISOR_MAX_FAULTS       3u          /* Watchdog or brownout resets in a row before the safe state */
+#define SUPERVISOR_HEALTHY_TIME     60000       /* Miliseconds of running which clear the faults */
+#define SUPERVISOR_SAFE_SLEEP       3600u       /* Seconds to sleep in the safe state before trying again */
+
+/* Kept in EEPROM so the counts survive resets */
+typedef struct
+{
+    byte magic;
+    byte faults;                                /* Watchdog or brownout resets in a row */
+    uint16_t resets[SUPERVISOR_RESET_CAUSES];   /* Resets of each cause, index is the MCUSR bit */
+} supervisorCounters_t;
+
+/* MCUSR is saved in .init3, before the C startup clears .bss, so it must live in .noinit */
+static byte supervisorResetFlags __attribute__((section(".noinit")));
+/* Supervisor Stuff end */
+
 /* Power Management Stuff */
 #define PIN_BATTERY_LEVEL           A3
 #define PIN_INSOMNIA          	    2       /* Used for development purpose to keep the Robot awake */
-#define ADC_MAX_VALUE               1023.0
-#define ADC_MAX_VOLTAGE             3.3
-#define BATTERY_SLEEP_THRESHOLD     3.3     /* Voltage drops by 0.05 V when motors are working */
+#define ADC_MAX_VALUE               1023u
+#define ADC_MUX_BANDGAP             (_BV(REFS0) | _BV(MUX3) | _BV(MUX2) | _BV(MUX1))   /* 1.1V bandgap against AVCC */
 #define ROBOT_SLEEP_1_SECOND        1
 #define ROBOT_SLEEP_10_SECONDS      10
 #define ROBOT_SLEEP_1_MINUTE        60
-#define ROBOT_SLEEP_TIME_DEFAULT    ROBOT_SLEEP_1_SECOND
+/* Hibernation: the Robot sleeps until the sun charged the battery, waking only to measure it */
+#define HIBERNATE_ENTER_PERCENT     5u      /* Hibernate below this, about 3.45V at rest */
+#define HIBERNATE_EXIT_PERCENT      10u     /* Wake up at this, so a little charge doesn't wake the Robot every time */
+#define HIBERNATE_SLEEP_MIN         ROBOT_SLEEP_10_SECONDS  /* First sleep, doubled after every measurement */
+#define HIBERNATE_SLEEP_MAX         (5u * ROBOT_SLEEP_1_MINUTE)
+/* Wake on IR: the IR Receiver stays on while sleeping and its first edge wakes the Robot */
+#define ROBOT_SLEEP_LISTEN          E_OK    /* E_NOT_OK saves the 0.4mA of the IR Receiver, only Insomnia wakes the Robot then */
+#define ROBOT_WAKE_TIMER            0u      /* Slept all the time */
+#define ROBOT_WAKE_IR               1u      /* Woken by the remote */
+#define ROBOT_WAKE_INSOMNIA         2u      /* Woken or kept awake by Insomnia */
+#define ROBOT_ROUSED_TIME           60000   /* Miliseconds the Robot stays awake on a low battery after being woken */
+#define IR_WAKE_MARK_TICKS          44u     /* 50us ticks of the header mark lost while waking: 2ms crystal start-up and the wake code */
+
+static volatile byte robotWakeSource = ROBOT_WAKE_TIMER;
+static byte robotRoused = E_NOT_OK;         /* E_OK for ROBOT_ROUSED_TIME after the remote or Insomnia woke the Robot */
+static unsigned long robotRousedTime;
+/* How the battery is wired */
+#define BATTERY_MEASURE_DIVIDER     0u      /* Battery on PIN_BATTERY_LEVEL through the R1 = R2 divider */
+#define BATTERY_MEASURE_VCC         1u      /* Battery straight on VCC, no divider and no regulator: VCC is the battery */
+#define BATTERY_MEASURE             BATTERY_MEASURE_DIVIDER
+/* Bandgap calibration, it is 1.0 - 1.2V depending on the chip */
+#define BATTERY_BANDGAP_NOMINAL     1100u   /* Millivolts, until the board is calibrated */
+#define BATTERY_BANDGAP_MIN         1000u
+#define BATTERY_BANDGAP_MAX         1200u
+#define BATTERY_BANDGAP_SETTLE      2u      /* Miliseconds for the bandgap to settle after switching the ADC to it */
+#define BATTERY_VCC_PERIOD          1000u   /* Miliseconds a VCC reading is used before the bandgap is read again */
+#define BATTERY_READ_PERIOD         1000u   /* Miliseconds between the battery readings of Robot_PowerManagement() */
+#define BATTERY_CALIBRATION_MAGIC   0xBAu
+#define BATTERY_CALIBRATE_VCC       0u      /* Multimeter reading of VCC in mV: flash once with it, then set back to 0 */
+
+/* Kept in EEPROM, written once per board */
+typedef struct
+{
+    byte magic;
+    uint16_t bandgapMilliVolts;
+} batteryCalibration_t;
+
+static uint16_t batteryBandgap = BATTERY_BANDGAP_NOMINAL;  /* Millivolts of the bandgap of this chip */
+static uint16_t batteryVccMilliVolts = 0u;              /* Last VCC reading, 0 to read the bandgap again */
+static unsigned long batteryVccTime;                    /* millis() of the last VCC reading */
+static unsigned long batteryReadTime;                   /* millis() of the last reading of Robot_PowerManagement() */
+
+/* Pins of the Robot, parked as low outputs by Power_Sleep(); Insomnia and the Battery Level stay as they are */
+static const powerPin_t robotPins[] PROGMEM =
+{
+    { LED_BUILTIN,              OUTPUT, LOW,    POWER_GROUP_LED },      /* Debug purposes */
+    { PIN_MA_ENABLE,            OUTPUT, LOW,    POWER_GROUP_MOTOR },
+    { PIN_MA_PHASE,             OUTPUT, LOW,    POWER_GROUP_MOTOR },
+    { PIN_MB_ENABLE,            OUTPUT, LOW,    POWER_GROUP_MOTOR },
+    { PIN_MB_PHASE,             OUTPUT, LOW,    POWER_GROUP_MOTOR },
+    { PIN_DRV8834_SLEEP,        OUTPUT, LOW,    POWER_GROUP_MOTOR },    /* Motor_EnableMotor() wakes the Motor Driver */
+    { PIN_IR_RECEIVER_POWER,    OUTPUT, HIGH,   POWER_GROUP_IR },       /* IR Receiver powered */
+    { PIN_IR_RECEIVER_DATA,     INPUT,  LOW,    POWER_GROUP_IR },
+};
 /* Power Management Stuff end */
 
+/* SoC Stuff */
+/* State of charge: the open circuit voltage of a LiPo tells its charge, but the motors pull the
+ * battery down by their current times its internal resistance. The resistance is measured on the
+ * voltage steps when the motors start or stop, the charge is counted from the estimated current
+ * and pulled slowly towards the load compensated voltage, which also sees the solar charging */
+#define SOC_CAPACITY_MAS            (1200ul * 3600ul)   /* mA * s, 1200mAh of the 14500 cell */
+#define SOC_PERMILLE_STEP           100u    /* SoC between two entries of socOcvTable, per mille */
+#define SOC_OCV_TABLE_SIZE          11u
+#define SOC_IDLE_MILLIAMPS          7u      /* Robot awake with the motors stopped */
+#define SOC_MOTOR_MILLIAMPS         100u    /* Each motor at full PWM duty */
+#define SOC_RESISTANCE_DEFAULT      200u    /* Milliohms, until the first step is measured */
+#define SOC_RESISTANCE_MIN          30u     /* Milliohms, steps outside the range are noise */
+#define SOC_RESISTANCE_MAX          1000u
+#define SOC_RESISTANCE_FILTER       4       /* A new measurement moves the resistance by 1/4 of the difference */
+#define SOC_STEP_MIN_MILLIAMPS      50u     /* Smaller load steps don't give a usable voltage step */
+#define SOC_STEP_SETTLE             20u     /* Miliseconds after a step before the voltage is read */
+#define SOC_BLEND_REST              64u     /* Pull by 1/64 per second at rest */
+#define SOC_BLEND_LOAD              512u    /* Pull by 1/512 per second with the motors running, the compensation is a guess */
+
+/* Open circuit voltage of a LiPo cell in mV, from 0% to 100% in steps of 10% */
+static const uint16_t socOcvTable[SOC_OCV_TABLE_SIZE] PROGMEM =
+{
+    3300u, 3600u, 3690u, 3740u, 3770u, 3800u, 3850u, 3910u, 3980u, 4070u, 4200u
+};
+
+static int32_t socCharge = -1;                          /* mA * s left in the battery, -1 before the first reading */
+static byte socPercent = 0u;                            /* Last result of Soc_Update() */
+static uint32_t socChargeRest = 0u;                     /* mA * ms used below one mA * s */
+static uint16_t socResistance = SOC_RESISTANCE_DEFAULT; /* Milliohms */
+static byte socMotorLevels[2] = {0u, 0u};               /* PWM duty of Motor A and Motor B */
+static uint16_t socLoadMilliAmps = 0u;                  /* Estimated current of the motors */
+static uint16_t socLastMilliVolts = 0u;                 /* Last battery reading */
+static byte socLastSettled = E_NOT_OK;                  /* E_OK while the last reading is of the present current, settled */
+static unsigned long socLoadTime = 0u;                  /* millis() of the last motor change */
+static byte socStepPending = E_NOT_OK;                  /* E_OK while a load step waits to be measured */
+static uint16_t socStepMilliVolts;                      /* Battery before the load step */
+static uint16_t socStepMilliAmps;                       /* Motor current before the load step */
+static unsigned long socStepTime;
+static unsigned long socTime = 0u;                      /* millis() of the last update */
+static uint32_t socBlendTime = 0u;                      /* Log_Now() of the last pull, sleep must count for the solar charging */
+/* SoC Stuff end */
+
+/* Cruise Stuff */
+/* Energy-optimal cruise duty. There is no odometry, so the speed comes from the back-EMF of the motors:
+ * the battery sag over its internal resistance gives the current, the PWM voltage less the current
+ * times the winding resistance is the back-EMF. Back-EMF over the power of the whole Robot, idle
+ * current included, is proportional to the distance per joule. The sweep rotates in place, it needs
+ * no free space and both motors carry the same load as driving straight */
+#define CRUISE_DUTY_FIRST           80u     /* Lowest duty of the sweep, the motors barely start below */
+#define CRUISE_DUTY_STEP            25u
+#define CRUISE_REST_TIME            1000    /* Miliseconds standing still before each step, the battery recovers */
+#define CRUISE_RUN_TIME             600     /* Miliseconds of rotation before the loaded voltage is read */
+#define CRUISE_SAMPLES              64u     /* Battery readings averaged over a few PWM periods, one ADC step is 6.4mV */
+#define CRUISE_SAG_MIN              20u     /* Millivolts, three ADC steps; a smaller sag is quantisation, not current */
+#define CRUISE_MOTOR_MILLIOHMS      7000u   /* Winding resistance of one motor, measure it with a multimeter */
+#define CRUISE_MIN_PERCENT          30u     /* Sweep only with a healthy battery, its resistance grows when empty */
+#define CRUISE_CALIBRATION_MAGIC    0xC6u   /* 0xC5 was swept while Motor A couldn't PWM */
+#define CRUISE_RECALIBRATE          E_NOT_OK    /* E_OK sweeps again after the next start: flash once with it, then set back */
+#define CRUISE_STATE_NEEDED         0u      /* No calibration, sweep when the Robot is free */
+#define CRUISE_STATE_SWEEP          1u
+#define CRUISE_STATE_DONE           2u
+
+/* Only the Timer0 pins D5 and D6 can PWM a motor, Timer2 runs the IR Receiver. A motor which is
+ * only ever full on or off would make the sweep keep a meaningless duty */
+#if ((5 == PIN_MA_ENABLE) || (6 == PIN_MA_ENABLE)) && ((5 == PIN_MB_ENABLE) || (6 == PIN_MB_ENABLE))
+#define CRUISE_MOTORS_PWM           E_OK
+#else
+#define CRUISE_MOTORS_PWM           E_NOT_OK
+#endif
+
+/* IR_SEND_ASYNC puts the 38kHz carrier on TIMER_PWM_PIN(D3, OC2B) for the IR LED of the beacon */
+#if defined(IR_SEND_ASYNC) && ((TIMER_PWM_PIN == PIN_MA_ENABLE) || (TIMER_PWM_PIN == PIN_MA_PHASE) || \
+    (TIMER_PWM_PIN == PIN_MB_ENABLE) || (TIMER_PWM_PIN == PIN_MB_PHASE) || (TIMER_PWM_PIN == PIN_DRV8834_SLEEP))
+#error "IR_SEND_ASYNC needs TIMER_PWM_PIN for the IR LED, move the motor pin on it first"
+#endif
+
+/* Kept in EEPROM */
+typedef struct
+{
+    byte magic;
+    byte duty;
+} cruiseCalibration_t;
+
+static byte cruiseState = CRUISE_STATE_NEEDED;
+static int16_t cruiseSpeed = DRIVE_SPEED_FULL;  /* Q8 speed of autonomous driving */
+static byte cruiseSweepDuty;                    /* Duty of the running step */
+static byte cruiseBestDuty;
+static uint32_t cruiseBestScore;
+static uint16_t cruiseRestMilliVolts;           /* Battery before the running step */
+static uint16_t cruiseVccMilliVolts;            /* VCC of the running step */
+/* Cruise Stuff end */
+
+/* Clock Stuff */
+/* Clock governor: with nothing to do the CPU clock is divided by 8, 1MHz instead of 8MHz. Timer prescalers
+ * are divided by 8 too, so millis(), delay() and PWM frequencies stay the same. The IR Receiver ticks every
+ * 50us, which is 50 cycles at 1MHz, too few for its interrupt: it is stopped and the first edge of a frame
+ * brings the clock back from the pin change interrupt. Dev Builds stay at 8MHz, Serial needs it for 115200 */
+#define CLOCK_FULL                  0u      /* CLKPR prescaler: 8MHz */
+#define CLOCK_SLOW                  3u      /* CLKPR prescaler: divided by 8, 1MHz */
+#define CLOCK_IDLE_TIME             2000    /* Miliseconds with nothing to do before slowing down */
+#define CLOCK_PRESCALER_MASK        0x07u   /* CSn2:0 of TCCRnB and ADPS2:0 of ADCSRA */
+
+/* Timer prescaler which counts as fast at 1MHz, index is CSn2:0 at 8MHz. /1 stays /1, Timer1
+ * counts CPU cycles for the Profiler. Prescalers without a match 8 times lower stay */
+static const byte clockTimer01Slow[8] = { 0u, 1u, 1u, 2u, 4u, 5u, 6u, 7u };    /* /1, /8, /64, /256, /1024 */
+static const byte clockTimer2Slow[8] = { 0u, 1u, 1u, 3u, 2u, 5u, 3u, 5u };     /* /1, /8, /32, /64, /128, /256, /1024 */
+
+static volatile byte clockState = CLOCK_FULL;
+static volatile byte clockIrEdge = E_NOT_OK;    /* E_OK when an IR frame brought the clock back */
+static unsigned long clockBusyTime = 0u;        /* Last time there was something to do */
+static byte clockSaved[4];                      /* TCCR0B, TCCR1B, TCCR2B and ADCSRA at 8MHz */
+/* Clock Stuff end */
+
+/* Mood Stuff */
+#define MOOD_HAPPY_PERCENT          70u     /* Battery above this is a happy Robot */
+#define MOOD_CALM_PERCENT           30u     /* Below this the Robot is tired */
+#define MOOD_HYSTERESIS             3u      /* Percent past a threshold before the mood changes, no flicker */
+
+static byte robotMood = DISPLAY_MOOD_UNKNOWN;
+/* Mood Stuff end */
+
+/* Telemetry Stuff */
+/* Dev Builds send values as small binary frames instead of text, see tools/telemetry.py
+ * Frame before encoding: id, time(2 bytes), data(little endian), checksum
+ * Frames are COBS encoded and have a 0 byte before and after, so text on Serial stays readable */
+#define TELEMETRY_ID_BATTERY        1u      /* uint16_t battery voltage in mV */
+#define TELEMETRY_ID_DROPPED        2u      /* uint16_t frames dropped so far */
+#define TELEMETRY_ID_DISPLAY        3u      /* displayStats_t: refreshes per hour, skipped, uJ per refresh */
+#define TELEMETRY_ID_ENERGY         4u      /* telemetryEnergy_t: ENERGY_* subsystem, mJ spent so far */
+#define TELEMETRY_ID_SOC            5u      /* telemetrySoc_t: state of charge in %, internal resistance in mOhm */
+#define TELEMETRY_MAX_DATA          8u      /* Biggest data of a frame */
+#define TELEMETRY_MAX_FRAME         (1u + 2u + TELEMETRY_MAX_DATA + 1u)
+#define TELEMETRY_MAX_ENCODED       (TELEMETRY_MAX_FRAME + 1u + 2u)     /* COBS overhead + delimiters */
+#define TELEMETRY_PERIOD            100     /* Miliseconds between two battery frames */
+#define TELEMETRY_DISPLAY_PERIOD    10000   /* Miliseconds between two display frames */
+#define TELEMETRY_ENERGY_PERIOD     1000    /* Miliseconds between two energy frames, one subsystem each */
+#define TELEMETRY_SOC_PERIOD        1000    /* Miliseconds between two state of charge frames */
+
+/* Energy frame; packed, AVR has no padding anyway */
+typedef struct __attribute__((packed))
+{
+    byte subsystem;
+    uint32_t milliJoules;
+} telemetryEnergy_t;
+
+/* State of charge frame */
+typedef struct __attribute__((packed))
+{
+    byte percent;
+    uint16_t resistance;
+} telemetrySoc_t;
+
+static uint16_t telemetryDropped = 0u;      /* Frames dropped because Serial was busy */
+/* Telemetry Stuff end */
+
+/***************************************************************************************
+ * Function: Clock_SetFull()
+ ***************************************************************************************
+ * Description: Back to 8MHz with the saved timer and ADC prescalers. Interrupts must be
+ *              off, it runs from the pin change interrupt too.
+ **************************************************************************************/
+void Clock_SetFull(void)
+{
+    CLKPR = _BV(CLKPCE);
+    CLKPR = CLOCK_FULL;
+    TCCR0B = clockSaved[0];
+    TCCR1B = clockSaved[1];
+    TCCR2B = clockSaved[2];
+    ADCSRA = (ADCSRA & ~CLOCK_PRESCALER_MASK) | (clockSaved[3] & CLOCK_PRESCALER_MASK);
+
+    /* IR Receiver has its timer again */
+    PCICR &= ~_BV(PCIE0);
+    PCMSK0 &= ~_BV(PCINT1);
+    clockState = CLOCK_FULL;
+}
+
+/***************************************************************************************
+ * Function: Clock_Slow()
+ ***************************************************************************************
+ * Description: Divide the CPU clock by 8 and every prescaler which allows it, so time
+ *              runs as before. The ADC clock stays in its 50 - 200kHz range.
+ **************************************************************************************/
+void Clock_Slow(void)
+{
+    byte adcPrescaler;
+
+    irrecv.disableIRIn();
+
+    cli();
+    clockSaved[0] = TCCR0B;
+    clockSaved[1] = TCCR1B;
+    clockSaved[2] = TCCR2B;
+    clockSaved[3] = ADCSRA;
+    CLKPR = _BV(CLKPCE);
+    CLKPR = CLOCK_SLOW;
+    TCCR0B = (TCCR0B & ~CLOCK_PRESCALER_MASK) | clockTimer01Slow[TCCR0B & CLOCK_PRESCALER_MASK];
+    TCCR1B = (TCCR1B & ~CLOCK_PRESCALER_MASK) | clockTimer01Slow[TCCR1B & CLOCK_PRESCALER_MASK];
+    TCCR2B = (TCCR2B & ~CLOCK_PRESCALER_MASK) | clockTimer2Slow[TCCR2B & CLOCK_PRESCALER_MASK];
+    adcPrescaler = ADCSRA & CLOCK_PRESCALER_MASK;
+    adcPrescaler = (adcPrescaler > (CLOCK_SLOW + 1u)) ? (adcPrescaler - CLOCK_SLOW) : 1u;
+    ADCSRA = (ADCSRA & ~CLOCK_PRESCALER_MASK) | adcPrescaler;
+
+    /* First edge of an IR frame brings the clock back, see ISR(PCINT0_vect) */
+    PCIFR = _BV(PCIF0);
+    PCMSK0 |= _BV(PCINT1);
+    PCICR |= _BV(PCIE0);
+    clockState = CLOCK_SLOW;
+    sei();
+
+    Energy_SetState(ENERGY_MCU, ENERGY_MCU_ACTIVE_SLOW);
+}
+
+/***************************************************************************************
+ * Function: Clock_Boost()
+ ***************************************************************************************
+ * Description: Something to do, run at 8MHz for at least CLOCK_IDLE_TIME.
+ **************************************************************************************/
+void Clock_Boost(void)
+{
+    if(CLOCK_SLOW == clockState)
+    {
+        cli();
+        Clock_SetFull();
+        sei();
+        irrecv.enableIRIn();
+        Energy_SetState(ENERGY_MCU, ENERGY_MCU_ACTIVE);
+    }
+    else
+    {
+        /* Already fast */
+    }
+
+    clockBusyTime = millis();
+}
+
+/***************************************************************************************
+ * Function: Clock_Task()
+ ***************************************************************************************
+ * Description: Slow down after CLOCK_IDLE_TIME without motors, IR frames or Serial.
+ **************************************************************************************/
+void Clock_Task(void)
+{
+    if(E_OK == clockIrEdge)
+    {
+        /* The interrupt switched the clock, book it */
+        clockIrEdge = E_NOT_OK;
+        clockBusyTime = millis();
+        Energy_SetState(ENERGY_MCU, ENERGY_MCU_ACTIVE);
+    }
+    else if((0u != socLoadMilliAmps) || (0 == irrecv.isIdle()))
+    {
+        /* Motors are running or a frame is received */
+        clockBusyTime = millis();
+    }
+    else if((CLOCK_FULL == clockState) && (E_OK != devStuff) && (CLOCK_IDLE_TIME < (millis() - clockBusyTime)))
+    {
+        Clock_Slow();
+    }
+    else
+    {
+        /* Do nothing */
+    }
+}
+
+/***************************************************************************************
+ * Function: Soc_MotorChanged()
+ ***************************************************************************************
+ * Description: Follow the motor current and start measuring the internal resistance
+ *              when it makes a big enough step.
+ * Parameters:
+ *  - motorIdentifier[in]   :   DRV8834_MOTOR_A, DRV8834_MOTOR_B or DRV8834_MOTOR_BOTH
+ *  - motorPower[in]        :   New PWM duty of the motors
+ **************************************************************************************/
+void Soc_MotorChanged(byte motorIdentifier, byte motorPower)
+{
+    uint16_t oldMilliAmps = socLoadMilliAmps;
+
+    if(motorIdentifier & DRV8834_MOTOR_A)
+    {
+        socMotorLevels[0] = motorPower;
+    }
+    else
+    {
+        /* Do nothing */
+    }
+    if(motorIdentifier & DRV8834_MOTOR_B)
+    {
+        socMotorLevels[1] = motorPower;
+    }
+    else
+    {
+        /* Do nothing */
+    }
+
+    /* Count the charge up to the step with the old current, the next reading may be a second away */
+    if(0u != socLastMilliVolts)
+    {
+        socChargeRest += (uint32_t)(oldMilliAmps + SOC_IDLE_MILLIAMPS) * (millis() - socTime);
+        socTime = millis();
+    }
+    else
+    {
+        /* Nothing counted yet */
+    }
+
+    socLoadMilliAmps = ((uint16_t)(socMotorLevels[0] + socMotorLevels[1]) * SOC_MOTOR_MILLIAMPS) / DRV8834_POWER_FULL;
+
+    /* VCC sags with the load once the regulator drops out, read it again */
+    batteryVccMilliVolts = 0u;
+
+    /* The last reading is the voltage before the step, unless another change came after it: a pending
+     * step is then mixed with this one and no voltage is of one current step any more */
+    if((E_OK == socLastSettled) &&
+       (SOC_STEP_MIN_MILLIAMPS <= (uint16_t)abs((int16_t)socLoadMilliAmps - (int16_t)oldMilliAmps)))
+    {
+        socStepPending = E_OK;
+        socStepMilliVolts = socLastMilliVolts;
+        socStepMilliAmps = oldMilliAmps;
+        socStepTime = millis();
+    }
+    else
+    {
+        socStepPending = E_NOT_OK;
+    }
+    socLastSettled = E_NOT_OK;
+    socLoadTime = millis();
+}
+
+/***************************************************************************************
+ * Function: Motor_Stopped()
+ ***************************************************************************************
+ * Description: Motors lost their power; once none runs the DRV8834 idle time starts.
+ * Parameters:
+ *  - motorIdentifier[in]   :   DRV8834_MOTOR_A, DRV8834_MOTOR_B or DRV8834_MOTOR_BOTH
+ **************************************************************************************/
+void Motor_Stopped(byte motorIdentifier)
+{
+    motorPending &= ~motorIdentifier;
+    if(0u != (motorRunning & motorIdentifier))
+    {
+        if(motorRunning & motorIdentifier & DRV8834_MOTOR_A)
+        {
+            motorStopTime[0] = millis();
+        }
+        else
+        {
+            /* Do nothing */
+        }
+        if(motorRunning & motorIdentifier & DRV8834_MOTOR_B)
+        {
+            motorStopTime[1] = millis();
+        }
+        else
+        {
+            /* Do nothing */
+        }
+        motorRunning &= ~motorIdentifier;
+        motorDriverTime = millis();
+    }
+    else
+    {
+        /* Wasn't running */
+    }
+}
+
 /***************************************************************************************
  * Function: Motor_Break()
  ***************************************************************************************
@@ -88,26 +718,36 @@ void Motor_BreakMotor(byte motorIdentifier)
      * - xPHASE doesn't matter
      * The outputs will be both 0v => Motor will stop */
 
+    /* A newer command replaces a pending reversal */
+    motorReversing &= ~motorIdentifier;
+
     /* Check which motor to break */
     switch(motorIdentifier)
     {
       case DRV8834_MOTOR_A:
         /* Break Motor A */
         analogWrite(PIN_MA_ENABLE, LOW);
+        Energy_SetLevel(ENERGY_MOTOR_A, 0u);
         break;
       case DRV8834_MOTOR_B:
         /* Break Motor B */
         analogWrite(PIN_MB_ENABLE, LOW);
+        Energy_SetLevel(ENERGY_MOTOR_B, 0u);
         break;
       case DRV8834_MOTOR_BOTH:
         /* Break Both Motors */
         analogWrite(PIN_MA_ENABLE, LOW);
         analogWrite(PIN_MB_ENABLE, LOW);
+        Energy_SetLevel(ENERGY_MOTOR_A, 0u);
+        Energy_SetLevel(ENERGY_MOTOR_B, 0u);
         break;
       default:
         /* Motor not recognized */
         break;
     }
+
+    Soc_MotorChanged(motorIdentifier, DRV8834_POWER_NONE);
+    Motor_Stopped(motorIdentifier);
 }
 
 /***************************************************************************************
@@ -156,6 +796,16 @@ void Motor_SwitchDirection(byte motorIdentifier, byte motorDirection)
             /* Motor not recognized */
             break;
     }
+
+    /* Whoever switched it, Motor_Reverse() needs to know */
+    if(HIGH == motorDirection)
+    {
+        motorDirections |= (motorIdentifier & DRV8834_MOTOR_BOTH);
+    }
+    else
+    {
+        motorDirections &= ~motorIdentifier;
+    }
 }
 
 /***************************************************************************************
@@ -174,6 +824,58 @@ void Motor_SwitchDirection(byte motorIdentifier, byte motorDirection)
  **************************************************************************************/
 void Motor_EnableMotor(byte motorIdentifier, byte motorPower)
 {
+    /* A newer command replaces a pending reversal */
+    motorReversing &= ~motorIdentifier;
+
+    /* Motors run with 8MHz */
+    if(DRV8834_POWER_NONE != motorPower)
+    {
+        Clock_Boost();
+    }
+    else
+    {
+        /* Do nothing */
+    }
+
+    /* A sleeping Motor Driver is woken up, Motor_Task() applies the power once it is awake */
+    if((DRV8834_POWER_NONE != motorPower) && (DRV8834_STATE_AWAKE != motorDriverState))
+    {
+        if(DRV8834_STATE_ASLEEP == motorDriverState)
+        {
+            digitalWrite(PIN_DRV8834_SLEEP, HIGH);
+            Energy_SetState(ENERGY_DRV8834, ENERGY_DRV8834_AWAKE);
+            motorDriverState = DRV8834_STATE_WAKING;
+            motorDriverTime = millis();
+        }
+        else
+        {
+            /* Already waking up */
+        }
+
+        if(DRV8834_MOTOR_A & motorIdentifier)
+        {
+            motorPendingPower[0] = motorPower;
+        }
+        else
+        {
+            /* Do nothing */
+        }
+        if(DRV8834_MOTOR_B & motorIdentifier)
+        {
+            motorPendingPower[1] = motorPower;
+        }
+        else
+        {
+            /* Do nothing */
+        }
+        motorPending |= (motorIdentifier & DRV8834_MOTOR_BOTH);
+        return;
+    }
+    else
+    {
+        /* Do nothing */
+    }
+
     /* A Motor will be enabled through PWM on xENBL pin 
      * The motor can be disabled using value 0 for motorPower */
 
@@ -183,20 +885,155 @@ void Motor_EnableMotor(byte motorIdentifier, byte motorPower)
         case DRV8834_MOTOR_A:
             /* Enable Motor A */
             analogWrite(PIN_MA_ENABLE, motorPower);
+            Energy_SetLevel(ENERGY_MOTOR_A, motorPower);
             break;
         case DRV8834_MOTOR_B:
             /* Enable Motor B */
             analogWrite(PIN_MB_ENABLE, motorPower);
+            Energy_SetLevel(ENERGY_MOTOR_B, motorPower);
             break;
         case DRV8834_MOTOR_BOTH:
             /* Enable Both Motors */
             analogWrite(PIN_MA_ENABLE, motorPower);
             analogWrite(PIN_MB_ENABLE, motorPower);
+            Energy_SetLevel(ENERGY_MOTOR_A, motorPower);
+            Energy_SetLevel(ENERGY_MOTOR_B, motorPower);
             break;
         default:
             /* Motor not recognized */
             break;
     }
+
+    Soc_MotorChanged(motorIdentifier, motorPower);
+
+    if(DRV8834_POWER_NONE != motorPower)
+    {
+        motorRunning |= (motorIdentifier & DRV8834_MOTOR_BOTH);
+    }
+    else
+    {
+        Motor_Stopped(motorIdentifier);
+    }
+}
+
+/***************************************************************************************
+ * Function: Motor_Reverse()
+ ***************************************************************************************
+ * Description: Run one motor in a direction. A motor turning the other way is braked
+ *              first and Motor_Task() reverses it after DRV8834_BRAKE_TIME, driving
+ *              the H-bridge against the spinning motor would draw a big current spike.
+ * Parameters:
+ *  - motorIdentifier[in]   :   DRV8834_MOTOR_A or DRV8834_MOTOR_B
+ *  - motorDirection[in]    :   DRV8834_DIRECTION_BACKWARD or DRV8834_DIRECTION_FORWARD
+ *  - motorPower[in]        :   PWM duty, 1u - 255u
+ **************************************************************************************/
+void Motor_Reverse(byte motorIdentifier, byte motorDirection, byte motorPower)
+{
+    byte index = (DRV8834_MOTOR_A == motorIdentifier) ? 0u : 1u;
+
+    if((DRV8834_DIRECTION_FORWARD == motorDirection) == (0u != (motorDirections & motorIdentifier)))
+    {
+        /* Same direction, also when a pending reversal is called off */
+        Motor_EnableMotor(motorIdentifier, motorPower);
+    }
+    else if((0u == (motorRunning & motorIdentifier)) && (DRV8834_BRAKE_TIME <= (millis() - motorStopTime[index])))
+    {
+        /* Standing still already */
+        Motor_SwitchDirection(motorIdentifier, motorDirection);
+        Motor_EnableMotor(motorIdentifier, motorPower);
+    }
+    else
+    {
+        /* Brake now, Motor_Task() reverses it */
+        if(motorRunning & motorIdentifier)
+        {
+            Motor_BreakMotor(motorIdentifier);
+        }
+        else
+        {
+            /* Braking already */
+        }
+        motorReversing |= motorIdentifier;
+        motorReversePower[index] = motorPower;
+    }
+}
+
+/***************************************************************************************
+ * Function: Motor_Task()
+ ***************************************************************************************
+ * Description: Start the pending motors once the DRV8834 is awake and send it to sleep
+ *              after DRV8834_IDLE_SLEEP_TIME without motors. Never blocks.
+ **************************************************************************************/
+void Motor_Task(void)
+{
+    byte pending;
+
+    switch(motorDriverState)
+    {
+        case DRV8834_STATE_WAKING:
+            /* More than DRV8834_WAKEUP_WAIT, millis() may tick right after the wake up */
+            if(DRV8834_WAKEUP_WAIT < (millis() - motorDriverTime))
+            {
+                motorDriverState = DRV8834_STATE_AWAKE;
+                motorDriverTime = millis();
+                pending = motorPending;
+                motorPending = 0u;
+                if(DRV8834_MOTOR_A & pending)
+                {
+                    Motor_EnableMotor(DRV8834_MOTOR_A, motorPendingPower[0]);
+                }
+                else
+                {
+                    /* Do nothing */
+                }
+                if(DRV8834_MOTOR_B & pending)
+                {
+                    Motor_EnableMotor(DRV8834_MOTOR_B, motorPendingPower[1]);
+                }
+                else
+                {
+                    /* Do nothing */
+                }
+            }
+            else
+            {
+                /* Do nothing */
+            }
+            break;
+        case DRV8834_STATE_AWAKE:
+            /* Reverse the braked motors once they stand still */
+            for(byte index = 0u; index < 2u; index++)
+            {
+                byte motorIdentifier = (0u == index) ? DRV8834_MOTOR_A : DRV8834_MOTOR_B;
+
+                if((motorReversing & motorIdentifier) && (DRV8834_BRAKE_TIME <= (millis() - motorStopTime[index])))
+                {
+                    Motor_SwitchDirection(motorIdentifier, (motorDirections & motorIdentifier) ?
+                                          DRV8834_DIRECTION_BACKWARD : DRV8834_DIRECTION_FORWARD);
+                    Motor_EnableMotor(motorIdentifier, motorReversePower[index]);
+                }
+                else
+                {
+                    /* Do nothing */
+                }
+            }
+
+            if((0u == motorRunning) && (0u == motorReversing) && (DRV8834_IDLE_SLEEP_TIME < (millis() - motorDriverTime)))
+            {
+                /* Nothing moved for a while, the DRV8834 draws 2.5mA awake */
+                digitalWrite(PIN_DRV8834_SLEEP, LOW);
+                Energy_SetState(ENERGY_DRV8834, ENERGY_DRV8834_SLEEP);
+                motorDriverState = DRV8834_STATE_ASLEEP;
+            }
+            else
+            {
+                /* Do nothing */
+            }
+            break;
+        default:
+            /* Asleep until the next motor command */
+            break;
+    }
 }
 
 /***************************************************************************************
@@ -217,11 +1054,16 @@ void Motor_TestMotor(byte motorIdentifier)
    * and also the switching of the direction shall work. */
 
   static byte direction = 1u;
+  unsigned long testTime;
 
-  /* Run the motor for 1s */
+  /* Run the motor for 1s, Motor_Task() starts it once the Motor Driver is awake */
   Motor_EnableMotor(motorIdentifier, 255u);
   digitalWrite(LED_BUILTIN, HIGH);
-  delay(DELAY_1_SECOND);
+  testTime = millis();
+  while(DELAY_1_SECOND > (millis() - testTime))
+  {
+      Motor_Task();
+  }
 
   /* Stop the motor for 1s */
   Motor_EnableMotor(motorIdentifier, 0u);
@@ -234,169 +1076,1747 @@ void Motor_TestMotor(byte motorIdentifier)
 }
 
 /***************************************************************************************
- * Function: HandleIR()
+ * Function: Drive_Wheel()
  ***************************************************************************************
- * Description: This function checks the IR readings and moves the robot accordingly.
+ * Description: Run one wheel with a signed speed. The direction is only switched while
+ *              the motor stands still, see Motor_Reverse().
+ * Parameters:
+ *  - wheel[in]   :   DRIVE_WHEEL_A or DRIVE_WHEEL_B
+ *  - speed[in]   :   Q8 speed, -DRIVE_SPEED_FULL - DRIVE_SPEED_FULL
+ **************************************************************************************/
+void Drive_Wheel(byte wheel, int16_t speed)
+{
+    byte motorIdentifier = (DRIVE_WHEEL_A == wheel) ? DRV8834_MOTOR_A : DRV8834_MOTOR_B;
+    byte direction = (0 > speed) ? DRV8834_DIRECTION_BACKWARD : DRV8834_DIRECTION_FORWARD;
+    uint32_t power;
+
+    /* Q8 speed times trim to PWM duty, trims above 1.0 saturate */
+    power = ((uint32_t)abs(speed) * driveTrim[wheel] * DRV8834_POWER_FULL) / ((uint32_t)DRIVE_SPEED_FULL * DRIVE_TRIM_UNITY);
+    power = min(power, (uint32_t)DRV8834_POWER_FULL);
+
+    if(DRV8834_POWER_NONE == power)
+    {
+        Motor_BreakMotor(motorIdentifier);
+    }
+    else
+    {
+        Motor_Reverse(motorIdentifier, direction, (byte)power);
+    }
+}
+
+/***************************************************************************************
+ * Function: Drive_Set()
+ ***************************************************************************************
+ * Description: Drive with a linear and an angular velocity; both together drive an arc.
+ *              When a wheel would need more than full speed both wheels are scaled
+ *              down, so the arc keeps its shape.
+ * Parameters:
+ *  - linear[in]    :   Q8 forward speed, negative drives backwards
+ *  - angular[in]   :   Q8 speed added to the right wheel and taken from the left one,
+ *                      positive turns left
+ **************************************************************************************/
+void Drive_Set(int16_t linear, int16_t angular)
+{
+    int32_t left = (int32_t)linear - angular;
+    int32_t right = (int32_t)linear + angular;
+    int32_t peak = max(abs(left), abs(right));
+
+    /* Saturation */
+    if(DRIVE_SPEED_FULL < peak)
+    {
+        left = (left * DRIVE_SPEED_FULL) / peak;
+        right = (right * DRIVE_SPEED_FULL) / peak;
+    }
+    else
+    {
+        /* Do nothing */
+    }
+
+    Drive_Wheel(DRIVE_WHEEL_A, (int16_t)left);
+    Drive_Wheel(DRIVE_WHEEL_B, (int16_t)right);
+}
+
+/***************************************************************************************
+ * Function: Motion_Queue()
+ ***************************************************************************************
+ * Description: Add a step at the end of the queue.
+ * Parameters:
+ *  - kind[in]       :   MOTION_* step
+ *  - speed[in]      :   Q8 velocity of MOTION_DRIVE and MOTION_ROTATE
+ *  - duration[in]   :   Miliseconds of the step
+ *  - done[in]       :   Called when the step is done, or NULL
+ * Return: E_OK when queued, E_NOT_OK when the queue is full
+ **************************************************************************************/
+byte Motion_Queue(byte kind, int16_t speed, uint16_t duration, motionDone_t done)
+{
+    motionStep_t *step;
+
+    if(MOTION_QUEUE_SIZE <= motionCount)
+    {
+        return E_NOT_OK;
+    }
+    else
+    {
+        step = &motionQueue[(motionHead + motionCount) % MOTION_QUEUE_SIZE];
+        step->kind = kind;
+        step->speed = speed;
+        step->duration = duration;
+        step->done = done;
+        motionCount++;
+
+        return E_OK;
+    }
+}
+
+/***************************************************************************************
+ * Function: Motion_Drive()
+ ***************************************************************************************
+ * Description: Queue driving straight for a while, negative speeds drive backwards.
+ **************************************************************************************/
+byte Motion_Drive(int16_t speed, uint16_t duration, motionDone_t done)
+{
+    return Motion_Queue(MOTION_DRIVE, speed, duration, done);
+}
+
+/***************************************************************************************
+ * Function: Motion_Rotate()
+ ***************************************************************************************
+ * Description: Queue rotating in place for a while, positive speeds turn left.
+ **************************************************************************************/
+byte Motion_Rotate(int16_t speed, uint16_t duration, motionDone_t done)
+{
+    return Motion_Queue(MOTION_ROTATE, speed, duration, done);
+}
+
+/***************************************************************************************
+ * Function: Motion_Pause()
+ ***************************************************************************************
+ * Description: Queue standing still for a while.
+ **************************************************************************************/
+byte Motion_Pause(uint16_t duration, motionDone_t done)
+{
+    return Motion_Queue(MOTION_PAUSE, DRIVE_SPEED_NONE, duration, done);
+}
+
+/***************************************************************************************
+ * Function: Motion_Brake()
+ ***************************************************************************************
+ * Description: Queue stopping the motors.
+ **************************************************************************************/
+byte Motion_Brake(motionDone_t done)
+{
+    return Motion_Queue(MOTION_BRAKE, DRIVE_SPEED_NONE, 0u, done);
+}
+
+/***************************************************************************************
+ * Function: Motion_Clear()
+ ***************************************************************************************
+ * Description: Drop every step and stop the motors. Nobody is called back.
+ **************************************************************************************/
+void Motion_Clear(void)
+{
+    motionCount = 0u;
+    motionStarted = E_NOT_OK;
+    Motor_BreakMotor(DRV8834_MOTOR_BOTH);
+}
+
+/***************************************************************************************
+ * Function: Motion_Busy()
+ ***************************************************************************************
+ * Return: E_OK while steps are queued, E_NOT_OK otherwise
+ **************************************************************************************/
+byte Motion_Busy(void)
+{
+    return (0u != motionCount) ? E_OK : E_NOT_OK;
+}
+
+/***************************************************************************************
+ * Function: Motion_Task()
+ ***************************************************************************************
+ * Description: Start the next step when the current one is due. Steps without time,
+ *              like MOTION_BRAKE, are done in the same call. Never blocks.
+ **************************************************************************************/
+void Motion_Task(void)
+{
+    motionStep_t *step;
+    motionDone_t done;
+
+    while(0u != motionCount)
+    {
+        step = &motionQueue[motionHead];
+
+        /* Start it */
+        if(E_NOT_OK == motionStarted)
+        {
+            switch(step->kind)
+            {
+                case MOTION_DRIVE:
+                    Drive_Set(step->speed, DRIVE_SPEED_NONE);
+                    break;
+                case MOTION_ROTATE:
+                    Drive_Set(DRIVE_SPEED_NONE, step->speed);
+                    break;
+                default:
+                    /* Pause and Brake */
+                    Motor_BreakMotor(DRV8834_MOTOR_BOTH);
+                    break;
+            }
+            motionStart = millis();
+            motionStarted = E_OK;
+        }
+        else
+        {
+            /* Do nothing */
+        }
+
+        /* Still running */
+        if(step->duration > (millis() - motionStart))
+        {
+            break;
+        }
+        else
+        {
+            /* Do nothing */
+        }
+
+        /* Done; dequeue first, so the callback can queue more */
+        done = step->done;
+        motionHead = (motionHead + 1u) % MOTION_QUEUE_SIZE;
+        motionCount--;
+        motionStarted = E_NOT_OK;
+        if(NULL != done)
+        {
+            done();
+        }
+        else
+        {
+            /* Do nothing */
+        }
+    }
+}
+
+/***************************************************************************************
+ * Function: Keymap_Hash()
+ ***************************************************************************************
+ * Description: Map an IR code to its home slot in the keymap table.
+ * Parameters:
+ *  - code[in]   :   IR code value as decoded by IRremote
+ * Return: Slot index in range 0 - (KEYMAP_TABLE_SIZE - 1)
+ **************************************************************************************/
+byte Keymap_Hash(unsigned long code)
+{
+    /* NEC codes carry the command and its inverse, so simple byte folding would map
+     * every key to the same slot. Take the top bits of a multiplicative hash instead. */
+    return (byte)((uint32_t)(code * KEYMAP_HASH_MULTIPLIER) >> (32u - KEYMAP_TABLE_BITS));
+}
+
+/***************************************************************************************
+ * Function: Keymap_Build()
+ ***************************************************************************************
+ * Description: Rebuild the RAM lookup table from the list of action codes.
+ **************************************************************************************/
+void Keymap_Build(void)
+{
+    byte slot;
+
+    /* Empty the table */
+    for(slot = 0u; slot < KEYMAP_TABLE_SIZE; slot++)
+    {
+        keymapTable[slot].code = 0u;
+        keymapTable[slot].action = KEYMAP_ACTION_NONE;
+    }
+
+    /* Insert every action with linear probing; the table is never full so it always ends */
+    for(byte index = 0u; index < KEYMAP_ACTION_COUNT; index++)
+    {
+        slot = Keymap_Hash(keymapCodes[index]);
+        while(KEYMAP_ACTION_NONE != keymapTable[slot].action)
+        {
+            slot = (slot + 1u) & (KEYMAP_TABLE_SIZE - 1u);
+        }
+        keymapTable[slot].code = keymapCodes[index];
+        keymapTable[slot].action = index + 1u;
+    }
+}
+
+/***************************************************************************************
+ * Function: Keymap_Checksum()
+ ***************************************************************************************
+ * Description: Compute the checksum which protects the keymap stored in EEPROM.
+ * Return: XOR of the magic and of all the code bytes
+ **************************************************************************************/
+byte Keymap_Checksum(void)
+{
+    byte checksum = KEYMAP_EEPROM_MAGIC;
+    const byte *codeBytes = (const byte *)keymapCodes;
+
+    for(byte index = 0u; index < sizeof(keymapCodes); index++)
+    {
+        checksum ^= codeBytes[index];
+    }
+
+    return checksum;
+}
+
+/***************************************************************************************
+ * Function: Keymap_Load()
+ ***************************************************************************************
+ * Description: Load the keymap from EEPROM and build the lookup table. When EEPROM does
+ *              not hold a valid keymap the default IR_VALUE_* codes are used.
+ **************************************************************************************/
+void Keymap_Load(void)
+{
+    byte *codeBytes = (byte *)keymapCodes;
+
+    /* Read stored codes */
+    for(byte index = 0u; index < sizeof(keymapCodes); index++)
+    {
+        codeBytes[index] = EEPROM.read(EEPROM_ADDRESS_KEYMAP + 1u + index);
+    }
+
+    /* Check if stored keymap is valid */
+    if((KEYMAP_EEPROM_MAGIC != EEPROM.read(EEPROM_ADDRESS_KEYMAP)) ||
+       (Keymap_Checksum() != EEPROM.read(EEPROM_ADDRESS_KEYMAP + KEYMAP_EEPROM_SIZE - 1u)))
+    {
+        /* Nothing learned yet, use the default Remote */
+        keymapCodes[KEYMAP_ACTION_FORWARD - 1u] = IR_VALUE_FORWARD;
+        keymapCodes[KEYMAP_ACTION_BACKWARD - 1u] = IR_VALUE_BACKWARD;
+        keymapCodes[KEYMAP_ACTION_LEFT - 1u] = IR_VALUE_LEFT;
+        keymapCodes[KEYMAP_ACTION_RIGHT - 1u] = IR_VALUE_RIGHT;
+        keymapCodes[KEYMAP_ACTION_MODE - 1u] = IR_VALUE_MODE;
+        keymapCodes[KEYMAP_ACTION_LEARN - 1u] = IR_VALUE_LEARN;
+    }
+    else
+    {
+        /* Use learned Remote */
+    }
+
+    Keymap_Build();
+}
+
+/***************************************************************************************
+ * Function: Keymap_Save()
+ ***************************************************************************************
+ * Description: Store the keymap in EEPROM. Only the bytes which changed are written
+ *              so relearning the same Remote doesn't wear the EEPROM.
+ **************************************************************************************/
+void Keymap_Save(void)
+{
+    const byte *codeBytes = (const byte *)keymapCodes;
+
+    /* EEPROM.update() skips the write when the stored byte is already the same */
+    EEPROM.update(EEPROM_ADDRESS_KEYMAP, KEYMAP_EEPROM_MAGIC);
+    for(byte index = 0u; index < sizeof(keymapCodes); index++)
+    {
+        EEPROM.update(EEPROM_ADDRESS_KEYMAP + 1u + index, codeBytes[index]);
+    }
+    EEPROM.update(EEPROM_ADDRESS_KEYMAP + KEYMAP_EEPROM_SIZE - 1u, Keymap_Checksum());
+}
+
+/***************************************************************************************
+ * Function: Keymap_Lookup()
+ ***************************************************************************************
+ * Description: Find the action mapped to an IR code. Takes constant time as the table
+ *              has a fixed size which is never full.
+ * Parameters:
+ *  - code[in]   :   IR code value as decoded by IRremote
+ * Return: KEYMAP_ACTION_* mapped to the code, KEYMAP_ACTION_NONE if code is not mapped
+ **************************************************************************************/
+byte Keymap_Lookup(unsigned long code)
+{
+    byte slot = Keymap_Hash(code);
+
+    /* Probe until the code or an empty slot is found */
+    while(KEYMAP_ACTION_NONE != keymapTable[slot].action)
+    {
+        if(code == keymapTable[slot].code)
+        {
+            return keymapTable[slot].action;
+        }
+        slot = (slot + 1u) & (KEYMAP_TABLE_SIZE - 1u);
+    }
+
+    return KEYMAP_ACTION_NONE;
+}
+
+/***************************************************************************************
+ * Function: Keymap_StartLearn()
+ ***************************************************************************************
+ * Description: Start learning a new Remote. The next received codes will be mapped to
+ *              the actions in order: Forward, Backward, Left, Right, Mode, Learn.
+ *              The builtin LED stays on while learning.
+ **************************************************************************************/
+void Keymap_StartLearn(void)
+{
+    keymapLearnIndex = 0u;
+    digitalWrite(LED_BUILTIN, HIGH);
+
+    /* Dev Stuff */
+    if(E_OK == devStuff)
+    {
+        Serial.println("Learning Remote");
+    }
+}
+
+/***************************************************************************************
+ * Function: Keymap_LearnCode()
+ ***************************************************************************************
+ * Description: Map a received code to the next action while learning.
+ * Parameters:
+ *  - code[in]   :   IR code value as decoded by IRremote
+ * Return: E_OK if learning is active and the code was consumed, E_NOT_OK otherwise
+ **************************************************************************************/
+byte Keymap_LearnCode(unsigned long code)
+{
+    /* Check if Robot is learning */
+    if(KEYMAP_LEARN_INACTIVE == keymapLearnIndex)
+    {
+        return E_NOT_OK;
+    }
+
+    /* Ignore repeats from a held button and codes already given to a previous action */
+    if(REPEAT == code)
+    {
+        return E_OK;
+    }
+    for(byte index = 0u; index < keymapLearnIndex; index++)
+    {
+        if(code == keymapCodes[index])
+        {
+            return E_OK;
+        }
+    }
+
+    /* Map the code */
+    keymapCodes[keymapLearnIndex] = code;
+    keymapLearnIndex++;
+
+    /* Blink so the user knows the code was accepted, Keymap_Task() turns the LED on again */
+    digitalWrite(LED_BUILTIN, LOW);
+    keymapBlinking = E_OK;
+    keymapBlinkTime = millis();
+
+    /* Check if all actions are learned */
+    if(KEYMAP_ACTION_COUNT <= keymapLearnIndex)
+    {
+        keymapLearnIndex = KEYMAP_LEARN_INACTIVE;
+        digitalWrite(LED_BUILTIN, LOW);
+        Keymap_Build();
+        Keymap_Save();
+
+        /* Dev Stuff */
+        if(E_OK == devStuff)
+        {
+            Serial.println("Remote learned");
+        }
+    }
+    else
+    {
+        /* Wait for next code */
+    }
+
+    return E_OK;
+}
+
+/***************************************************************************************
+ * Function: Keymap_Task()
+ ***************************************************************************************
+ * Description: End the blink of an accepted code after KEYMAP_BLINK_TIME, the LED
+ *              stays off when that was the last code.
+ **************************************************************************************/
+void Keymap_Task(void)
+{
+    if((E_OK == keymapBlinking) && (KEYMAP_BLINK_TIME <= (millis() - keymapBlinkTime)))
+    {
+        keymapBlinking = E_NOT_OK;
+        if(KEYMAP_LEARN_INACTIVE != keymapLearnIndex)
+        {
+            digitalWrite(LED_BUILTIN, HIGH);
+        }
+        else
+        {
+            /* Remote learned */
+        }
+    }
+    else
+    {
+        /* Do nothing */
+    }
+}
+
+/***************************************************************************************
+ * Function: Log_Now()
+ ***************************************************************************************
+ * Description: Time stamp of the log.
+ * Return: Seconds since boot, time spent sleeping included
+ **************************************************************************************/
+uint32_t Log_Now(void)
+{
+    return (millis() / 1000u) + logSleptSeconds;
+}
+
+/***************************************************************************************
+ * Function: Log_Checksum()
+ ***************************************************************************************
+ * Description: Compute the checksum which protects a log record in EEPROM. A record
+ *              which was only partly written when power was lost won't match.
+ * Parameters:
+ *  - record[in]   :   Record to check, its checksum field is skipped
+ * Return: XOR of LOG_EEPROM_MAGIC and of all the other record bytes
+ **************************************************************************************/
+byte Log_Checksum(const logRecord_t *record)
+{
+    byte checksum = LOG_EEPROM_MAGIC ^ record->checksum;
+    const byte *recordBytes = (const byte *)record;
+
+    for(byte index = 0u; index < sizeof(logRecord_t); index++)
+    {
+        checksum ^= recordBytes[index];
+    }
+
+    return checksum;
+}
+
+/***************************************************************************************
+ * Function: Log_Init()
+ ***************************************************************************************
+ * Description: Find the newest record in EEPROM so the log continues after it.
+ **************************************************************************************/
+void Log_Init(void)
+{
+    logRecord_t record;
+    byte found = E_NOT_OK;
+
+    logSlot = 0u;
+    logSequence = 0u;
+
+    /* Newest record is the valid one with the highest sequence; the sequence wraps,
+     * so compare with the difference, there are far less slots than sequences */
+    for(byte slot = 0u; slot < LOG_RECORD_COUNT; slot++)
+    {
+        EEPROM.get(EEPROM_ADDRESS_LOG + (slot * sizeof(logRecord_t)), record);
+
+        if((LOG_SEQUENCE_EMPTY != record.sequence) && (Log_Checksum(&record) == record.checksum) &&
+           ((E_NOT_OK == found) || (0 <= (int16_t)(record.sequence - logSequence))))
+        {
+            found = E_OK;
+            logSequence = record.sequence + 1u;
+            logSlot = (slot + 1u) % LOG_RECORD_COUNT;
+        }
+        else
+        {
+            /* Empty, damaged or older */
+        }
+    }
+
+    if(LOG_SEQUENCE_EMPTY == logSequence)
+    {
+        logSequence = 0u;
+    }
+    else
+    {
+        /* Do nothing */
+    }
+}
+
+/***************************************************************************************
+ * Function: Log_Flush()
+ ***************************************************************************************
+ * Description: Write the queued events to EEPROM. Each byte takes about 3.4ms to write,
+ *              so this is done in batches at quiet moments: before sleeping, when the
+ *              queue is full and every LOG_FLUSH_PERIOD.
+ **************************************************************************************/
+void Log_Flush(void)
+{
+    for(byte index = 0u; index < logQueued; index++)
+    {
+        /* EEPROM.put() only writes the bytes which changed */
+        EEPROM.put(EEPROM_ADDRESS_LOG + (logSlot * sizeof(logRecord_t)), logQueue[index]);
+        logSlot = (logSlot + 1u) % LOG_RECORD_COUNT;
+    }
+    logQueued = 0u;
+}
+
+/***************************************************************************************
+ * Function: Log_Event()
+ ***************************************************************************************
+ * Description: Queue an event for the EEPROM log. Cheap, the write happens later.
+ *              Must not be called from an interrupt.
+ * Parameters:
+ *  - type[in]   :   LOG_EVENT_* which happened
+ *  - data[in]   :   Value which belongs to the event, see LOG_EVENT_*
+ **************************************************************************************/
+void Log_Event(byte type, uint16_t data)
+{
+    logRecord_t *record = &logQueue[logQueued];
+
+    record->sequence = logSequence;
+    record->time = Log_Now();
+    record->type = type;
+    record->data = data;
+    record->checksum = 0u;
+    record->checksum = Log_Checksum(record);
+    logQueued++;
+
+    /* Erased slots read as LOG_SEQUENCE_EMPTY, never use it */
+    logSequence++;
+    if(LOG_SEQUENCE_EMPTY == logSequence)
+    {
+        logSequence = 0u;
+    }
+    else
+    {
+        /* Do nothing */
+    }
+
+    /* No room for the next event */
+    if(LOG_QUEUE_SIZE <= logQueued)
+    {
+        Log_Flush();
+    }
+    else
+    {
+        /* Write later */
+    }
+}
+
+/***************************************************************************************
+ * Function: Log_Task()
+ ***************************************************************************************
+ * Description: Write queued events from time to time, so they are not lost on reset.
+ **************************************************************************************/
+void Log_Task(void)
+{
+    static unsigned long flushTime = 0u;
+
+    if(LOG_FLUSH_PERIOD < (millis() - flushTime))
+    {
+        flushTime = millis();
+        Log_Flush();
+    }
+    else
+    {
+        /* Do nothing */
+    }
+}
+
+/***************************************************************************************
+ * Function: HandleIR()
+ ***************************************************************************************
+ * Description: This function checks the IR readings and moves the robot accordingly.
  **************************************************************************************/
 void HandleIR(void)
 {
-    /* Robot reaction based on the IR value */
-    switch(results.value)
+    /* Robot reaction based on the IR value */
+    switch(Keymap_Lookup(results.value))
+    {
+        case KEYMAP_ACTION_FORWARD: 
+            /* Move Forward */
+            Drive_Set(DRIVE_SPEED_FULL, DRIVE_SPEED_NONE);
+            break;
+        case KEYMAP_ACTION_BACKWARD:
+            /* Move Backwards */
+            Drive_Set(-DRIVE_SPEED_FULL, DRIVE_SPEED_NONE);
+            break;
+        case KEYMAP_ACTION_LEFT:
+            /* Rotate Left */
+            Drive_Set(DRIVE_SPEED_NONE, DRIVE_SPEED_FULL);
+            break;
+        case KEYMAP_ACTION_RIGHT:
+            /* Rotate Right */
+            Drive_Set(DRIVE_SPEED_NONE, -DRIVE_SPEED_FULL);
+            break;
+        case KEYMAP_ACTION_MODE:
+            /* Change Explore State */
+            exploreState = !exploreState;
+            Motor_BreakMotor(DRV8834_MOTOR_BOTH);
+            Log_Event(LOG_EVENT_MODE, exploreState);
+            break;
+        case KEYMAP_ACTION_LEARN:
+            /* Learn a new Remote */
+            Motor_BreakMotor(DRV8834_MOTOR_BOTH);
+            Keymap_StartLearn();
+            break;
+        default:
+            /* Do nothing */
+            break;
+    }
+}
+
+/***************************************************************************************
+ * Function: Beacon_Frame()
+ ***************************************************************************************
+ * Description: Build the NEC value of a beacon.
+ * Parameters:
+ *  - kind[in]   :   BEACON_KIND_* of the beacon
+ *  - id[in]     :   ID of the beacon, 0 - 31
+ * Return: NEC value to send
+ **************************************************************************************/
+unsigned long Beacon_Frame(byte kind, byte id)
+{
+    byte data = (kind << 5) | (id & 0x1Fu);
+
+    return ((unsigned long)BEACON_ADDRESS << 24) | ((unsigned long)(byte)~BEACON_ADDRESS << 16) |
+           ((unsigned long)data << 8) | (byte)~data;
+}
+
+/***************************************************************************************
+ * Function: Beacon_Parse()
+ ***************************************************************************************
+ * Description: Check if a received IR value is a beacon.
+ * Parameters:
+ *  - value[in]   :   IR value as decoded by IRremote
+ *  - data[out]   :   Kind and ID byte of the beacon
+ * Return: E_OK if value is a beacon, E_NOT_OK otherwise
+ **************************************************************************************/
+byte Beacon_Parse(unsigned long value, byte *data)
+{
+    *data = (byte)(value >> 8);
+
+    if((NEC != results.decode_type) || (Beacon_Frame(*data >> 5, *data) != value))
+    {
+        return E_NOT_OK;
+    }
+
+    return E_OK;
+}
+
+/***************************************************************************************
+ * Function: Beacon_Broadcast()
+ ***************************************************************************************
+ * Description: Broadcast this robot's beacon every BEACON_PERIOD without blocking.
+ *              Needs IR_SEND_ASYNC in IRremote.h and an IR LED on TIMER_PWM_PIN.
+ **************************************************************************************/
+void Beacon_Broadcast(void)
+{
+#ifdef IR_SEND_ASYNC
+    static unsigned long broadcastTime = 0;
+
+    if((BEACON_PERIOD < (millis() - broadcastTime)) && (0 == irsend.busy()))
+    {
+        broadcastTime = millis();
+        Clock_Boost();
+        irsend.beginAsync();
+        irsend.sendNEC(Beacon_Frame(BEACON_KIND_ECOBOT, BEACON_OWN_ID), 32);
+        irsend.sendAsync();
+    }
+    else
+    {
+        /* Not yet */
+    }
+#endif
+}
+
+/***************************************************************************************
+ * Function: Beacon_Received()
+ ***************************************************************************************
+ * Description: Count a received beacon frame for the homing.
+ * Parameters:
+ *  - data[in]   :   Kind and ID byte of the beacon
+ **************************************************************************************/
+void Beacon_Received(byte data)
+{
+    byte kind = data >> 5;
+
+    /* Only chargers and sunny spots are worth driving to */
+    if((BEACON_KIND_CHARGER != kind) && (BEACON_KIND_SUN != kind))
+    {
+        return;
+    }
+
+    /* Start homing on the first beacon heard */
+    if(BEACON_STATE_IDLE == beaconState)
+    {
+        beaconTarget = data;
+        beaconStep = 0u;
+        memset(beaconHits, 0, sizeof(beaconHits));
+        beaconState = BEACON_STATE_LISTEN;
+        beaconTime = millis();
+    }
+    else if(data != beaconTarget)
+    {
+        /* Some other beacon */
+        return;
+    }
+    else if(BEACON_STATE_LISTEN == beaconState)
+    {
+        /* Count it for the bearing */
+        beaconHits[beaconStep]++;
+    }
+    else
+    {
+        /* Moving, not measuring */
+    }
+
+    beaconLastHeard = millis();
+}
+
+/***************************************************************************************
+ * Function: Beacon_Bearing()
+ ***************************************************************************************
+ * Description: Estimate the bearing of the beacon from the last scan. Each step is
+ *              scored together with its neighbours, so a lucky frame doesn't win.
+ * Return: Scan step which faces the beacon
+ **************************************************************************************/
+byte Beacon_Bearing(void)
+{
+    byte bestStep = 0u;
+    byte bestScore = 0u;
+
+    for(byte step = 0u; step < BEACON_SCAN_STEPS; step++)
+    {
+        byte score = beaconHits[(step + BEACON_SCAN_STEPS - 1u) % BEACON_SCAN_STEPS] +
+                     (2u * beaconHits[step]) +
+                     beaconHits[(step + 1u) % BEACON_SCAN_STEPS];
+        if(score > bestScore)
+        {
+            bestScore = score;
+            bestStep = step;
+        }
+    }
+
+    return bestStep;
+}
+
+/***************************************************************************************
+ * Function: Beacon_Spread()
+ ***************************************************************************************
+ * Description: Count the scan steps which heard every frame. Far away the receiver only
+ *              sees the beacon when facing it; close by the beacon is bright enough to
+ *              be seen off axis too, so the spread grows as the Robot gets closer.
+ * Return: Number of scan steps, 0 - BEACON_SCAN_STEPS
+ **************************************************************************************/
+byte Beacon_Spread(void)
+{
+    byte spread = 0u;
+
+    for(byte step = 0u; step < BEACON_SCAN_STEPS; step++)
+    {
+        if(BEACON_FULL_COUNT <= beaconHits[step])
+        {
+            spread++;
+        }
+        else
+        {
+            /* Missed frames */
+        }
+    }
+
+    return spread;
+}
+
+/***************************************************************************************
+ * Function: Beacon_Stop()
+ ***************************************************************************************
+ * Description: Give up homing and stop the motors.
+ **************************************************************************************/
+void Beacon_Stop(void)
+{
+    beaconState = BEACON_STATE_IDLE;
+    Motion_Clear();
+}
+
+/***************************************************************************************
+ * Function: Beacon_Listen()
+ ***************************************************************************************
+ * Description: Motion callback, a scan step was rotated; count the frames heard now.
+ **************************************************************************************/
+void Beacon_Listen(void)
+{
+    beaconState = BEACON_STATE_LISTEN;
+    beaconTime = millis();
+}
+
+/***************************************************************************************
+ * Function: Beacon_Approach()
+ ***************************************************************************************
+ * Description: Motion callback, the Robot faces the beacon and drives to it.
+ **************************************************************************************/
+void Beacon_Approach(void)
+{
+    beaconState = BEACON_STATE_APPROACH;
+}
+
+/***************************************************************************************
+ * Function: Beacon_Rescan()
+ ***************************************************************************************
+ * Description: Motion callback, the approach is done; scan again from here.
+ **************************************************************************************/
+void Beacon_Rescan(void)
+{
+    beaconStep = 0u;
+    memset(beaconHits, 0, sizeof(beaconHits));
+    Beacon_Listen();
+}
+
+/***************************************************************************************
+ * Function: Beacon_Home()
+ ***************************************************************************************
+ * Description: Drive towards the beacon heard last. The robot has no compass, so the
+ *              bearing is found by rotating in steps and counting the received frames
+ *              on each step: the receiver only sees the beacon when facing it. Then it
+ *              turns to the best step, drives for a while and scans again. Close by it
+ *              is heard on most steps, that is where it stops.
+ *              The moves run on the Motion queue, its callbacks bring the next state.
+ *              Never blocks, call it on every loop.
+ **************************************************************************************/
+void Beacon_Home(void)
+{
+    unsigned long elapsed = millis() - beaconTime;
+    byte spread;
+
+    /* Give up if the beacon went quiet */
+    if((BEACON_STATE_IDLE != beaconState) && (BEACON_STATE_DOCKED != beaconState) &&
+       (BEACON_LOST_TIMEOUT < (millis() - beaconLastHeard)))
+    {
+        Beacon_Stop();
+        return;
+    }
+
+    switch(beaconState)
+    {
+        case BEACON_STATE_LISTEN:
+            if(BEACON_LISTEN_TIME < elapsed)
+            {
+                if((BEACON_SCAN_STEPS - 1u) > beaconStep)
+                {
+                    /* Next step of the scan, then stand still to listen */
+                    beaconStep++;
+                    Motion_Rotate(-DRIVE_SPEED_HALF, BEACON_STEP_TIME, NULL);
+                    Motion_Brake(Beacon_Listen);
+                    beaconState = BEACON_STATE_ROTATE;
+                }
+                else
+                {
+                    spread = Beacon_Spread();
+                    if(BEACON_DOCKED_STEPS <= spread)
+                    {
+                        /* Heard all around, we are there */
+                        Motor_BreakMotor(DRV8834_MOTOR_BOTH);
+                        beaconState = BEACON_STATE_DOCKED;
+                    }
+                    else
+                    {
+                        /* Scan done, one more step brings us back to step 0; turn to the beacon from there,
+                         * go and scan again. The wider it was heard the closer it is, so the approach
+                         * gets shorter and doesn't drive past it */
+                        beaconStep = Beacon_Bearing() + 1u;
+                        Motion_Rotate(-DRIVE_SPEED_HALF, beaconStep * BEACON_STEP_TIME, Beacon_Approach);
+                        Motion_Drive(cruiseSpeed, ((uint32_t)BEACON_APPROACH_TIME * (BEACON_SCAN_STEPS - spread)) /
+                                                  BEACON_SCAN_STEPS, NULL);
+                        Motion_Brake(Beacon_Rescan);
+                        beaconState = BEACON_STATE_TURN;
+                    }
+                }
+                beaconTime = millis();
+            }
+            break;
+        default:
+            /* Moving on the Motion queue, Idle or Docked: nothing to do */
+            break;
+    }
+}
+
+/***************************************************************************************
+ * Function: Robot_Explore()
+ ***************************************************************************************
+ * Description: This function verify Explore Mode and decide how to control the robot.
+ **************************************************************************************/
+void Robot_Explore(void)
+{
+    PROFILE_SCOPE(PROFILER_PROBE_EXPLORE);
+
+    /* Explore the world based on the active state
+     * - Automate = drive autonomously but check IR Receiver for Mode Switch first
+     * - Manual = drive based on IR commands */
+
+    /* Timeout to stop the motors
+     * - when it is 0 it is disabled
+     * - when it has a value it is started and checked upon the threshold */
+    static volatile long breakTime = 0;
+
+    /* Kind and ID of a received beacon */
+    byte beaconData;
+
+    
+    /* Check Exploreing state */
+    if(exploreState == EXPLORE_AUTOMATE)
+    {
+        /* Try to read IR Receiver */
+        if(irrecv.decode(&results))
+        {
+            /* Resume IR */
+            irrecv.resume();
+
+            /* Check for Explore Mode */
+            if(E_OK == Keymap_LearnCode(results.value))
+            {
+                /* Code was learned */
+                return; /* Skip Autonomous part */
+            }
+            else if(KEYMAP_ACTION_MODE == Keymap_Lookup(results.value))
+            {
+                /* Switch Explore State */
+                exploreState = !exploreState;
+                Beacon_Stop();
+                Log_Event(LOG_EVENT_MODE, exploreState);
+                return; /* Skip Autonomous part */
+            }
+            else if(E_OK == Beacon_Parse(results.value, &beaconData))
+            {
+                /* Beacon in sight */
+                Beacon_Received(beaconData);
+            }
+            else
+            {
+                /* Do Nothing */
+            }
+        }
+        else
+        {
+            /* No IR Commands */
+        }
+
+        /* Do Autonomous things */
+        /* Check for Obstacles */
+        /* Decide next Direction */
+        /* Move */
+        if(CRUISE_STATE_SWEEP != cruiseState)
+        {
+            Beacon_Home();
+        }
+        else
+        {
+            /* Cruise sweep owns the motors */
+        }
+        Beacon_Broadcast();
+    }
+    else
+    {
+        /* Do Manual things */
+        /* Check for IR Input */
+        if(irrecv.decode(&results))
+        {
+            /* Resume IR */
+            irrecv.resume();
+
+            /* Handle IR Input, unless it is learned */
+            if(E_NOT_OK == Keymap_LearnCode(results.value))
+            {
+                HandleIR();
+            }
+            else
+            {
+                /* Code was learned */
+            }
+
+            /* Start Break timeout */
+            breakTime = millis();
+        }
+        else
+        {
+            /* Stop motors if some time passed since last command */
+            if((0 != breakTime) && (DRV8834_BREAK_TIMEOUT < (millis() - breakTime)))
+            {
+                /* Stop Motors */
+                Motor_BreakMotor(DRV8834_MOTOR_BOTH);
+
+                /* Disable Break Timeout */
+                breakTime = 0;
+            }
+            else
+            {
+                /* Do Nothing */
+            }
+        }
+    }
+}
+
+/***************************************************************************************
+ * Function: Robot_WakeUp()
+ ***************************************************************************************
+ * Description: This function is executed when the robot wakes up. It will initialize
+ *              everything and will make the robot functional.
+ **************************************************************************************/
+void Robot_WakeUp(void)
+{
+    /* Initialize things */
+    /* PIN Modes and levels, this powers the IR Receiver */
+    Power_WakeUp();
+
+    /* Motor Driver sleeps until the first motor command */
+    motorDriverState = DRV8834_STATE_ASLEEP;
+    Energy_SetState(ENERGY_DRV8834, ENERGY_DRV8834_SLEEP);
+
+    /* Set default direction of both Motors to move Forward */
+    Motor_SwitchDirection(DRV8834_MOTOR_BOTH, DRV8834_DIRECTION_FORWARD);
+
+    /* IR Receiver is powered */
+    Energy_SetState(ENERGY_IR, ENERGY_ON);
+
+    /* Enable IR Receiver, unless it already records the frame which woke the Robot */
+    if(ROBOT_WAKE_IR != robotWakeSource)
+    {
+        irrecv.enableIRIn();
+    }
+    else
+    {
+        /* Do nothing */
+    }
+
+    /* Dev Stuff */
+    if(E_OK == devStuff)
+    {
+        /* New Day! */
+        Serial.println("Good Morning!");
+    }
+}
+
+/***************************************************************************************
+ * Function: Mood_Show()
+ ***************************************************************************************
+ * Description: Show a mood and the Explore State on the display. The display is only
+ *              refreshed when one of them changed.
+ * Parameters:
+ *  - mood[in]   :   DISPLAY_MOOD_* to show
+ **************************************************************************************/
+void Mood_Show(byte mood)
+{
+    robotMood = mood;
+    Display_Show(mood, (EXPLORE_AUTOMATE == exploreState) ? DISPLAY_ICON_AUTOMATE : DISPLAY_ICON_MANUAL);
+}
+
+/***************************************************************************************
+ * Function: Mood_FromBattery()
+ ***************************************************************************************
+ * Description: Find the mood of a state of charge.
+ * Parameters:
+ *  - batteryPercent[in]   :   State of charge, may be out of 0 - 100 with the hysteresis
+ * Return: DISPLAY_MOOD_HAPPY, DISPLAY_MOOD_CALM or DISPLAY_MOOD_TIRED
+ **************************************************************************************/
+byte Mood_FromBattery(int16_t batteryPercent)
+{
+    if((int16_t)MOOD_HAPPY_PERCENT <= batteryPercent)
+    {
+        return DISPLAY_MOOD_HAPPY;
+    }
+    else if((int16_t)MOOD_CALM_PERCENT <= batteryPercent)
+    {
+        return DISPLAY_MOOD_CALM;
+    }
+    else
+    {
+        return DISPLAY_MOOD_TIRED;
+    }
+}
+
+/***************************************************************************************
+ * Function: Mood_Update()
+ ***************************************************************************************
+ * Description: Show the mood of the state of charge. A new mood must be reached by
+ *              MOOD_HYSTERESIS, so noise on the reading doesn't cost refreshes.
+ * Parameters:
+ *  - batteryPercent[in]   :   State of charge
+ **************************************************************************************/
+void Mood_Update(byte batteryPercent)
+{
+    byte mood = Mood_FromBattery(batteryPercent);
+
+    /* Coming from sleep or boot any mood is fine, else check with hysteresis */
+    if((DISPLAY_MOOD_TIRED >= robotMood) && (mood != robotMood))
+    {
+        if(mood < robotMood)
+        {
+            /* Better mood, must be reached with less voltage too */
+            mood = Mood_FromBattery((int16_t)batteryPercent - (int16_t)MOOD_HYSTERESIS);
+        }
+        else
+        {
+            /* Worse mood, must be reached with more voltage too */
+            mood = Mood_FromBattery((int16_t)batteryPercent + (int16_t)MOOD_HYSTERESIS);
+        }
+    }
+    else
+    {
+        /* Do nothing */
+    }
+
+    Mood_Show(mood);
+}
+
+/***************************************************************************************
+ * Function: Battery_ReadBandgap()
+ ***************************************************************************************
+ * Description: Measure the internal 1.1V bandgap against AVCC. The first conversion
+ *              after switching is thrown away, the bandgap needs time to settle.
+ * Return: ADC value of the bandgap, the lower it is the higher is VCC
+ **************************************************************************************/
+uint16_t Battery_ReadBandgap(void)
+{
+    ADMUX = ADC_MUX_BANDGAP;
+    delay(BATTERY_BANDGAP_SETTLE);
+
+    for(byte conversion = 0u; conversion < 2u; conversion++)
+    {
+        ADCSRA |= _BV(ADSC);
+        while(bit_is_set(ADCSRA, ADSC))
+        {
+            /* Wait for the conversion */
+        }
+    }
+
+    return ADC;
+}
+
+/***************************************************************************************
+ * Function: Battery_ReadVcc()
+ ***************************************************************************************
+ * Description: Recover VCC from the bandgap: bandgap = VCC * ADC / 1023.
+ * Return: VCC in mV, 0 if the ADC didn't work
+ **************************************************************************************/
+uint16_t Battery_ReadVcc(void)
+{
+    uint16_t bandgapLevel;
+
+    /* The bandgap costs BATTERY_BANDGAP_SETTLE and two conversions, VCC moves slowly */
+    if((0u != batteryVccMilliVolts) && (BATTERY_VCC_PERIOD > (millis() - batteryVccTime)))
+    {
+        return batteryVccMilliVolts;
+    }
+    else
+    {
+        bandgapLevel = Battery_ReadBandgap();
+    }
+
+    if(0u == bandgapLevel)
+    {
+        return 0u;
+    }
+    else
+    {
+        batteryVccMilliVolts = ((uint32_t)batteryBandgap * ADC_MAX_VALUE) / bandgapLevel;
+        batteryVccTime = millis();
+        return batteryVccMilliVolts;
+    }
+}
+
+/***************************************************************************************
+ * Function: Battery_Calibrate()
+ ***************************************************************************************
+ * Description: Find the bandgap voltage of this chip from a known VCC and keep it in
+ *              EEPROM. Needed once per board.
+ * Parameters:
+ *  - vccMilliVolts[in]   :   VCC measured with a multimeter
+ **************************************************************************************/
+void Battery_Calibrate(uint16_t vccMilliVolts)
+{
+    batteryCalibration_t calibration;
+    uint16_t bandgap = ((uint32_t)vccMilliVolts * Battery_ReadBandgap()) / ADC_MAX_VALUE;
+
+    /* A bandgap out of the datasheet range is a wrong VCC, keep the old one */
+    if((BATTERY_BANDGAP_MIN <= bandgap) && (BATTERY_BANDGAP_MAX >= bandgap))
+    {
+        batteryBandgap = bandgap;
+        calibration.magic = BATTERY_CALIBRATION_MAGIC;
+        calibration.bandgapMilliVolts = bandgap;
+        EEPROM.put(EEPROM_ADDRESS_BATTERY, calibration);
+    }
+    else
+    {
+        /* Do nothing */
+    }
+
+    /* Dev Stuff */
+    if(E_OK == devStuff)
+    {
+        Serial.print("Bandgap mV: ");
+        Serial.println(bandgap);
+    }
+}
+
+/***************************************************************************************
+ * Function: Battery_Init()
+ ***************************************************************************************
+ * Description: Load the bandgap calibration, or calibrate when the build has
+ *              BATTERY_CALIBRATE_VCC.
+ **************************************************************************************/
+void Battery_Init(void)
+{
+    batteryCalibration_t calibration;
+
+    EEPROM.get(EEPROM_ADDRESS_BATTERY, calibration);
+    if((BATTERY_CALIBRATION_MAGIC == calibration.magic) &&
+       (BATTERY_BANDGAP_MIN <= calibration.bandgapMilliVolts) &&
+       (BATTERY_BANDGAP_MAX >= calibration.bandgapMilliVolts))
     {
-        case IR_VALUE_FORWARD: 
-            /* Move Forward */
-            Motor_SwitchDirection(DRV8834_MOTOR_BOTH, DRV8834_DIRECTION_FORWARD);
-            Motor_EnableMotor(DRV8834_MOTOR_BOTH, DRV8834_POWER_FULL);
-            break;
-        case IR_VALUE_BACKWARD:
-            /* Move Backwards */
-            Motor_SwitchDirection(DRV8834_MOTOR_BOTH, DRV8834_DIRECTION_BACKWARD);
-            Motor_EnableMotor(DRV8834_MOTOR_BOTH, DRV8834_POWER_FULL);
-            break;
-        case IR_VALUE_LEFT:
-            /* Rotate Left */
-            Motor_SwitchDirection(DRV8834_MOTOR_A, DRV8834_DIRECTION_BACKWARD);
-            Motor_SwitchDirection(DRV8834_MOTOR_B, DRV8834_DIRECTION_FORWARD);
-            Motor_EnableMotor(DRV8834_MOTOR_BOTH, DRV8834_POWER_FULL);
-            break;
-        case IR_VALUE_RIGHT:
-            /* Rotate Right */
-            Motor_SwitchDirection(DRV8834_MOTOR_A, DRV8834_DIRECTION_FORWARD);
-            Motor_SwitchDirection(DRV8834_MOTOR_B, DRV8834_DIRECTION_BACKWARD);
-            Motor_EnableMotor(DRV8834_MOTOR_BOTH, DRV8834_POWER_FULL);
-            break;
-        case IR_VALUE_MODE:
-            /* Change Explore State */
-            exploreState = !exploreState;
-            Motor_BreakMotor(DRV8834_MOTOR_BOTH);
-            break;
-        default:
-            /* Do nothing */
-            break;
+        batteryBandgap = calibration.bandgapMilliVolts;
+    }
+    else
+    {
+        /* Never calibrated, nominal is within 10% */
+    }
+
+    if(0u != BATTERY_CALIBRATE_VCC)
+    {
+        Battery_Calibrate(BATTERY_CALIBRATE_VCC);
+    }
+    else
+    {
+        /* Do nothing */
     }
 }
 
 /***************************************************************************************
- * Function: Robot_Explore()
+ * Function: Battery_ReadMilliVolts()
  ***************************************************************************************
- * Description: This function verify Explore Mode and decide how to control the robot.
+ * Description: Read the battery voltage. AVCC is the ADC reference and moves with the
+ *              battery, so it is measured first and the divider reading is scaled with
+ *              it instead of assuming 3.3V.
+ * Return: Battery voltage in mV
  **************************************************************************************/
-void Robot_Explore(void)
+uint16_t Battery_ReadMilliVolts(void)
 {
-    /* Explore the world based on the active state
-     * - Automate = drive autonomously but check IR Receiver for Mode Switch first
-     * - Manual = drive based on IR commands */
+    uint32_t vccMilliVolts = Battery_ReadVcc();
 
-    /* Timeout to stop the motors
-     * - when it is 0 it is disabled
-     * - when it has a value it is started and checked upon the threshold */
-    static volatile long breakTime = 0;
+    if(BATTERY_MEASURE_DIVIDER == BATTERY_MEASURE)
+    {
+        /* Battery voltage is double the reading value; Voltage Divider is used with R1 = R2 */
+        return ((uint32_t)analogRead(PIN_BATTERY_LEVEL) * vccMilliVolts * 2u) / ADC_MAX_VALUE;
+    }
+    else
+    {
+        return vccMilliVolts;
+    }
+}
 
-    
-    /* Check Exploreing state */
-    if(exploreState == EXPLORE_AUTOMATE)
+/***************************************************************************************
+ * Function: Soc_FromMilliVolts()
+ ***************************************************************************************
+ * Description: Look up the open circuit voltage in socOcvTable.
+ * Parameters:
+ *  - ocvMilliVolts[in]   :   Open circuit voltage of the battery
+ * Return: State of charge in per mille, 0 - 1000
+ **************************************************************************************/
+uint16_t Soc_FromMilliVolts(uint16_t ocvMilliVolts)
+{
+    uint16_t low = pgm_read_word(&socOcvTable[0]);
+    uint16_t high;
+
+    if(low >= ocvMilliVolts)
     {
-        /* Try to read IR Receiver */
-        if(irrecv.decode(&results))
+        return 0u;
+    }
+    else
+    {
+        /* Find the segment and interpolate in it */
+        for(byte index = 1u; index < SOC_OCV_TABLE_SIZE; index++)
         {
-            /* Resume IR */
-            irrecv.resume();
+            high = pgm_read_word(&socOcvTable[index]);
+            if(high > ocvMilliVolts)
+            {
+                return ((index - 1u) * SOC_PERMILLE_STEP) +
+                       (((uint32_t)(ocvMilliVolts - low) * SOC_PERMILLE_STEP) / (high - low));
+            }
+            else
+            {
+                low = high;
+            }
+        }
 
-            /* Check for Explore Mode */
-            if(IR_VALUE_MODE == results.value)
+        return (SOC_OCV_TABLE_SIZE - 1u) * SOC_PERMILLE_STEP;
+    }
+}
+
+/***************************************************************************************
+ * Function: Soc_Update()
+ ***************************************************************************************
+ * Description: Count the charge used since the last update, measure the internal
+ *              resistance after a load step and pull the charge towards the load
+ *              compensated open circuit voltage.
+ * Parameters:
+ *  - batteryMilliVolts[in]   :   Battery voltage, under load
+ * Return: State of charge in percent
+ **************************************************************************************/
+byte Soc_Update(uint16_t batteryMilliVolts)
+{
+    unsigned long now = millis();
+    uint32_t seconds = Log_Now();
+    uint16_t loadMilliAmps = socLoadMilliAmps + SOC_IDLE_MILLIAMPS;
+    uint16_t stepMilliAmps;
+    int32_t ocvCharge;
+    int32_t resistance;
+    uint32_t blend;
+
+    /* Internal resistance is the voltage step over the current step */
+    if((E_OK == socStepPending) && (SOC_STEP_SETTLE <= (now - socStepTime)))
+    {
+        socStepPending = E_NOT_OK;
+        stepMilliAmps = (uint16_t)abs((int16_t)socLoadMilliAmps - (int16_t)socStepMilliAmps);
+        if(SOC_STEP_MIN_MILLIAMPS <= stepMilliAmps)
+        {
+            resistance = ((int32_t)abs((int16_t)socStepMilliVolts - (int16_t)batteryMilliVolts) * 1000) /
+                         stepMilliAmps;
+            if(((int32_t)SOC_RESISTANCE_MIN <= resistance) && ((int32_t)SOC_RESISTANCE_MAX >= resistance))
             {
-                /* Switch Explore State */
-                exploreState = !exploreState;
-                Motor_BreakMotor(DRV8834_MOTOR_BOTH);
-                return; /* Skip Autonomous part */
+                socResistance += (resistance - (int32_t)socResistance) / SOC_RESISTANCE_FILTER;
             }
             else
             {
-                /* Do Nothing */
+                /* Noise */
             }
         }
         else
         {
-            /* No IR Commands */
+            /* Too small a step to give a usable voltage step */
         }
+    }
+    else
+    {
+        /* Do nothing */
+    }
+    socLastMilliVolts = batteryMilliVolts;
+    socLastSettled = (SOC_STEP_SETTLE <= (now - socLoadTime)) ? E_OK : E_NOT_OK;
 
-        /* Do Autonomous things */
-        /* Check for Obstacles */
-        /* Decide next Direction */
-        /* Move */
+    /* Open circuit voltage is the reading plus the drop on the internal resistance */
+    ocvCharge = (int32_t)(SOC_CAPACITY_MAS / 1000u) *
+                Soc_FromMilliVolts(batteryMilliVolts + (uint16_t)(((uint32_t)loadMilliAmps * socResistance) / 1000u));
+
+    if(0 > socCharge)
+    {
+        /* First reading, nothing counted yet */
+        socCharge = ocvCharge;
+        socBlendTime = seconds;
     }
     else
     {
-        /* Do Manual things */
-        /* Check for IR Input */
-        if(irrecv.decode(&results))
+        /* Count the charge used */
+        socChargeRest += (uint32_t)loadMilliAmps * (now - socTime);
+        socCharge -= socChargeRest / 1000u;
+        socChargeRest %= 1000u;
+
+        /* Pull towards the voltage, weaker under load */
+        blend = (0u == socLoadMilliAmps) ? SOC_BLEND_REST : SOC_BLEND_LOAD;
+        if((seconds - socBlendTime) >= blend)
         {
-            /* Resume IR */
-            irrecv.resume();
+            socCharge = ocvCharge;
+            socBlendTime = seconds;
+        }
+        else if(seconds != socBlendTime)
+        {
+            socCharge += ((ocvCharge - socCharge) / (int32_t)blend) * (int32_t)(seconds - socBlendTime);
+            socBlendTime = seconds;
+        }
+        else
+        {
+            /* Less than a second */
+        }
+
+        socCharge = constrain(socCharge, 0, (int32_t)SOC_CAPACITY_MAS);
+    }
+    socTime = now;
+    socPercent = socCharge / (SOC_CAPACITY_MAS / 100u);
 
-            /* Handle IR Input */
-            HandleIR();
+    return socPercent;
+}
 
-            /* Start Break timeout */
-            breakTime = millis();
+/***************************************************************************************
+ * Function: ISR(PCINT0_vect)
+ ***************************************************************************************
+ * Description: IR Receiver output changed while sleeping or while the clock is slow,
+ *              the remote sends a frame.
+ **************************************************************************************/
+ISR(PCINT0_vect)
+{
+    robotWakeSource = ROBOT_WAKE_IR;
+
+    /* Awake but slow: back to 8MHz and catch the frame, its header mark just began.
+     * enableIRInMark() turns interrupts on again, nothing follows it here */
+    if(CLOCK_SLOW == clockState)
+    {
+        Clock_SetFull();
+        clockIrEdge = E_OK;
+        irrecv.enableIRInMark(0u);
+    }
+    else
+    {
+        /* Do nothing */
+    }
+}
+
+/***************************************************************************************
+ * Function: ISR(PCINT2_vect)
+ ***************************************************************************************
+ * Description: Insomnia changed while sleeping.
+ **************************************************************************************/
+ISR(PCINT2_vect)
+{
+    robotWakeSource = ROBOT_WAKE_INSOMNIA;
+}
+
+/***************************************************************************************
+ * Function: Cruise_SpeedFromDuty()
+ ***************************************************************************************
+ * Return: Q8 speed which gives the PWM duty
+ **************************************************************************************/
+int16_t Cruise_SpeedFromDuty(byte duty)
+{
+    return (int16_t)((((uint16_t)duty * DRIVE_SPEED_FULL) + DRV8834_POWER_FULL - 1u) / DRV8834_POWER_FULL);
+}
+
+/***************************************************************************************
+ * Function: Cruise_ReadMilliVolts()
+ ***************************************************************************************
+ * Description: The divider is read CRUISE_SAMPLES times in about 7ms, the PWM ripple
+ *              spreads the readings so their average resolves less than one ADC step.
+ *              The rest and the loaded reading of a step share cruiseVccMilliVolts: the
+ *              regulator holds VCC above CRUISE_MIN_PERCENT and every new bandgap
+ *              reading would add its own ADC step of noise. Without the divider the
+ *              battery is VCC and each sample reads the bandgap, about 140ms.
+ * Return: Average of CRUISE_SAMPLES battery readings
+ **************************************************************************************/
+uint16_t Cruise_ReadMilliVolts(void)
+{
+    uint32_t sum = 0u;
+
+    if(BATTERY_MEASURE_DIVIDER == BATTERY_MEASURE)
+    {
+        for(byte sample = 0u; sample < CRUISE_SAMPLES; sample++)
+        {
+            sum += analogRead(PIN_BATTERY_LEVEL);
+        }
+
+        /* Same as Battery_ReadMilliVolts(), R1 = R2 */
+        return (uint16_t)((sum * cruiseVccMilliVolts * 2u) / ((uint32_t)ADC_MAX_VALUE * CRUISE_SAMPLES));
+    }
+    else
+    {
+        for(byte sample = 0u; sample < CRUISE_SAMPLES; sample++)
+        {
+            batteryVccMilliVolts = 0u;
+            sum += Battery_ReadVcc();
+        }
+
+        return (uint16_t)(sum / CRUISE_SAMPLES);
+    }
+}
+
+/***************************************************************************************
+ * Function: Cruise_Score()
+ ***************************************************************************************
+ * Description: Distance per joule of a sweep step, in arbitrary units.
+ * Parameters:
+ *  - duty[in]                 :   PWM duty of both motors
+ *  - restMilliVolts[in]       :   Battery with the motors stopped
+ *  - loadedMilliVolts[in]     :   Battery with the motors running
+ * Return: Back-EMF in mV per W, 0 when the motors stall or the sag is too small
+ **************************************************************************************/
+uint32_t Cruise_Score(byte duty, uint16_t restMilliVolts, uint16_t loadedMilliVolts)
+{
+    int32_t motorMilliAmps;
+    int32_t backEmf;
+    uint32_t milliWatts;
+
+    if((restMilliVolts <= loadedMilliVolts) || (CRUISE_SAG_MIN > (uint16_t)(restMilliVolts - loadedMilliVolts)))
+    {
+        /* Too little sag, the current can't be told */
+        return 0u;
+    }
+    else
+    {
+        /* Current of both motors, each gets half */
+        motorMilliAmps = ((int32_t)(restMilliVolts - loadedMilliVolts) * 1000) / socResistance;
+        backEmf = (((int32_t)loadedMilliVolts * duty) / DRV8834_POWER_FULL) -
+                  (((motorMilliAmps / 2) * (int32_t)CRUISE_MOTOR_MILLIOHMS) / 1000);
+        milliWatts = ((uint32_t)loadedMilliVolts * (motorMilliAmps + SOC_IDLE_MILLIAMPS)) / 1000u;
+
+        return (0 < backEmf) ? (((uint32_t)backEmf * 1000u) / milliWatts) : 0u;
+    }
+}
+
+/***************************************************************************************
+ * Function: Cruise_Rest()
+ ***************************************************************************************
+ * Description: Motion callback, the Robot stood still; read the battery at rest.
+ **************************************************************************************/
+void Cruise_Rest(void)
+{
+    cruiseVccMilliVolts = Battery_ReadVcc();
+    cruiseRestMilliVolts = Cruise_ReadMilliVolts();
+}
+
+/***************************************************************************************
+ * Function: Cruise_Loaded()
+ ***************************************************************************************
+ * Description: Motion callback, the motors still run; score the step and queue the next
+ *              one, rest and rotate, or keep the best duty when the sweep reached full
+ *              duty.
+ **************************************************************************************/
+void Cruise_Loaded(void)
+{
+    cruiseCalibration_t calibration;
+    uint32_t score = Cruise_Score(cruiseSweepDuty, cruiseRestMilliVolts, Cruise_ReadMilliVolts());
+
+    if(score > cruiseBestScore)
+    {
+        cruiseBestScore = score;
+        cruiseBestDuty = cruiseSweepDuty;
+    }
+    else
+    {
+        /* Do nothing */
+    }
+
+    if((DRV8834_POWER_FULL - CRUISE_DUTY_STEP) >= cruiseSweepDuty)
+    {
+        cruiseSweepDuty += CRUISE_DUTY_STEP;
+        Motion_Pause(CRUISE_REST_TIME, Cruise_Rest);
+        Motion_Rotate(Cruise_SpeedFromDuty(cruiseSweepDuty), CRUISE_RUN_TIME, Cruise_Loaded);
+    }
+    else
+    {
+        /* Sweep done; nothing scored keeps full duty until the next start sweeps again */
+        Motion_Brake(NULL);
+        calibration.magic = CRUISE_CALIBRATION_MAGIC;
+        calibration.duty = (0u != cruiseBestScore) ? cruiseBestDuty : DRV8834_POWER_FULL;
+        if(0u != cruiseBestScore)
+        {
+            EEPROM.put(EEPROM_ADDRESS_CRUISE, calibration);
         }
         else
         {
-            /* Stop motors if some time passed since last command */
-            if((0 != breakTime) && (DRV8834_BREAK_TIMEOUT < (millis() - breakTime)))
-            {
-                /* Stop Motors */
-                Motor_BreakMotor(DRV8834_MOTOR_BOTH);
+            /* Do nothing */
+        }
+        cruiseSpeed = Cruise_SpeedFromDuty(calibration.duty);
+        cruiseState = CRUISE_STATE_DONE;
 
-                /* Disable Break Timeout */
-                breakTime = 0;
-            }
-            else
-            {
-                /* Do Nothing */
-            }
+        /* Dev Stuff */
+        if(E_OK == devStuff)
+        {
+            Serial.print("Cruise duty: ");
+            Serial.println(calibration.duty);
+        }
+        else
+        {
+            /* Do nothing */
         }
     }
 }
 
 /***************************************************************************************
- * Function: Robot_WakeUp()
+ * Function: Cruise_Init()
+ ***************************************************************************************
+ * Description: Load the cruise duty found on an earlier start.
+ **************************************************************************************/
+void Cruise_Init(void)
+{
+    cruiseCalibration_t calibration;
+
+    EEPROM.get(EEPROM_ADDRESS_CRUISE, calibration);
+    if(E_OK != CRUISE_MOTORS_PWM)
+    {
+        /* Nothing to sweep, full duty */
+        cruiseState = CRUISE_STATE_DONE;
+    }
+    else if((CRUISE_CALIBRATION_MAGIC == calibration.magic) && (CRUISE_DUTY_FIRST <= calibration.duty) &&
+            (E_OK != CRUISE_RECALIBRATE))
+    {
+        cruiseSpeed = Cruise_SpeedFromDuty(calibration.duty);
+        cruiseState = CRUISE_STATE_DONE;
+    }
+    else
+    {
+        /* Never calibrated, sweep once the Robot is free */
+        cruiseState = CRUISE_STATE_NEEDED;
+    }
+}
+
+/***************************************************************************************
+ * Function: Cruise_Task()
+ ***************************************************************************************
+ * Description: Start the sweep when it is needed and the Robot explores on its own with
+ *              nothing else to do; start over when something else stopped it.
+ **************************************************************************************/
+void Cruise_Task(void)
+{
+    if((CRUISE_STATE_SWEEP == cruiseState) && (E_OK != Motion_Busy()))
+    {
+        /* The queue was cleared under the sweep: mode switch, sleep or beacon */
+        cruiseState = CRUISE_STATE_NEEDED;
+    }
+    else if((CRUISE_STATE_NEEDED == cruiseState) && (EXPLORE_AUTOMATE == exploreState) &&
+            (BEACON_STATE_IDLE == beaconState) && (E_OK != Motion_Busy()) &&
+            (CRUISE_MIN_PERCENT <= socPercent))
+    {
+        cruiseSweepDuty = CRUISE_DUTY_FIRST;
+        cruiseBestScore = 0u;
+        Motion_Pause(CRUISE_REST_TIME, Cruise_Rest);
+        Motion_Rotate(Cruise_SpeedFromDuty(cruiseSweepDuty), CRUISE_RUN_TIME, Cruise_Loaded);
+        cruiseState = CRUISE_STATE_SWEEP;
+    }
+    else
+    {
+        /* Do nothing */
+    }
+}
+
+/***************************************************************************************
+ * Function: Robot_ArmWakeUp()
  ***************************************************************************************
- * Description: This function is executed when the robot wakes up. It will initialize
- *              everything and will make the robot functional.
+ * Description: Let the IR Receiver and Insomnia wake the Robot from power down. Only
+ *              level interrupts of INT0 / INT1 wake it, and only when low, so pin
+ *              change interrupts are used: D9 is PCINT1, D2 is PCINT18.
  **************************************************************************************/
-void Robot_WakeUp(void)
+void Robot_ArmWakeUp(void)
 {
-    /* Initialize things */
-    /* PIN Modes */
-    pinMode(LED_BUILTIN, OUTPUT);   /* Debug purposes */
-    pinMode(PIN_MA_ENABLE, OUTPUT);
-    pinMode(PIN_MA_PHASE, OUTPUT);
-    pinMode(PIN_MB_ENABLE, OUTPUT);
-    pinMode(PIN_MB_PHASE, OUTPUT);
-    pinMode(PIN_DRV8834_SLEEP, OUTPUT);
-    pinMode(PIN_IR_RECEIVER_POWER, OUTPUT);
-    pinMode(PIN_IR_RECEIVER_DATA, INPUT);
-
-    /* Wakeup the Motor Driver */
-    digitalWrite(PIN_DRV8834_SLEEP, HIGH);
-    delay(DRV8834_WAKEUP_WAIT);
+    robotWakeSource = ROBOT_WAKE_TIMER;
 
-    /* Set default direction of both Motors to move Forward */
-    Motor_SwitchDirection(DRV8834_MOTOR_BOTH, DRV8834_DIRECTION_FORWARD);
+    PCMSK2 |= _BV(PCINT18);
+    if(E_OK == ROBOT_SLEEP_LISTEN)
+    {
+        PCMSK0 |= _BV(PCINT1);
+    }
+    else
+    {
+        /* Do nothing */
+    }
 
-    /* Power on the IR Receiver */
-    digitalWrite(PIN_IR_RECEIVER_POWER, HIGH);
+    /* Forget edges from before sleeping */
+    PCIFR = _BV(PCIF0) | _BV(PCIF2);
+    PCICR |= _BV(PCIE0) | _BV(PCIE2);
+}
 
-    /* Enable IR Receiver */
-    irrecv.enableIRIn();
+/***************************************************************************************
+ * Function: Robot_DisarmWakeUp()
+ ***************************************************************************************
+ * Description: Awake again, the pins don't interrupt anymore.
+ **************************************************************************************/
+void Robot_DisarmWakeUp(void)
+{
+    PCICR &= ~(_BV(PCIE0) | _BV(PCIE2));
+    PCMSK0 &= ~_BV(PCINT1);
+    PCMSK2 &= ~_BV(PCINT18);
+}
 
-    /* Dev Stuff */
-    if(E_OK == devStuff)
+/***************************************************************************************
+ * Function: Robot_PowerDown()
+ ***************************************************************************************
+ * Description: Power down for up to 8 seconds, unless a wake up pin is already set.
+ * Parameters:
+ *  - period[in]   :   SLEEP_1S, SLEEP_2S, SLEEP_4S or SLEEP_8S
+ * Return: E_OK if the whole period was slept
+ **************************************************************************************/
+byte Robot_PowerDown(period_t period)
+{
+    if(ROBOT_WAKE_TIMER == robotWakeSource)
     {
-        /* New Day! */
-        Serial.println("Good Morning!");
+        LowPower.powerDown(period, ADC_OFF, BOD_OFF);
+    }
+    else
+    {
+        /* Do nothing */
     }
+
+    return (ROBOT_WAKE_TIMER == robotWakeSource) ? E_OK : E_NOT_OK;
 }
 
 /***************************************************************************************
@@ -407,39 +2827,33 @@ void Robot_WakeUp(void)
  *  - sleepTime[in]   :   Number of seconds to go to sleep
  *                              Supported Inputs: 
  *                                  0u - 3600u
+ * Return: ROBOT_WAKE_TIMER, or ROBOT_WAKE_IR / ROBOT_WAKE_INSOMNIA when woken early
  **************************************************************************************/
-void Robot_Sleep(uint16_t sleepTime)
+byte Robot_Sleep(uint16_t sleepTime)
 {
+    uint16_t sleptTime = 0u;
+
     /* Check if Robot is able to sleep */
     if(HIGH == digitalRead(PIN_INSOMNIA))
     {
         /* Insomnia is here, can't sleep */
+        return ROBOT_WAKE_INSOMNIA;
     }
     else
     {
         /* Insomnia is not around, sleep */
-        /* Set wakeup conditions */
-        /* GPIO External Interrupt Wakeup */
-        attachInterrupt(PIN_INSOMNIA, Robot_WakeUp, HIGH);
-
-        /* Ensure All Used Pins are configured to output, then output nothing */
-        /* Exception for Insomnia to wake it up and Battery Level as it will be always on */
-        pinMode(PIN_IR_RECEIVER_POWER, OUTPUT);
-        digitalWrite(PIN_IR_RECEIVER_POWER, LOW);   /* Disable IR Receiver */
-        pinMode(PIN_IR_RECEIVER_DATA, OUTPUT);
-        digitalWrite(PIN_IR_RECEIVER_DATA, LOW);
-        pinMode(PIN_DRV8834_SLEEP, OUTPUT);
-        digitalWrite(PIN_DRV8834_SLEEP, LOW);   /* Send Motor Driver to sleep */
-        pinMode(PIN_MA_ENABLE, OUTPUT);
-        digitalWrite(PIN_MA_ENABLE, LOW);
-        pinMode(PIN_MA_PHASE, OUTPUT);
-        digitalWrite(PIN_MA_PHASE, LOW);
-        pinMode(PIN_MB_ENABLE, OUTPUT);
-        digitalWrite(PIN_MB_ENABLE, LOW);
-        pinMode(PIN_MB_PHASE, OUTPUT);
-        digitalWrite(PIN_MB_PHASE, LOW);
-        pinMode(LED_BUILTIN, OUTPUT);
-        digitalWrite(LED_BUILTIN, LOW);        
+        /* Wake up code needs 8MHz for the IR Receiver */
+        Clock_Boost();
+
+        /* Stop the motors and what they were about to do, the pins are parked right before sleeping */
+        Motion_Clear();
+
+        /* Write the log while there is nothing else to do */
+        Log_Flush();
+
+        /* Show it, the e-paper keeps the image without power */
+        Mood_Show(DISPLAY_MOOD_SLEEPING);
+        Display_Wait();
 
         /* Dev Stuff */
         if(E_OK == devStuff)
@@ -450,26 +2864,138 @@ void Robot_Sleep(uint16_t sleepTime)
             delay(100);
         }
 
-        /* Go to sleep */
-        if(sleepTime & 1u)
+        /* Park the pins and stop the peripherals, millis() and the display are done */
+        if(E_OK == ROBOT_SLEEP_LISTEN)
+        {
+            /* IR Receiver stays on and drives its pin, the remote wakes the Robot */
+            Power_Sleep(POWER_GROUP_IR);
+        }
+        else
+        {
+            Power_Sleep(0u);
+            Energy_SetState(ENERGY_IR, ENERGY_OFF);
+        }
+        Energy_SetState(ENERGY_DRV8834, ENERGY_DRV8834_SLEEP);
+        motorDriverState = DRV8834_STATE_ASLEEP;
+
+        /* Set wakeup conditions */
+        Robot_ArmWakeUp();
+        Energy_SetState(ENERGY_MCU, ENERGY_MCU_POWER_DOWN);
+
+        /* Go to sleep, a wake up pin ends it early */
+        if((sleepTime & 1u) && (E_OK == Robot_PowerDown(SLEEP_1S)))
         {
-            LowPower.powerDown(SLEEP_1S, ADC_OFF, BOD_OFF);
+            sleptTime += 1u;
         }
-        if(sleepTime & 2u)
+        if((sleepTime & 2u) && (E_OK == Robot_PowerDown(SLEEP_2S)))
         {
-            LowPower.powerDown(SLEEP_1S, ADC_OFF, BOD_OFF);
+            sleptTime += 2u;
         }
-        if(sleepTime & 4u)
+        if((sleepTime & 4u) && (E_OK == Robot_PowerDown(SLEEP_4S)))
         {
-            LowPower.powerDown(SLEEP_4S, ADC_OFF, BOD_OFF);
+            sleptTime += 4u;
         }
 
-        while(sleepTime & 0xFFF8u)
+        while((sleepTime - sleptTime) & 0xFFF8u)
         {
-            sleepTime -= 8;
-            LowPower.powerDown(SLEEP_8S, ADC_OFF, BOD_OFF);
+            if(E_OK == Robot_PowerDown(SLEEP_8S))
+            {
+                sleptTime += 8u;
+            }
+            else
+            {
+                break;
+            }
+        }
+
+        /* Timers and ADC are needed again, the pins wait for Robot_WakeUp() */
+        Power_Resume();
+
+        /* The remote is sending, catch the rest of the frame before anything else */
+        if(ROBOT_WAKE_IR == robotWakeSource)
+        {
+            irrecv.enableIRInMark(IR_WAKE_MARK_TICKS);
+        }
+        else
+        {
+            /* Do nothing */
         }
+        Robot_DisarmWakeUp();
+
+        /* LowPower uses the watchdog as sleep timer and turns it off on wake up */
+        wdt_enable(SUPERVISOR_WATCHDOG_TIMEOUT);
+
+        /* millis() stops while sleeping; the period which was cut short isn't counted */
+        logSleptSeconds += sleptTime;
+        Energy_Elapse((uint32_t)sleptTime * 1000u);
+        Energy_SetState(ENERGY_MCU, ENERGY_MCU_ACTIVE);
+
+        /* millis() stood still, the VCC reading is from before the sleep */
+        batteryVccMilliVolts = 0u;
+
+        return robotWakeSource;
+    }
+}
+
+/***************************************************************************************
+ * Function: Robot_Hibernate()
+ ***************************************************************************************
+ * Description: Sleep until the battery is charged again. Each wake only measures the
+ *              battery, nothing else is powered; the sleeps get twice as long every
+ *              time, up to HIBERNATE_SLEEP_MAX, as the sun needs a while anyway.
+ * Parameters:
+ *  - batteryMilliVolts[in]   :   Battery voltage which made the Robot hibernate
+ **************************************************************************************/
+void Robot_Hibernate(uint16_t batteryMilliVolts)
+{
+    uint16_t sleepTime = HIBERNATE_SLEEP_MIN;
+    uint32_t sleepStart = Log_Now();
+    byte batteryPercent;
+    byte wakeSource;
+
+    Log_Event(LOG_EVENT_BATTERY_LOW, batteryMilliVolts);
+    Log_Event(LOG_EVENT_SLEEP, batteryMilliVolts);
+
+    do
+    {
+        /* Go to sleep */
+        wakeSource = Robot_Sleep(sleepTime);
+
+        /* Measure only the battery */
+        batteryMilliVolts = Battery_ReadMilliVolts();
+        batteryPercent = Soc_Update(batteryMilliVolts);
+
+        /* Sleep longer next time */
+        sleepTime = min(sleepTime * 2u, HIBERNATE_SLEEP_MAX);
+    }while((HIBERNATE_EXIT_PERCENT > batteryPercent) && (ROBOT_WAKE_TIMER == wakeSource));
+
+    /* Woken by the remote or Insomnia: stay awake a while, even on a low battery */
+    if(ROBOT_WAKE_TIMER != wakeSource)
+    {
+        robotRoused = E_OK;
+        robotRousedTime = millis();
+    }
+    else
+    {
+        /* Do nothing */
+    }
+
+    Log_Event(LOG_EVENT_WAKE, (uint16_t)(Log_Now() - sleepStart));
+    if(HIBERNATE_EXIT_PERCENT <= batteryPercent)
+    {
+        Log_Event(LOG_EVENT_BATTERY_OK, batteryMilliVolts);
+    }
+    else if(ROBOT_WAKE_IR == wakeSource)
+    {
+        Log_Event(LOG_EVENT_WAKE_IR, batteryMilliVolts);
+    }
+    else
+    {
+        Log_Event(LOG_EVENT_WAKE_INSOMNIA, batteryMilliVolts);
     }
+
+    /* Wakeup */
+    Robot_WakeUp();
 }
 
 /***************************************************************************************
@@ -479,33 +3005,272 @@ void Robot_Sleep(uint16_t sleepTime)
  **************************************************************************************/
 void Robot_PowerManagement()
 {
-    volatile uint16_t batteryLevel;
-    volatile float batteryVoltage;
+    PROFILE_SCOPE(PROFILER_PROBE_POWER_MANAGEMENT);
 
-    /* Go to sleep if the battery is discharged to save energy and let Solar recharge it */
-    do
+    uint16_t batteryMilliVolts;
+    byte batteryPercent;
+
+    /* Read Battery Level once a second, or when a load step is due to be measured */
+    if((0u != socLastMilliVolts) && (BATTERY_READ_PERIOD > (millis() - batteryReadTime)) &&
+       !((E_OK == socStepPending) && (SOC_STEP_SETTLE <= (millis() - socStepTime))))
     {
-        /* Read Battery Level */
-        batteryLevel = analogRead(PIN_BATTERY_LEVEL);
-        
-        /* Battery voltage is double the reading value; Voltage Divider is used with R1 = R2 */
-        batteryVoltage = (batteryLevel * (ADC_MAX_VOLTAGE / ADC_MAX_VALUE)) * 2;
+        return;
+    }
+    else
+    {
+        batteryReadTime = millis();
+        batteryMilliVolts = Battery_ReadMilliVolts();
+        batteryPercent = Soc_Update(batteryMilliVolts);
+    }
+
+    /* Someone woke the Robot, it stays up for a while */
+    if((E_OK == robotRoused) && (ROBOT_ROUSED_TIME < (millis() - robotRousedTime)))
+    {
+        robotRoused = E_NOT_OK;
+    }
+    else
+    {
+        /* Do nothing */
+    }
+
+    /* Hibernate if the battery is discharged to save energy and let Solar recharge it */
+    if((HIBERNATE_ENTER_PERCENT > batteryPercent) && (E_NOT_OK == robotRoused))
+    {
+        Robot_Hibernate(batteryMilliVolts);
+    }
+    else
+    {
+        /* No need to sleep */
+        Energy_SetVoltage(batteryMilliVolts);
+        Display_SetBattery(batteryMilliVolts);
+        Mood_Update(batteryPercent);
+    }
+}
+
+/***************************************************************************************
+ * Function: Supervisor_SaveResetFlags()
+ ***************************************************************************************
+ * Description: Runs from .init3, before the C startup and long before setup(). Saves
+ *              the reset cause and stops the watchdog: it stays on after a watchdog
+ *              reset and would reset the Robot again while it is still booting.
+ *              Optiboot clears MCUSR before starting the sketch and hands its value
+ *              over in r2, nothing touches r2 before .init3. Without a bootloader MCUSR
+ *              always has a flag set. See Notes.h for the bootloader.
+ **************************************************************************************/
+void Supervisor_SaveResetFlags(void) __attribute__((naked, used, section(".init3")));
+void Supervisor_SaveResetFlags(void)
+{
+#ifdef __AVR__
+    __asm__ __volatile__ ("sts %0, r2" : "=m" (supervisorResetFlags));
+#endif
+    if(0u != MCUSR)
+    {
+        /* No bootloader, or one which leaves MCUSR as it is */
+        supervisorResetFlags = MCUSR;
+    }
+    else
+    {
+        /* Optiboot, r2 has it */
+    }
+    MCUSR = 0u;
+    wdt_disable();
+}
+
+/***************************************************************************************
+ * Function: Supervisor_SafeState()
+ ***************************************************************************************
+ * Description: Something keeps resetting the Robot. Put the motors and everything else
+ *              to sleep for a long time, then try again.
+ * Parameters:
+ *  - faults[in]   :   Watchdog or brownout resets in a row
+ **************************************************************************************/
+void Supervisor_SafeState(byte faults)
+{
+    Log_Event(LOG_EVENT_SAFE_STATE, faults);
+
+    /* Dev Stuff */
+    if(E_OK == devStuff)
+    {
+        Serial.println("Too many faults, safe state");
+    }
+
+    /* Robot_Sleep() sends the Motor Driver to sleep and turns every used pin off */
+    Robot_Sleep(SUPERVISOR_SAFE_SLEEP);
+}
+
+/***************************************************************************************
+ * Function: Supervisor_Init()
+ ***************************************************************************************
+ * Description: Count the reset cause, log it and go to the safe state after repeated
+ *              faults. Watchdog resets mean something hung; brownout resets mean the
+ *              battery can't carry the load. A power on reset also sets BORF, so
+ *              brownout is a fault only without PORF.
+ **************************************************************************************/
+void Supervisor_Init(void)
+{
+    supervisorCounters_t counters;
+    byte event = LOG_EVENT_BOOT;
+
+    /* Read counters, start from zero if they were never written */
+    EEPROM.get(EEPROM_ADDRESS_SUPERVISOR, counters);
+    if(SUPERVISOR_EEPROM_MAGIC != counters.magic)
+    {
+        memset(&counters, 0, sizeof(counters));
+        counters.magic = SUPERVISOR_EEPROM_MAGIC;
+    }
+    else
+    {
+        /* Continue counting */
+    }
+
+    /* Count each cause */
+    for(byte cause = 0u; cause < SUPERVISOR_RESET_CAUSES; cause++)
+    {
+        if(supervisorResetFlags & (1u << cause))
+        {
+            counters.resets[cause]++;
+        }
+        else
+        {
+            /* Do nothing */
+        }
+    }
+
+    /* Check for a fault */
+    if(supervisorResetFlags & _BV(WDRF))
+    {
+        event = LOG_EVENT_WATCHDOG;
+        counters.faults++;
+    }
+    else if((supervisorResetFlags & _BV(BORF)) && !(supervisorResetFlags & _BV(PORF)))
+    {
+        event = LOG_EVENT_BROWNOUT;
+        counters.faults++;
+    }
+    else
+    {
+        /* Clean start: power on or reset button, forget old faults */
+        counters.faults = 0u;
+    }
 
-        /* Check if robot is tired */
-        if(BATTERY_SLEEP_THRESHOLD >= batteryVoltage)
+    EEPROM.put(EEPROM_ADDRESS_SUPERVISOR, counters);
+    Log_Event(event, supervisorResetFlags);
+
+    /* Dev Stuff */
+    if(E_OK == devStuff)
+    {
+        Serial.print("Resets PO/EXT/BO/WD: ");
+        for(byte cause = 0u; cause < SUPERVISOR_RESET_CAUSES; cause++)
         {
-            /* Go to sleep */
-            Robot_Sleep(ROBOT_SLEEP_TIME_DEFAULT);
+            Serial.print(counters.resets[cause]);
+            Serial.print(' ');
+        }
+        Serial.println();
+    }
+
+    if(SUPERVISOR_MAX_FAULTS <= counters.faults)
+    {
+        Supervisor_SafeState(counters.faults);
+    }
+    else
+    {
+        /* Good to go */
+    }
+
+    /* Reset if the loop ever hangs */
+    wdt_enable(SUPERVISOR_WATCHDOG_TIMEOUT);
+}
+
+/***************************************************************************************
+ * Function: Supervisor_Task()
+ ***************************************************************************************
+ * Description: Kick the watchdog, once every loop. After running fine for a while the
+ *              faults in a row are forgotten.
+ **************************************************************************************/
+void Supervisor_Task(void)
+{
+    static byte healthy = E_NOT_OK;
+
+    wdt_reset();
+
+    if((E_NOT_OK == healthy) && (SUPERVISOR_HEALTHY_TIME < millis()))
+    {
+        healthy = E_OK;
 
-            /* Wakeup */
-            Robot_WakeUp();
+        /* EEPROM.update() skips the write if there were no faults */
+        EEPROM.update(EEPROM_ADDRESS_SUPERVISOR + offsetof(supervisorCounters_t, faults), 0u);
+    }
+    else
+    {
+        /* Do nothing */
+    }
+}
+
+/***************************************************************************************
+ * Function: Telemetry_Send()
+ ***************************************************************************************
+ * Description: Send one telemetry frame on Serial without blocking. Serial sends from
+ *              its own interrupt driven buffer; if there is no room for the whole frame
+ *              it is dropped, so the loop is never throttled by the UART.
+ * Parameters:
+ *  - frameId[in]   :   TELEMETRY_ID_* of the data
+ *  - data[in]      :   Data of the frame, little endian
+ *  - dataLen[in]   :   Number of data bytes, up to TELEMETRY_MAX_DATA
+ **************************************************************************************/
+void Telemetry_Send(byte frameId, const byte *data, byte dataLen)
+{
+    PROFILE_SCOPE(PROFILER_PROBE_TELEMETRY);
+
+    byte frame[TELEMETRY_MAX_FRAME];
+    byte encoded[TELEMETRY_MAX_ENCODED];
+    byte frameLen = 0u;
+    byte encodedLen = 0u;
+    byte codeIndex;
+    byte checksum = 0u;
+    uint16_t now = (uint16_t)millis();
+
+    /* Build frame */
+    frame[frameLen++] = frameId;
+    frame[frameLen++] = (byte)now;
+    frame[frameLen++] = (byte)(now >> 8);
+    for(byte index = 0u; index < dataLen; index++)
+    {
+        frame[frameLen++] = data[index];
+    }
+    for(byte index = 0u; index < frameLen; index++)
+    {
+        checksum += frame[index];
+    }
+    frame[frameLen++] = checksum;
+
+    /* COBS: every 0 is replaced with the distance to the next 0 */
+    encoded[encodedLen++] = 0u;     /* Ends whatever text came before */
+    codeIndex = encodedLen++;
+    encoded[codeIndex] = 1u;
+    for(byte index = 0u; index < frameLen; index++)
+    {
+        if(0u == frame[index])
+        {
+            codeIndex = encodedLen++;
+            encoded[codeIndex] = 1u;
         }
         else
         {
-            /* No need to sleep */
-            break;
+            encoded[encodedLen++] = frame[index];
+            encoded[codeIndex]++;
         }
-    }while(BATTERY_SLEEP_THRESHOLD >= batteryVoltage);
+    }
+    encoded[encodedLen++] = 0u;
+
+    /* Send only if it fits in the Serial buffer */
+    if(Serial.availableForWrite() >= encodedLen)
+    {
+        Serial.write(encoded, encodedLen);
+    }
+    else
+    {
+        telemetryDropped++;
+    }
 }
 
 /***************************************************************************************
@@ -521,14 +3286,61 @@ void Robot_Testing(void)
     /* Test if motors stopped working */
     //Motor_TestMotor(DRV8834_MOTOR_BOTH);
 
-    /* Read Battery Level */
-    float batteryLevel = analogRead(PIN_BATTERY_LEVEL);
-        
-    /* Battery voltage is double the reading value; Voltage Divider is used with R1 = R2 */
-    float batteryVoltage = (batteryLevel * (ADC_MAX_VOLTAGE / ADC_MAX_VALUE)) * 2;
+    static unsigned long telemetryTime = 0u;
+    static unsigned long telemetryDisplayTime = 0u;
+    static unsigned long telemetryEnergyTime = 0u;
+    static byte telemetryEnergySubsystem = 0u;
+    static unsigned long telemetrySocTime = 0u;
+    displayStats_t displayStats;
+    telemetryEnergy_t energy;
+    telemetrySoc_t soc;
 
     /* Show battery level on Serial */
-    Serial.println(batteryVoltage);
+    if(TELEMETRY_PERIOD < (millis() - telemetryTime))
+    {
+        telemetryTime = millis();
+
+        /* Read Battery Level */
+        uint16_t batteryMilliVolts = Battery_ReadMilliVolts();
+
+        Telemetry_Send(TELEMETRY_ID_BATTERY, (const byte *)&batteryMilliVolts, sizeof(batteryMilliVolts));
+
+        /* Tell when Serial can't keep up */
+        if(0u != telemetryDropped)
+        {
+            Telemetry_Send(TELEMETRY_ID_DROPPED, (const byte *)&telemetryDropped, sizeof(telemetryDropped));
+        }
+    }
+
+    /* Show what the display costs */
+    if(TELEMETRY_DISPLAY_PERIOD < (millis() - telemetryDisplayTime))
+    {
+        telemetryDisplayTime = millis();
+        Display_GetStats(&displayStats);
+        Telemetry_Send(TELEMETRY_ID_DISPLAY, (const byte *)&displayStats, sizeof(displayStats));
+    }
+
+    /* Show where the battery goes, one subsystem after the other */
+    if(TELEMETRY_ENERGY_PERIOD < (millis() - telemetryEnergyTime))
+    {
+        telemetryEnergyTime = millis();
+        energy.subsystem = telemetryEnergySubsystem;
+        energy.milliJoules = Energy_MilliJoules(telemetryEnergySubsystem);
+        Telemetry_Send(TELEMETRY_ID_ENERGY, (const byte *)&energy, sizeof(energy));
+        telemetryEnergySubsystem = (telemetryEnergySubsystem + 1u) % ENERGY_SUBSYSTEM_COUNT;
+    }
+
+    /* Show the state of charge and what it is based on */
+    if(TELEMETRY_SOC_PERIOD < (millis() - telemetrySocTime))
+    {
+        telemetrySocTime = millis();
+        soc.percent = socPercent;
+        soc.resistance = socResistance;
+        Telemetry_Send(TELEMETRY_ID_SOC, (const byte *)&soc, sizeof(soc));
+    }
+
+    /* Show where the CPU time goes */
+    Profiler_Dump();
 }
 
 /***************************************************************************************
@@ -542,13 +3354,42 @@ void setup(void)
     if(E_OK == devStuff)
     {
         /* Prepare Debug */
+        Power_Hold(POWER_USART, POWER_HOLDER_SERIAL);
         Serial.begin(SERIAL_BRATE);
+
+        /* Start counting cycles */
+        Power_Hold(POWER_TIMER1, POWER_HOLDER_PROFILER);
+        Profiler_Init();
     }
     else
     {
         /* Do nothing */
     }
 
+    /* Start counting the energy spent */
+    Energy_Init();
+
+    /* Stop the peripherals nobody uses: TWI always, USART and Timer1 in production */
+    Power_Init(robotPins, sizeof(robotPins) / sizeof(robotPins[0]));
+
+    /* Load IR Remote mapping */
+    Keymap_Load();
+
+    /* Load the bandgap calibration of this board */
+    Battery_Init();
+
+    /* Load the most efficient cruise duty */
+    Cruise_Init();
+
+    /* Prepare the e-paper, it shows the first mood after the battery is read */
+    Display_Init();
+
+    /* Continue the event log */
+    Log_Init();
+
+    /* Check why the Robot started and start the watchdog */
+    Supervisor_Init();
+
     /* Initialize everything */
     Robot_WakeUp();
 }
@@ -560,6 +3401,9 @@ void setup(void)
  **************************************************************************************/
 void loop(void) 
 {
+    /* Still alive */
+    Supervisor_Task();
+
     /* Dev Build */
     if(E_OK == devStuff)
     {
@@ -574,6 +3418,27 @@ void loop(void)
     /* Battery Management */
     Robot_PowerManagement();
 
+    /* Keep the event log */
+    Log_Task();
+
+    /* Blink for learned codes */
+    Keymap_Task();
+
+    /* Finish display refreshes */
+    Display_Task();
+
     /* Movement Control */
     Robot_Explore();
+
+    /* Find the cruise duty once */
+    Cruise_Task();
+
+    /* Next step of the queued moves */
+    Motion_Task();
+
+    /* Start the motors commanded above, or send the Motor Driver to sleep */
+    Motor_Task();
+
+    /* Slow down when there is nothing to do */
+    Clock_Task();
 }
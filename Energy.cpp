@@ -0,0 +1,219 @@
+/***************************************************************************************
+ * Includes
+ **************************************************************************************/
+#include "Energy.h"
+
+#ifdef ENERGY_HOST
+#include <string.h>
+#define PROGMEM
+#define memcpy_P    memcpy
+unsigned long millis(void);
+#else
+#include <Arduino.h>
+#include <avr/pgmspace.h>
+#endif
+
+/***************************************************************************************
+ * Macros
+ **************************************************************************************/
+#define ENERGY_MICROJOULES_PER_MILLIJOULE   1000u
+#define ENERGY_LEVEL_FULL                   255u
+
+/***************************************************************************************
+ * Types
+ **************************************************************************************/
+/* Ledger of one subsystem */
+typedef struct
+{
+    uint8_t state;
+    uint8_t level;
+    uint32_t milliJoules;
+    uint32_t microJoules;       /* Below one millijoule, carried into milliJoules */
+} energyAccount_t;
+
+/***************************************************************************************
+ * Profiles
+ **************************************************************************************/
+/* Currents in microamps, from the measurements in Notes.h:
+ * - Robot sleeping draws 1.58mA, all of it is the board as everything else is off
+ * - Robot idle draws 7.03mA: DRV8834 2.5mA, IR Receiver 0.4mA, ADC 0.23mA, the rest is the MCU
+ * - Motors running draw 210mA, about 100mA each at full duty
+ * - MCU idle is not measured, the datasheet gives about a third of active at 8MHz
+ * - MCU at 1MHz is not measured either, the datasheet gives about 0.5mA over the sleeping board */
+static const energyProfile_t energyProfiles[ENERGY_SUBSYSTEM_COUNT][ENERGY_STATE_COUNT] PROGMEM =
+{
+    /* ENERGY_MCU: power down, idle, active, active at 1MHz */
+    { { 1580u, 0u }, { 2600u, 0u }, { 3900u, 0u }, { 2100u, 0u } },
+    /* ENERGY_DRV8834: sleep, awake */
+    { { 2u, 0u }, { 2500u, 0u }, { 0u, 0u }, { 0u, 0u } },
+    /* ENERGY_MOTOR_A: off, on */
+    { { 0u, 0u }, { 0u, 100000u }, { 0u, 0u }, { 0u, 0u } },
+    /* ENERGY_MOTOR_B: off, on */
+    { { 0u, 0u }, { 0u, 100000u }, { 0u, 0u }, { 0u, 0u } },
+    /* ENERGY_IR: off, on */
+    { { 0u, 0u }, { 400u, 0u }, { 0u, 0u }, { 0u, 0u } },
+    /* ENERGY_ADC: off, on */
+    { { 0u, 0u }, { 230u, 0u }, { 0u, 0u }, { 0u, 0u } },
+};
+
+static const char * const energyNames[ENERGY_SUBSYSTEM_COUNT] =
+{
+    "MCU",
+    "DRV8834",
+    "Motor A",
+    "Motor B",
+    "IR",
+    "ADC",
+};
+
+/***************************************************************************************
+ * Variables
+ **************************************************************************************/
+static energyAccount_t energyAccounts[ENERGY_SUBSYSTEM_COUNT];
+static uint16_t energyMilliVolts = ENERGY_NOMINAL_MILLIVOLTS;
+static uint32_t energyTime = 0u;                    /* millis() of the last integration */
+
+/***************************************************************************************
+ * Function: Energy_Add()
+ ***************************************************************************************
+ * Description: Add the energy of the current states over some time to the ledger.
+ * Parameters:
+ *  - miliseconds[in]   :   Time spent in the current states
+ **************************************************************************************/
+static void Energy_Add(uint32_t miliseconds)
+{
+    energyProfile_t profile;
+    uint32_t microAmps;
+    uint32_t microWatts;
+    uint32_t milliWatts;
+    uint32_t seconds = miliseconds / 1000u;
+    uint32_t rest = miliseconds % 1000u;
+
+    for(uint8_t subsystem = 0u; subsystem < ENERGY_SUBSYSTEM_COUNT; subsystem++)
+    {
+        energyAccount_t *account = &energyAccounts[subsystem];
+
+        memcpy_P(&profile, &energyProfiles[subsystem][account->state], sizeof(profile));
+        microAmps = profile.microAmps + ((profile.microAmpsFull * account->level) / ENERGY_LEVEL_FULL);
+
+        /* Power fits 32 bits, energy over an hour of sleep doesn't; split both so every
+         * product stays small and 64 bits division isn't needed */
+        microWatts = (microAmps * energyMilliVolts) / 1000u;
+        milliWatts = microWatts / 1000u;
+        microWatts %= 1000u;
+
+        account->milliJoules += milliWatts * seconds;
+        account->microJoules += (microWatts * seconds) + (milliWatts * rest) + ((microWatts * rest) / 1000u);
+        account->milliJoules += account->microJoules / ENERGY_MICROJOULES_PER_MILLIJOULE;
+        account->microJoules %= ENERGY_MICROJOULES_PER_MILLIJOULE;
+    }
+}
+
+/***************************************************************************************
+ * Function: Energy_Update()
+ ***************************************************************************************
+ * Description: Integrate the time since the last update, before anything changes.
+ **************************************************************************************/
+static void Energy_Update(void)
+{
+    uint32_t now = millis();
+
+    Energy_Add(now - energyTime);
+    energyTime = now;
+}
+
+/***************************************************************************************
+ * Function: Energy_Init()
+ ***************************************************************************************
+ * Description: Start an empty ledger with everything on, as after Robot_WakeUp().
+ **************************************************************************************/
+void Energy_Init(void)
+{
+    memset(energyAccounts, 0, sizeof(energyAccounts));
+    energyAccounts[ENERGY_MCU].state = ENERGY_MCU_ACTIVE;
+    energyAccounts[ENERGY_DRV8834].state = ENERGY_DRV8834_AWAKE;
+    energyAccounts[ENERGY_MOTOR_A].state = ENERGY_ON;
+    energyAccounts[ENERGY_MOTOR_B].state = ENERGY_ON;
+    energyAccounts[ENERGY_IR].state = ENERGY_ON;
+    energyAccounts[ENERGY_ADC].state = ENERGY_ON;
+    energyTime = millis();
+}
+
+/***************************************************************************************
+ * Function: Energy_SetState()
+ ***************************************************************************************
+ * Description: A subsystem changed state.
+ * Parameters:
+ *  - subsystem[in]   :   ENERGY_* subsystem
+ *  - state[in]       :   ENERGY_*_* state of its profile
+ **************************************************************************************/
+void Energy_SetState(uint8_t subsystem, uint8_t state)
+{
+    Energy_Update();
+    energyAccounts[subsystem].state = state;
+}
+
+/***************************************************************************************
+ * Function: Energy_SetLevel()
+ ***************************************************************************************
+ * Description: A subsystem changed its PWM duty.
+ * Parameters:
+ *  - subsystem[in]   :   ENERGY_* subsystem
+ *  - level[in]       :   0 - 255, as given to analogWrite()
+ **************************************************************************************/
+void Energy_SetLevel(uint8_t subsystem, uint8_t level)
+{
+    Energy_Update();
+    energyAccounts[subsystem].level = level;
+}
+
+/***************************************************************************************
+ * Function: Energy_SetVoltage()
+ ***************************************************************************************
+ * Description: Battery voltage, current times voltage gives the power.
+ * Parameters:
+ *  - milliVolts[in]   :   Battery voltage
+ **************************************************************************************/
+void Energy_SetVoltage(uint16_t milliVolts)
+{
+    Energy_Update();
+    energyMilliVolts = milliVolts;
+}
+
+/***************************************************************************************
+ * Function: Energy_Elapse()
+ ***************************************************************************************
+ * Description: Account time which millis() didn't count, like power down sleep.
+ * Parameters:
+ *  - miliseconds[in]   :   Time spent in the current states
+ **************************************************************************************/
+void Energy_Elapse(uint32_t miliseconds)
+{
+    Energy_Update();
+    Energy_Add(miliseconds);
+}
+
+/***************************************************************************************
+ * Function: Energy_MilliJoules()
+ ***************************************************************************************
+ * Description: Energy spent by a subsystem.
+ * Parameters:
+ *  - subsystem[in]   :   ENERGY_* subsystem
+ * Return: Millijoules since Energy_Init()
+ **************************************************************************************/
+uint32_t Energy_MilliJoules(uint8_t subsystem)
+{
+    Energy_Update();
+
+    return energyAccounts[subsystem].milliJoules;
+}
+
+/***************************************************************************************
+ * Function: Energy_Name()
+ ***************************************************************************************
+ * Return: Name of a subsystem, for reports
+ **************************************************************************************/
+const char *Energy_Name(uint8_t subsystem)
+{
+    return energyNames[subsystem];
+}
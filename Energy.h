@@ -0,0 +1,53 @@
+#ifndef ENERGY_H
+#define ENERGY_H
+/***************************************************************************************
+ * Energy
+ ***************************************************************************************
+ * Ledger of the energy spent by each subsystem. Every subsystem is in one state of its
+ * profile table; the current of that state, times the battery voltage, is integrated
+ * over time. Subsystems with PWM add their full duty current scaled with the duty.
+ * Call Energy_SetState() / Energy_SetLevel() whenever a subsystem changes and
+ * Energy_Elapse() for the time millis() doesn't see, like power down.
+ * Define ENERGY_HOST to build on a PC, see tools/energysim.cpp. The PC program
+ * provides millis().
+ **************************************************************************************/
+#include <stdint.h>
+
+/* Subsystems */
+#define ENERGY_MCU              0u      /* Arduino Pro Mini board: MCU, regulator and LED */
+#define ENERGY_DRV8834          1u      /* Motor Driver logic */
+#define ENERGY_MOTOR_A          2u      /* Motor A through the DRV8834, level is its PWM duty */
+#define ENERGY_MOTOR_B          3u      /* Motor B through the DRV8834, level is its PWM duty */
+#define ENERGY_IR               4u      /* IR Receiver */
+#define ENERGY_ADC              5u      /* ADC of the MCU */
+#define ENERGY_SUBSYSTEM_COUNT  6u
+
+/* States; each subsystem uses the first ones */
+#define ENERGY_MCU_POWER_DOWN   0u
+#define ENERGY_MCU_IDLE         1u
+#define ENERGY_MCU_ACTIVE       2u
+#define ENERGY_MCU_ACTIVE_SLOW  3u      /* Clock governor runs the MCU at 1MHz */
+#define ENERGY_DRV8834_SLEEP    0u
+#define ENERGY_DRV8834_AWAKE    1u
+#define ENERGY_OFF              0u      /* Motors, IR Receiver and ADC */
+#define ENERGY_ON               1u
+#define ENERGY_STATE_COUNT      4u
+
+#define ENERGY_NOMINAL_MILLIVOLTS   3700u   /* Until Energy_SetVoltage() is called */
+
+/* Current drawn in one state */
+typedef struct
+{
+    uint32_t microAmps;         /* At level 0 */
+    uint32_t microAmpsFull;     /* Added at level 255, scaled in between */
+} energyProfile_t;
+
+void Energy_Init(void);
+void Energy_SetState(uint8_t subsystem, uint8_t state);
+void Energy_SetLevel(uint8_t subsystem, uint8_t level);
+void Energy_SetVoltage(uint16_t milliVolts);
+void Energy_Elapse(uint32_t miliseconds);
+uint32_t Energy_MilliJoules(uint8_t subsystem);
+const char *Energy_Name(uint8_t subsystem);
+
+#endif /* ENERGY_H */
@@ -19,11 +19,24 @@
 
 #include "IRremote.h"
 #include "IRremoteInt.h"
+#include "Profiler.h"
 
 // Provides ISR
 #include <avr/interrupt.h>
 
 volatile irparams_t irparams;
+#ifdef IR_SEND_ASYNC
+volatile irsendparams_t irsendparams;
+#endif
+
+#ifdef IR_CALIBRATE
+// Learned by calibrateNEC()
+static int markExcess = MARK_EXCESS;
+static unsigned int clockSkew = CAL_SKEW_ONE;
+#define RECV_MARK_EXCESS markExcess
+#else
+#define RECV_MARK_EXCESS MARK_EXCESS
+#endif
 
 // These versions of MATCH, MATCH_MARK, and MATCH_SPACE are only for debugging.
 // To use them, set DEBUG in IRremoteInt.h
@@ -66,6 +79,16 @@ int MATCH_SPACE(int measured_ticks, int desired_us) {
   Serial.println(TICKS_HIGH(desired_us - MARK_EXCESS), DEC);
   return measured_ticks >= TICKS_LOW(desired_us - MARK_EXCESS) && measured_ticks <= TICKS_HIGH(desired_us - MARK_EXCESS);
 }
+#elif defined(IR_CALIBRATE)
+// Same bounds as TICKS_LOW and TICKS_HIGH, on the skewed desired time, in integer math
+int MATCH(int measured, int desired) {
+  long expected = ((long)desired * clockSkew) >> 8;
+  long measured100 = (long)measured * USECPERTICK * 100;
+  return measured100 + USECPERTICK * 100 > expected * (100 - TOLERANCE) &&
+    measured100 <= expected * (100 + TOLERANCE) + USECPERTICK * 100;
+}
+int MATCH_MARK(int measured_ticks, int desired_us) {return MATCH(measured_ticks, (desired_us + RECV_MARK_EXCESS));}
+int MATCH_SPACE(int measured_ticks, int desired_us) {return MATCH(measured_ticks, (desired_us - RECV_MARK_EXCESS));}
 #else
 int MATCH(int measured, int desired) {return measured >= TICKS_LOW(desired) && measured <= TICKS_HIGH(desired);}
 int MATCH_MARK(int measured_ticks, int desired_us) {return MATCH(measured_ticks, (desired_us + MARK_EXCESS));}
@@ -248,9 +271,39 @@ void IRsend::sendSAMSUNG(unsigned long data, int nbits)
   space(0);
 }
 
+#ifdef IR_SEND_ASYNC
+// Add a MARK (level 0) or SPACE (level 1) to the schedule being compiled.
+// Successive entries of the same level are merged, empty ones are dropped.
+static void scheduleAppend(uint8_t level, int time) {
+  if (time <= 0) {
+    return;
+  }
+  uint8_t len = irsendparams.len;
+  if (len > 0 && ((len - 1) & 1) == level) {
+    irsendparams.schedule[len - 1] += time;
+  }
+  else if (len == 0 && level == SPACE) {
+    // Nothing to wait for before the first mark
+  }
+  else if (len < SENDBUF) {
+    irsendparams.schedule[len] = time;
+    irsendparams.len++;
+  }
+  else {
+    irsendparams.overflow = 1;
+  }
+}
+#endif
+
 void IRsend::mark(int time) {
   // Sends an IR mark for the specified number of microseconds.
   // The mark output is modulated at the PWM frequency.
+#ifdef IR_SEND_ASYNC
+  if (irsendparams.compiling) {
+    scheduleAppend(MARK, time);
+    return;
+  }
+#endif
   TIMER_ENABLE_PWM; // Enable pin 3 PWM output
   if (time > 0) delayMicroseconds(time);
 }
@@ -259,10 +312,53 @@ void IRsend::mark(int time) {
 void IRsend::space(int time) {
   // Sends an IR space for the specified number of microseconds.
   // A space is no output, so the PWM output is disabled.
+#ifdef IR_SEND_ASYNC
+  if (irsendparams.compiling) {
+    scheduleAppend(SPACE, time);
+    return;
+  }
+#endif
   TIMER_DISABLE_PWM; // Disable pin 3 PWM output
   if (time > 0) delayMicroseconds(time);
 }
 
+#ifdef IR_SEND_ASYNC
+// Start building a schedule; the next send* call doesn't transmit anything
+void IRsend::beginAsync() {
+  irsendparams.compiling = 1;
+  irsendparams.overflow = 0;
+  irsendparams.len = 0;
+  irsendparams.khz = 38;
+}
+
+// Send the schedule built since beginAsync() from the timer interrupt.
+// Returns ERR if a frame is still being sent or the schedule overflowed.
+int IRsend::sendAsync() {
+  irsendparams.compiling = 0;
+  if (irsendparams.active || irsendparams.overflow || irsendparams.len == 0) {
+    return ERR;
+  }
+  // Convert us to timer interrupts, the interrupt handler only counts down
+  for (uint8_t i = 0; i < irsendparams.len; i++) {
+    unsigned long count = (unsigned long)irsendparams.schedule[i] * irsendparams.khz * TIMER_INTR_PER_CARRIER / 1000;
+    irsendparams.schedule[i] = count ? count : 1;
+  }
+  enableIROut(irsendparams.khz);
+  cli();
+  irsendparams.index = 0;
+  irsendparams.remaining = irsendparams.schedule[0];
+  irsendparams.active = 1;
+  TIMER_ENABLE_PWM; // schedule always starts with a mark
+  TIMER_ENABLE_INTR;
+  sei();
+  return DECODED;
+}
+
+int IRsend::busy() {
+  return irsendparams.active;
+}
+#endif
+
 void IRsend::enableIROut(int khz) {
   // Enables IR output.  The khz value controls the modulation frequency in kilohertz.
   // The IR output will be on pin 3 (OC2B).
@@ -276,6 +372,14 @@ void IRsend::enableIROut(int khz) {
   // See my Secrets of Arduino PWM at http://arcfn.com/2009/07/secrets-of-arduino-pwm.html for details.
 
   
+#ifdef IR_SEND_ASYNC
+  if (irsendparams.compiling) {
+    // Only remember the carrier, the timer is set up by sendAsync()
+    irsendparams.khz = khz;
+    return;
+  }
+#endif
+
   // Disable the Timer2 Interrupt (which is used for receiving IR)
   TIMER_DISABLE_INTR; //Timer2 Overflow Interrupt
   
@@ -298,6 +402,11 @@ IRrecv::IRrecv(int recvpin)
 
 // initialization
 void IRrecv::enableIRIn() {
+#ifdef IR_FAST_PIN_READ
+  // Before the interrupt is enabled, it reads the pin through these
+  irparams.recvreg = portInputRegister(digitalPinToPort(irparams.recvpin));
+  irparams.recvmask = digitalPinToBitMask(irparams.recvpin);
+#endif
   cli();
   // setup pulse clock timer interrupt
   //Prescale /8 (16M/8 = 0.5 microseconds per tick)
@@ -328,6 +437,57 @@ void IRrecv::blink13(int blinkflag)
     pinMode(BLINKLED, OUTPUT);
 }
 
+// Compare two tick values, returning 0 if newval is shorter,
+// 1 if newval is equal, and 2 if newval is longer
+// Use a tolerance of 20%, with integer math so it is cheap enough for the ISR
+static inline uint8_t compareTicks(unsigned int oldval, unsigned int newval) {
+  if ((unsigned long)newval * 5 < (unsigned long)oldval * 4) {
+    return 0;
+  } 
+  else if ((unsigned long)oldval * 5 < (unsigned long)newval * 4) {
+    return 2;
+  } 
+  else {
+    return 1;
+  }
+}
+
+// Record one MARK or SPACE width.
+// With IR_HASH_IN_ISR each width is compared with the previous one of the same
+// kind and folded into the hash, the same way decodeHash() walks rawbuf.
+static inline void recordInterval(unsigned int ticks) {
+#ifdef IR_HASH_IN_ISR
+  uint8_t len = irparams.rawlen;
+  if (len == 0) {
+    irparams.hash = FNV_BASIS_32;
+  }
+  else if (len >= 3) {
+    irparams.hash = (irparams.hash * FNV_PRIME_32) ^ compareTicks(irparams.hashprev[len & 1], ticks);
+  }
+  irparams.hashprev[len & 1] = ticks;
+#endif
+#if defined(IR_COMPACT_RAWBUF) && !defined(IR_HASH_ONLY)
+  if (irparams.rawlen == 0) {
+    irparams.rawlongcount = 0;
+  }
+  if (ticks < RAWBUF_ESCAPE) {
+    irparams.rawbuf[irparams.rawlen] = ticks;
+  }
+  else {
+    // Too long for a byte, keep the full width aside if there is room
+    irparams.rawbuf[irparams.rawlen] = RAWBUF_ESCAPE;
+    if (irparams.rawlongcount < RAWLONG) {
+      irparams.rawlongidx[irparams.rawlongcount] = irparams.rawlen;
+      irparams.rawlong[irparams.rawlongcount] = ticks;
+      irparams.rawlongcount++;
+    }
+  }
+#elif !defined(IR_HASH_ONLY)
+  irparams.rawbuf[irparams.rawlen] = ticks;
+#endif
+  irparams.rawlen++;
+}
+
 // TIMER2 interrupt code to collect raw data.
 // Widths of alternating SPACE, MARK are recorded in rawbuf.
 // Recorded in ticks of 50 microseconds.
@@ -337,9 +497,47 @@ void IRrecv::blink13(int blinkflag)
 // As soon as first MARK arrives, gap width is recorded, ready is cleared, and new logging starts
 ISR(TIMER_INTR_NAME)
 {
+#if defined(PROFILER_ENABLE) && defined(TIMER_LATENCY_CYCLES)
+  // Dev Builds only, production doesn't read the counter
+  PROFILE_VALUE(PROFILER_PROBE_IR_LATENCY, TIMER_LATENCY_CYCLES());
+#endif
+  PROFILE_SCOPE(PROFILER_PROBE_IR_ISR);
   TIMER_RESET;
 
+#ifdef IR_SEND_ASYNC
+  // While sending, the timer runs the carrier and interrupts once or twice per period
+  if (irsendparams.active) {
+    if (--irsendparams.remaining) {
+      return;
+    }
+    uint8_t index = irsendparams.index + 1;
+    if (index >= irsendparams.len) {
+      // Frame sent, go back to receiving
+      TIMER_DISABLE_PWM;
+      TIMER_CONFIG_NORMAL();
+      irsendparams.active = 0;
+      irparams.timer = 0;
+      irparams.rawlen = 0;
+      irparams.rcvstate = STATE_IDLE;
+      return;
+    }
+    if (index & 1) {
+      TIMER_DISABLE_PWM;
+    }
+    else {
+      TIMER_ENABLE_PWM;
+    }
+    irsendparams.index = index;
+    irsendparams.remaining = irsendparams.schedule[index];
+    return;
+  }
+#endif
+
+#ifdef IR_FAST_PIN_READ
+  uint8_t irdata = (*irparams.recvreg & irparams.recvmask) ? SPACE : MARK;
+#else
   uint8_t irdata = (uint8_t)digitalRead(irparams.recvpin);
+#endif
 
   irparams.timer++; // One more 50us tick
   if (irparams.rawlen >= RAWBUF) {
@@ -356,7 +554,7 @@ ISR(TIMER_INTR_NAME)
       else {
         // gap just ended, record duration and start recording transmission
         irparams.rawlen = 0;
-        irparams.rawbuf[irparams.rawlen++] = irparams.timer;
+        recordInterval(irparams.timer);
         irparams.timer = 0;
         irparams.rcvstate = STATE_MARK;
       }
@@ -364,14 +562,14 @@ ISR(TIMER_INTR_NAME)
     break;
   case STATE_MARK: // timing MARK
     if (irdata == SPACE) {   // MARK ended, record time
-      irparams.rawbuf[irparams.rawlen++] = irparams.timer;
+      recordInterval(irparams.timer);
       irparams.timer = 0;
       irparams.rcvstate = STATE_SPACE;
     }
     break;
   case STATE_SPACE: // timing SPACE
     if (irdata == MARK) { // SPACE just ended, record it
-      irparams.rawbuf[irparams.rawlen++] = irparams.timer;
+      recordInterval(irparams.timer);
       irparams.timer = 0;
       irparams.rcvstate = STATE_MARK;
     } 
@@ -402,6 +600,31 @@ ISR(TIMER_INTR_NAME)
   }
 }
 
+// Like enableIRIn(), but as if a mark began markTicks ago after a long gap.
+// Used after waking up on the first edge of a frame: the oscillator start-up
+// eats the beginning of the header mark, which would else be taken for noise.
+void IRrecv::enableIRInMark(unsigned int markTicks) {
+  enableIRIn();
+  cli();
+  recordInterval(GAP_TICKS + 1);
+  irparams.timer = markTicks;
+  irparams.rcvstate = STATE_MARK;
+  sei();
+}
+
+// Stop the tick interrupt, e.g. while the CPU clock is too slow for it.
+// enableIRIn() or enableIRInMark() start receiving again.
+void IRrecv::disableIRIn() {
+  TIMER_DISABLE_INTR;
+  irparams.rcvstate = STATE_IDLE;
+  irparams.rawlen = 0;
+}
+
+// True while waiting for a frame, false while one is recorded or waits for decode()
+int IRrecv::isIdle() {
+  return irparams.rcvstate == STATE_IDLE && irparams.rawlen == 0;
+}
+
 void IRrecv::resume() {
   irparams.rcvstate = STATE_IDLE;
   irparams.rawlen = 0;
@@ -409,15 +632,98 @@ void IRrecv::resume() {
 
 
 
+#ifdef TEST
+// Loads a capture in 50 us ticks, gap first, as if the ISR had just recorded it.
+// Call decode() next, then resume() to go back to receiving.
+void IRrecv::replay(const unsigned int *buf, int len) {
+  // The ISR leaves the buffer alone while stopped
+  irparams.rcvstate = STATE_STOP;
+  irparams.rawlen = 0;
+  for (int i = 0; i < len && i < RAWBUF; i++) {
+    recordInterval(buf[i]);
+  }
+}
+
+void IRsendRecorder::reset(int jitterPercent) {
+  // Start with a long gap, like after the remote was idle
+  rawbuf[0] = 0xFFFF;
+  rawlen = 1;
+  run = 0;
+  runIsMark = 0;
+  jitter = jitterPercent;
+}
+
+// Store the finished mark or space with sensor lag and jitter applied
+void IRsendRecorder::flush() {
+  long usec = runIsMark ? (long)run + MARK_EXCESS : (long)run - MARK_EXCESS;
+  if (jitter) {
+    // Small LCG so runs are repeatable
+    seed = seed * 1103515245UL + 12345UL;
+    usec += usec * ((long)((seed >> 16) % (2 * jitter + 1)) - jitter) / 100;
+  }
+  if (usec < USECPERTICK) {
+    usec = USECPERTICK;
+  }
+  if (rawlen < RAWBUF) {
+    rawbuf[rawlen++] = (usec + USECPERTICK / 2) / USECPERTICK;
+  }
+  run = 0;
+}
+
+void IRsendRecorder::mark(int time) {
+  if (!runIsMark && run > 0) {
+    flush();
+  }
+  runIsMark = 1;
+  run += time;
+}
+
+// A trailing space is never flushed, the receiver sees it as the gap
+void IRsendRecorder::space(int time) {
+  if (runIsMark && run > 0) {
+    flush();
+  }
+  runIsMark = 0;
+  run += time;
+}
+#endif
+
+// Returns the width in ticks of entry index of the raw buffer.
+// Decoders must read rawbuf through here so they work with IR_COMPACT_RAWBUF.
+static unsigned int rawWidth(decode_results *results, int index) {
+#ifdef IR_COMPACT_RAWBUF
+  unsigned int width = results->rawbuf[index];
+  if (width == RAWBUF_ESCAPE) {
+    // Long width; if it didn't fit in rawlong it is at least this long
+    width = RAWLONG_OVERFLOW;
+    for (uint8_t i = 0; i < irparams.rawlongcount; i++) {
+      if (irparams.rawlongidx[i] == index) {
+        width = irparams.rawlong[i];
+        break;
+      }
+    }
+  }
+  return width;
+#else
+  return results->rawbuf[index];
+#endif
+}
+
 // Decodes the received IR message
 // Returns 0 if no data ready, 1 if data ready.
 // Results of decoding are stored in results
 int IRrecv::decode(decode_results *results) {
+  PROFILE_SCOPE(PROFILER_PROBE_IR_DECODE);
+#ifdef IR_HASH_ONLY
+  results->rawbuf = NULL;
+#else
   results->rawbuf = irparams.rawbuf;
+#endif
   results->rawlen = irparams.rawlen;
   if (irparams.rcvstate != STATE_STOP) {
     return ERR;
   }
+#ifndef IR_HASH_ONLY
 #ifdef DEBUG
   Serial.println("Attempting NEC decode");
 #endif
@@ -478,6 +784,7 @@ int IRrecv::decode(decode_results *results) {
   if (decodeSAMSUNG(results)) {
     return DECODED;
   }
+#endif // IR_HASH_ONLY
   // decodeHash returns a hash on any input.
   // Thus, it needs to be last in the list.
   // If you add any decodes, add them before this.
@@ -494,14 +801,14 @@ long IRrecv::decodeNEC(decode_results *results) {
   long data = 0;
   int offset = 1; // Skip first space
   // Initial mark
-  if (!MATCH_MARK(results->rawbuf[offset], NEC_HDR_MARK)) {
+  if (!MATCH_MARK(rawWidth(results, offset), NEC_HDR_MARK)) {
     return ERR;
   }
   offset++;
   // Check for repeat
   if (irparams.rawlen == 4 &&
-    MATCH_SPACE(results->rawbuf[offset], NEC_RPT_SPACE) &&
-    MATCH_MARK(results->rawbuf[offset+1], NEC_BIT_MARK)) {
+    MATCH_SPACE(rawWidth(results, offset), NEC_RPT_SPACE) &&
+    MATCH_MARK(rawWidth(results, offset+1), NEC_BIT_MARK)) {
     results->bits = 0;
     results->value = REPEAT;
     results->decode_type = NEC;
@@ -511,19 +818,19 @@ long IRrecv::decodeNEC(decode_results *results) {
     return ERR;
   }
   // Initial space  
-  if (!MATCH_SPACE(results->rawbuf[offset], NEC_HDR_SPACE)) {
+  if (!MATCH_SPACE(rawWidth(results, offset), NEC_HDR_SPACE)) {
     return ERR;
   }
   offset++;
   for (int i = 0; i < NEC_BITS; i++) {
-    if (!MATCH_MARK(results->rawbuf[offset], NEC_BIT_MARK)) {
+    if (!MATCH_MARK(rawWidth(results, offset), NEC_BIT_MARK)) {
       return ERR;
     }
     offset++;
-    if (MATCH_SPACE(results->rawbuf[offset], NEC_ONE_SPACE)) {
+    if (MATCH_SPACE(rawWidth(results, offset), NEC_ONE_SPACE)) {
       data = (data << 1) | 1;
     } 
-    else if (MATCH_SPACE(results->rawbuf[offset], NEC_ZERO_SPACE)) {
+    else if (MATCH_SPACE(rawWidth(results, offset), NEC_ZERO_SPACE)) {
       data <<= 1;
     } 
     else {
@@ -535,9 +842,33 @@ long IRrecv::decodeNEC(decode_results *results) {
   results->bits = NEC_BITS;
   results->value = data;
   results->decode_type = NEC;
+#ifdef IR_CALIBRATE
+  calibrateNEC(results);
+#endif
   return DECODED;
 }
 
+#ifdef IR_CALIBRATE
+// Learn clock skew and sensor lag from the header of a decoded NEC frame.
+// The header mark plus space is 13.5ms whatever the lag is, which gives the skew;
+// the mark measured with the skew removed gives the lag.
+void IRrecv::calibrateNEC(decode_results *results) {
+  long mark = (long)rawWidth(results, 1) * USECPERTICK;
+  long space = (long)rawWidth(results, 2) * USECPERTICK;
+  long skew = ((mark + space) << 8) / (NEC_HDR_MARK + NEC_HDR_SPACE);
+  if (skew < CAL_SKEW_MIN || skew > CAL_SKEW_MAX) {
+    return;
+  }
+  long excess = (mark << 8) / skew - NEC_HDR_MARK;
+  if (excess < CAL_EXCESS_MIN || excess > CAL_EXCESS_MAX) {
+    return;
+  }
+  // Average over frames, one tick of resolution is a lot for a single sample
+  clockSkew += (skew - (long)clockSkew) / CAL_WEIGHT;
+  markExcess += (excess - markExcess) / CAL_WEIGHT;
+}
+#endif
+
 long IRrecv::decodeSony(decode_results *results) {
   long data = 0;
   if (irparams.rawlen < 2 * SONY_BITS + 2) {
@@ -547,7 +878,7 @@ long IRrecv::decodeSony(decode_results *results) {
 
   // Some Sony's deliver repeats fast after first
   // unfortunately can't spot difference from of repeat from two fast clicks
-  if (results->rawbuf[offset] < SONY_DOUBLE_SPACE_USECS) {
+  if (rawWidth(results, offset) < SONY_DOUBLE_SPACE_USECS) {
     // Serial.print("IR Gap found: ");
     results->bits = 0;
     results->value = REPEAT;
@@ -557,20 +888,20 @@ long IRrecv::decodeSony(decode_results *results) {
   offset++;
 
   // Initial mark
-  if (!MATCH_MARK(results->rawbuf[offset], SONY_HDR_MARK)) {
+  if (!MATCH_MARK(rawWidth(results, offset), SONY_HDR_MARK)) {
     return ERR;
   }
   offset++;
 
   while (offset + 1 < irparams.rawlen) {
-    if (!MATCH_SPACE(results->rawbuf[offset], SONY_HDR_SPACE)) {
+    if (!MATCH_SPACE(rawWidth(results, offset), SONY_HDR_SPACE)) {
       break;
     }
     offset++;
-    if (MATCH_MARK(results->rawbuf[offset], SONY_ONE_MARK)) {
+    if (MATCH_MARK(rawWidth(results, offset), SONY_ONE_MARK)) {
       data = (data << 1) | 1;
     } 
-    else if (MATCH_MARK(results->rawbuf[offset], SONY_ZERO_MARK)) {
+    else if (MATCH_MARK(rawWidth(results, offset), SONY_ZERO_MARK)) {
       data <<= 1;
     } 
     else {
@@ -601,11 +932,11 @@ long IRrecv::decodeSanyo(decode_results *results) {
   // Initial space  
   /* Put this back in for debugging - note can't use #DEBUG as if Debug on we don't see the repeat cos of the delay
   Serial.print("IR Gap: ");
-  Serial.println( results->rawbuf[offset]);
+  Serial.println( rawWidth(results, offset));
   Serial.println( "test against:");
-  Serial.println(results->rawbuf[offset]);
+  Serial.println(rawWidth(results, offset));
   */
-  if (results->rawbuf[offset] < SANYO_DOUBLE_SPACE_USECS) {
+  if (rawWidth(results, offset) < SANYO_DOUBLE_SPACE_USECS) {
     // Serial.print("IR Gap found: ");
     results->bits = 0;
     results->value = REPEAT;
@@ -615,26 +946,26 @@ long IRrecv::decodeSanyo(decode_results *results) {
   offset++;
 
   // Initial mark
-  if (!MATCH_MARK(results->rawbuf[offset], SANYO_HDR_MARK)) {
+  if (!MATCH_MARK(rawWidth(results, offset), SANYO_HDR_MARK)) {
     return ERR;
   }
   offset++;
 
   // Skip Second Mark
-  if (!MATCH_MARK(results->rawbuf[offset], SANYO_HDR_MARK)) {
+  if (!MATCH_MARK(rawWidth(results, offset), SANYO_HDR_MARK)) {
     return ERR;
   }
   offset++;
 
   while (offset + 1 < irparams.rawlen) {
-    if (!MATCH_SPACE(results->rawbuf[offset], SANYO_HDR_SPACE)) {
+    if (!MATCH_SPACE(rawWidth(results, offset), SANYO_HDR_SPACE)) {
       break;
     }
     offset++;
-    if (MATCH_MARK(results->rawbuf[offset], SANYO_ONE_MARK)) {
+    if (MATCH_MARK(rawWidth(results, offset), SANYO_ONE_MARK)) {
       data = (data << 1) | 1;
     } 
-    else if (MATCH_MARK(results->rawbuf[offset], SANYO_ZERO_MARK)) {
+    else if (MATCH_MARK(rawWidth(results, offset), SANYO_ZERO_MARK)) {
       data <<= 1;
     } 
     else {
@@ -665,12 +996,12 @@ long IRrecv::decodeMitsubishi(decode_results *results) {
   // Initial space  
   /* Put this back in for debugging - note can't use #DEBUG as if Debug on we don't see the repeat cos of the delay
   Serial.print("IR Gap: ");
-  Serial.println( results->rawbuf[offset]);
+  Serial.println( rawWidth(results, offset));
   Serial.println( "test against:");
-  Serial.println(results->rawbuf[offset]);
+  Serial.println(rawWidth(results, offset));
   */
   /* Not seeing double keys from Mitsubishi
-  if (results->rawbuf[offset] < MITSUBISHI_DOUBLE_SPACE_USECS) {
+  if (rawWidth(results, offset) < MITSUBISHI_DOUBLE_SPACE_USECS) {
     // Serial.print("IR Gap found: ");
     results->bits = 0;
     results->value = REPEAT;
@@ -683,25 +1014,26 @@ long IRrecv::decodeMitsubishi(decode_results *results) {
   // Typical
   // 14200 7 41 7 42 7 42 7 17 7 17 7 18 7 41 7 18 7 17 7 17 7 18 7 41 8 17 7 17 7 18 7 17 7 
 
-  // Initial Space
-  if (!MATCH_MARK(results->rawbuf[offset], MITSUBISHI_HDR_SPACE)) {
+  // Initial mark; the marks were matched as spaces before, which rejected the 8 tick
+  // mark of the capture above
+  if (!MATCH_MARK(rawWidth(results, offset), MITSUBISHI_BIT_MARK)) {
     return ERR;
   }
   offset++;
   while (offset + 1 < irparams.rawlen) {
-    if (MATCH_MARK(results->rawbuf[offset], MITSUBISHI_ONE_MARK)) {
+    if (MATCH_SPACE(rawWidth(results, offset), MITSUBISHI_ONE_SPACE)) {
       data = (data << 1) | 1;
     } 
-    else if (MATCH_MARK(results->rawbuf[offset], MITSUBISHI_ZERO_MARK)) {
+    else if (MATCH_SPACE(rawWidth(results, offset), MITSUBISHI_ZERO_SPACE)) {
       data <<= 1;
     } 
     else {
-      // Serial.println("A"); Serial.println(offset); Serial.println(results->rawbuf[offset]);
+      // Serial.println("A"); Serial.println(offset); Serial.println(rawWidth(results, offset));
       return ERR;
     }
     offset++;
-    if (!MATCH_SPACE(results->rawbuf[offset], MITSUBISHI_HDR_SPACE)) {
-      // Serial.println("B"); Serial.println(offset); Serial.println(results->rawbuf[offset]);
+    if (!MATCH_MARK(rawWidth(results, offset), MITSUBISHI_BIT_MARK)) {
+      // Serial.println("B"); Serial.println(offset); Serial.println(rawWidth(results, offset));
       break;
     }
     offset++;
@@ -731,9 +1063,9 @@ int IRrecv::getRClevel(decode_results *results, int *offset, int *used, int t1)
     // After end of recorded buffer, assume SPACE.
     return SPACE;
   }
-  int width = results->rawbuf[*offset];
+  int width = rawWidth(results, *offset);
   int val = ((*offset) % 2) ? MARK : SPACE;
-  int correction = (val == MARK) ? MARK_EXCESS : - MARK_EXCESS;
+  int correction = (val == MARK) ? RECV_MARK_EXCESS : - RECV_MARK_EXCESS;
 
   int avail;
   if (MATCH(width, t1 + correction)) {
@@ -806,11 +1138,11 @@ long IRrecv::decodeRC6(decode_results *results) {
   }
   int offset = 1; // Skip first space
   // Initial mark
-  if (!MATCH_MARK(results->rawbuf[offset], RC6_HDR_MARK)) {
+  if (!MATCH_MARK(rawWidth(results, offset), RC6_HDR_MARK)) {
     return ERR;
   }
   offset++;
-  if (!MATCH_SPACE(results->rawbuf[offset], RC6_HDR_SPACE)) {
+  if (!MATCH_SPACE(rawWidth(results, offset), RC6_HDR_SPACE)) {
     return ERR;
   }
   offset++;
@@ -854,23 +1186,23 @@ long IRrecv::decodePanasonic(decode_results *results) {
     unsigned long long data = 0;
     int offset = 1;
     
-    if (!MATCH_MARK(results->rawbuf[offset], PANASONIC_HDR_MARK)) {
+    if (!MATCH_MARK(rawWidth(results, offset), PANASONIC_HDR_MARK)) {
         return ERR;
     }
     offset++;
-    if (!MATCH_MARK(results->rawbuf[offset], PANASONIC_HDR_SPACE)) {
+    if (!MATCH_MARK(rawWidth(results, offset), PANASONIC_HDR_SPACE)) {
         return ERR;
     }
     offset++;
     
     // decode address
     for (int i = 0; i < PANASONIC_BITS; i++) {
-        if (!MATCH_MARK(results->rawbuf[offset++], PANASONIC_BIT_MARK)) {
+        if (!MATCH_MARK(rawWidth(results, offset++), PANASONIC_BIT_MARK)) {
             return ERR;
         }
-        if (MATCH_SPACE(results->rawbuf[offset],PANASONIC_ONE_SPACE)) {
+        if (MATCH_SPACE(rawWidth(results, offset),PANASONIC_ONE_SPACE)) {
             data = (data << 1) | 1;
-        } else if (MATCH_SPACE(results->rawbuf[offset],PANASONIC_ZERO_SPACE)) {
+        } else if (MATCH_SPACE(rawWidth(results, offset),PANASONIC_ZERO_SPACE)) {
             data <<= 1;
         } else {
             return ERR;
@@ -889,7 +1221,7 @@ long IRrecv::decodeLG(decode_results *results) {
     int offset = 1; // Skip first space
   
     // Initial mark
-    if (!MATCH_MARK(results->rawbuf[offset], LG_HDR_MARK)) {
+    if (!MATCH_MARK(rawWidth(results, offset), LG_HDR_MARK)) {
         return ERR;
     }
     offset++; 
@@ -897,19 +1229,19 @@ long IRrecv::decodeLG(decode_results *results) {
         return ERR;
     }
     // Initial space 
-    if (!MATCH_SPACE(results->rawbuf[offset], LG_HDR_SPACE)) {
+    if (!MATCH_SPACE(rawWidth(results, offset), LG_HDR_SPACE)) {
         return ERR;
     }
     offset++;
     for (int i = 0; i < LG_BITS; i++) {
-        if (!MATCH_MARK(results->rawbuf[offset], LG_BIT_MARK)) {
+        if (!MATCH_MARK(rawWidth(results, offset), LG_BIT_MARK)) {
             return ERR;
         }
         offset++;
-        if (MATCH_SPACE(results->rawbuf[offset], LG_ONE_SPACE)) {
+        if (MATCH_SPACE(rawWidth(results, offset), LG_ONE_SPACE)) {
             data = (data << 1) | 1;
         } 
-        else if (MATCH_SPACE(results->rawbuf[offset], LG_ZERO_SPACE)) {
+        else if (MATCH_SPACE(rawWidth(results, offset), LG_ZERO_SPACE)) {
             data <<= 1;
         } 
         else {
@@ -918,7 +1250,7 @@ long IRrecv::decodeLG(decode_results *results) {
         offset++;
     }
     //Stop bit
-    if (!MATCH_MARK(results->rawbuf[offset], LG_BIT_MARK)){
+    if (!MATCH_MARK(rawWidth(results, offset), LG_BIT_MARK)){
         return ERR;
     }
     // Success
@@ -934,35 +1266,36 @@ long IRrecv::decodeJVC(decode_results *results) {
     int offset = 1; // Skip first space
     // Check for repeat
     if (irparams.rawlen - 1 == 33 &&
-        MATCH_MARK(results->rawbuf[offset], JVC_BIT_MARK) &&
-        MATCH_MARK(results->rawbuf[irparams.rawlen-1], JVC_BIT_MARK)) {
+        MATCH_MARK(rawWidth(results, offset), JVC_BIT_MARK) &&
+        MATCH_MARK(rawWidth(results, irparams.rawlen-1), JVC_BIT_MARK)) {
         results->bits = 0;
         results->value = REPEAT;
         results->decode_type = JVC;
         return DECODED;
     } 
     // Initial mark
-    if (!MATCH_MARK(results->rawbuf[offset], JVC_HDR_MARK)) {
+    if (!MATCH_MARK(rawWidth(results, offset), JVC_HDR_MARK)) {
         return ERR;
     }
     offset++; 
-    if (irparams.rawlen < 2 * JVC_BITS + 1 ) {
+    // Header, the bits and the stop bit mark; a shorter frame would read past rawlen
+    if (irparams.rawlen < 2 * JVC_BITS + 4 ) {
         return ERR;
     }
     // Initial space 
-    if (!MATCH_SPACE(results->rawbuf[offset], JVC_HDR_SPACE)) {
+    if (!MATCH_SPACE(rawWidth(results, offset), JVC_HDR_SPACE)) {
         return ERR;
     }
     offset++;
     for (int i = 0; i < JVC_BITS; i++) {
-        if (!MATCH_MARK(results->rawbuf[offset], JVC_BIT_MARK)) {
+        if (!MATCH_MARK(rawWidth(results, offset), JVC_BIT_MARK)) {
             return ERR;
         }
         offset++;
-        if (MATCH_SPACE(results->rawbuf[offset], JVC_ONE_SPACE)) {
+        if (MATCH_SPACE(rawWidth(results, offset), JVC_ONE_SPACE)) {
             data = (data << 1) | 1;
         } 
-        else if (MATCH_SPACE(results->rawbuf[offset], JVC_ZERO_SPACE)) {
+        else if (MATCH_SPACE(rawWidth(results, offset), JVC_ZERO_SPACE)) {
             data <<= 1;
         } 
         else {
@@ -971,7 +1304,7 @@ long IRrecv::decodeJVC(decode_results *results) {
         offset++;
     }
     //Stop bit
-    if (!MATCH_MARK(results->rawbuf[offset], JVC_BIT_MARK)){
+    if (!MATCH_MARK(rawWidth(results, offset), JVC_BIT_MARK)){
         return ERR;
     }
     // Success
@@ -986,14 +1319,14 @@ long IRrecv::decodeSAMSUNG(decode_results *results) {
   long data = 0;
   int offset = 1; // Skip first space
   // Initial mark
-  if (!MATCH_MARK(results->rawbuf[offset], SAMSUNG_HDR_MARK)) {
+  if (!MATCH_MARK(rawWidth(results, offset), SAMSUNG_HDR_MARK)) {
     return ERR;
   }
   offset++;
   // Check for repeat
   if (irparams.rawlen == 4 &&
-    MATCH_SPACE(results->rawbuf[offset], SAMSUNG_RPT_SPACE) &&
-    MATCH_MARK(results->rawbuf[offset+1], SAMSUNG_BIT_MARK)) {
+    MATCH_SPACE(rawWidth(results, offset), SAMSUNG_RPT_SPACE) &&
+    MATCH_MARK(rawWidth(results, offset+1), SAMSUNG_BIT_MARK)) {
     results->bits = 0;
     results->value = REPEAT;
     results->decode_type = SAMSUNG;
@@ -1003,19 +1336,19 @@ long IRrecv::decodeSAMSUNG(decode_results *results) {
     return ERR;
   }
   // Initial space  
-  if (!MATCH_SPACE(results->rawbuf[offset], SAMSUNG_HDR_SPACE)) {
+  if (!MATCH_SPACE(rawWidth(results, offset), SAMSUNG_HDR_SPACE)) {
     return ERR;
   }
   offset++;
   for (int i = 0; i < SAMSUNG_BITS; i++) {
-    if (!MATCH_MARK(results->rawbuf[offset], SAMSUNG_BIT_MARK)) {
+    if (!MATCH_MARK(rawWidth(results, offset), SAMSUNG_BIT_MARK)) {
       return ERR;
     }
     offset++;
-    if (MATCH_SPACE(results->rawbuf[offset], SAMSUNG_ONE_SPACE)) {
+    if (MATCH_SPACE(rawWidth(results, offset), SAMSUNG_ONE_SPACE)) {
       data = (data << 1) | 1;
     } 
-    else if (MATCH_SPACE(results->rawbuf[offset], SAMSUNG_ZERO_SPACE)) {
+    else if (MATCH_SPACE(rawWidth(results, offset), SAMSUNG_ZERO_SPACE)) {
       data <<= 1;
     } 
     else {
@@ -1046,23 +1379,10 @@ long IRrecv::decodeSAMSUNG(decode_results *results) {
 
 // Compare two tick values, returning 0 if newval is shorter,
 // 1 if newval is equal, and 2 if newval is longer
-// Use a tolerance of 20%
 int IRrecv::compare(unsigned int oldval, unsigned int newval) {
-  if (newval < oldval * .8) {
-    return 0;
-  } 
-  else if (oldval < newval * .8) {
-    return 2;
-  } 
-  else {
-    return 1;
-  }
+  return compareTicks(oldval, newval);
 }
 
-// Use FNV hash algorithm: http://isthe.com/chongo/tech/comp/fnv/#FNV-param
-#define FNV_PRIME_32 16777619
-#define FNV_BASIS_32 2166136261
-
 /* Converts the raw code values into a 32-bit hash code.
  * Hopefully this code is unique for each button.
  * This isn't a "real" decoding, just an arbitrary value.
@@ -1072,13 +1392,18 @@ long IRrecv::decodeHash(decode_results *results) {
   if (results->rawlen < 6) {
     return ERR;
   }
+#ifdef IR_HASH_IN_ISR
+  // Already hashed while receiving
+  results->value = irparams.hash;
+#else
   long hash = FNV_BASIS_32;
   for (int i = 1; i+2 < results->rawlen; i++) {
-    int value =  compare(results->rawbuf[i], results->rawbuf[i+2]);
+    int value =  compare(rawWidth(results, i), rawWidth(results, i+2));
     // Add value into the hash
     hash = (hash * FNV_PRIME_32) ^ value;
   }
   results->value = hash;
+#endif
   results->bits = 32;
   results->decode_type = UNKNOWN;
   return DECODED;
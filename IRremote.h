@@ -19,10 +19,48 @@
 // The following are compile-time library options.
 // If you change them, recompile the library.
 // If DEBUG is defined, a lot of debugging output will be printed during decoding.
-// TEST must be defined for the IRtest unittests to work.  It will make some
-// methods virtual, which will be slightly slower, which is why it is optional.
+// TEST must be defined for the IRtest unittests and tools/irtest.cpp to work.
+// It will make some methods virtual, which will be slightly slower, which is why
+// it is optional.
 // #define DEBUG
 // #define TEST
+// If IR_HASH_IN_ISR is defined, the decodeHash value is computed by the interrupt
+// handler while the code is received, so unknown codes need no post-processing.
+// If IR_HASH_ONLY is defined, rawbuf is not stored at all and decode() only returns
+// hashes. This saves 2 * RAWBUF bytes of RAM when no protocol decoder is needed.
+// #define IR_HASH_IN_ISR
+// #define IR_HASH_ONLY
+// If IR_COMPACT_RAWBUF is defined, rawbuf stores one byte per entry instead of two.
+// Widths of 255 ticks or more are marked with RAWBUF_ESCAPE and kept aside in a
+// small table of RAWLONG entries. This saves about RAWBUF - 3 * RAWLONG bytes of RAM.
+// #define IR_COMPACT_RAWBUF
+// If IR_CALIBRATE is defined, the receiver sensor lag (MARK_EXCESS) and the
+// clock skew are learned from the header of each NEC frame that decodes, and
+// used for all later matching. Helps with RC clocks and unregulated supplies.
+// On unless IR_FIXED_TIMING is defined, which tools/irtest.cpp uses to compare.
+#ifndef IR_FIXED_TIMING
+#define IR_CALIBRATE
+#endif
+// If IR_SEND_ASYNC is defined, a frame can be sent without blocking: between
+// beginAsync() and sendAsync() the send* functions only build a schedule, which
+// the timer interrupt then plays while loop() keeps running. Receiving is
+// restarted when the frame ends. Costs 2 * SENDBUF bytes of RAM.
+// #define IR_SEND_ASYNC
+// If IR_FAST_PIN_READ is defined, the interrupt handler reads the receiver pin
+// through its port register and bit mask, found once by enableIRIn(), instead of
+// calling digitalRead() 20000 times per second.
+#define IR_FAST_PIN_READ
+
+#if defined(IR_HASH_ONLY) && !defined(IR_HASH_IN_ISR)
+#define IR_HASH_IN_ISR
+#endif
+
+// Type of one rawbuf entry
+#ifdef IR_COMPACT_RAWBUF
+typedef unsigned char rawbuf_t;
+#else
+typedef unsigned int rawbuf_t;
+#endif
 
 // Results returned from the decoder
 class decode_results {
@@ -34,7 +72,7 @@ public:
   };
   unsigned long value; // Decoded value
   int bits; // Number of bits in decoded value
-  volatile unsigned int *rawbuf; // Raw intervals in .5 us ticks
+  volatile rawbuf_t *rawbuf; // Raw intervals in .5 us ticks, NULL with IR_HASH_ONLY
   int rawlen; // Number of records in rawbuf.
 };
 
@@ -64,7 +102,13 @@ public:
   void blink13(int blinkflag);
   int decode(decode_results *results);
   void enableIRIn();
+  void enableIRInMark(unsigned int markTicks);
+  void disableIRIn();
+  int isIdle();
   void resume();
+#ifdef TEST
+  void replay(const unsigned int *buf, int len);
+#endif
 private:
   // These are called by decode
   int getRClevel(decode_results *results, int *offset, int *used, int t1);
@@ -80,6 +124,9 @@ private:
   long decodeSAMSUNG(decode_results *results);
   long decodeHash(decode_results *results);
   int compare(unsigned int oldval, unsigned int newval);
+#ifdef IR_CALIBRATE
+  void calibrateNEC(decode_results *results);
+#endif
 
 } 
 ;
@@ -110,9 +157,15 @@ public:
   void sendJVC(unsigned long data, int nbits, int repeat); // *Note instead of sending the REPEAT constant if you want the JVC repeat signal sent, send the original code value and change the repeat argument from 0 to 1. JVC protocol repeats by skipping the header NOT by sending a separate code value like NEC does.
   // private:
   void sendSAMSUNG(unsigned long data, int nbits);
-  void enableIROut(int khz);
+  VIRTUAL void enableIROut(int khz);
   VIRTUAL void mark(int usec);
   VIRTUAL void space(int usec);
+#ifdef IR_SEND_ASYNC
+  // sendSharpRaw() can't be sent this way as it waits between its repeats
+  void beginAsync();
+  int sendAsync();
+  int busy();
+#endif
 }
 ;
 
@@ -120,9 +173,35 @@ public:
 
 #define USECPERTICK 50  // microseconds per clock interrupt tick
 #define RAWBUF 100 // Length of raw duration buffer
+#define RAWLONG 4  // Length of long duration table with IR_COMPACT_RAWBUF
+#define SENDBUF 68 // Length of the IR_SEND_ASYNC schedule, enough for 32 bit NEC
 
 // Marks tend to be 100us too long, and spaces 100us too short
 // when received due to sensor lag.
 #define MARK_EXCESS 100
 
+#ifdef TEST
+// Records what IRsend would transmit the way the receiver ISR would see it,
+// including sensor lag and optional timing jitter, so decoders can be checked
+// with IRrecv::replay() without any hardware.
+class IRsendRecorder : public IRsend
+{
+public:
+  IRsendRecorder() : seed(1) { reset(0); }
+  void reset(int jitterPercent);
+  void enableIROut(int /*khz*/) {}
+  void mark(int usec);
+  void space(int usec);
+  unsigned int rawbuf[RAWBUF]; // Recorded intervals in 50 us ticks, first one is the gap
+  int rawlen; // Number of records in rawbuf
+private:
+  void flush();
+  unsigned long run; // Length of the current mark or space in us
+  int runIsMark;
+  int jitter;
+  unsigned long seed;
+}
+;
+#endif
+
 #endif
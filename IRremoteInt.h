@@ -120,9 +120,11 @@
 // 14200 7 41 7 42 7 42 7 17 7 17 7 18 7 41 7 18 7 17 7 17 7 18 7 41 8 17 7 17 7 18 7 17 7 
 
 // #define MITSUBISHI_HDR_MARK	250  // seen range 3500
-#define MITSUBISHI_HDR_SPACE	350 //  7*50+100
-#define MITSUBISHI_ONE_MARK	1950 // 41*50-100
-#define MITSUBISHI_ZERO_MARK  750 // 17*50-100
+// Marks are all alike and the space after each one gives the bit; received marks
+// are MARK_EXCESS too long and spaces MARK_EXCESS too short
+#define MITSUBISHI_BIT_MARK	250 //  7*50-100
+#define MITSUBISHI_ONE_SPACE	2150 // 41*50+100
+#define MITSUBISHI_ZERO_SPACE	950 // 17*50+100
 // #define MITSUBISHI_DOUBLE_SPACE_USECS  800  // usually ssee 713 - not using ticks as get number wrapround
 // #define MITSUBISHI_RPT_LENGTH 45000
 
@@ -191,6 +193,22 @@
 #define TICKS_LOW(us) (int) (((us)*LTOL/USECPERTICK))
 #define TICKS_HIGH(us) (int) (((us)*UTOL/USECPERTICK + 1))
 
+// IR_CALIBRATE limits; samples outside are treated as bad frames
+#define CAL_SKEW_ONE 256     // clock skew is measured/expected in 1/256 units
+#define CAL_SKEW_MIN 205     // -20%
+#define CAL_SKEW_MAX 307     // +20%
+#define CAL_EXCESS_MIN 0
+#define CAL_EXCESS_MAX 300
+#define CAL_WEIGHT 8         // each frame moves the estimates by 1/8
+
+// Use FNV hash algorithm: http://isthe.com/chongo/tech/comp/fnv/#FNV-param
+#define FNV_PRIME_32 16777619
+#define FNV_BASIS_32 2166136261
+
+// IR_COMPACT_RAWBUF marker for widths which don't fit in a byte
+#define RAWBUF_ESCAPE 0xFF
+#define RAWLONG_OVERFLOW 0xFFFF
+
 // receiver states
 #define STATE_IDLE     2
 #define STATE_MARK     3
@@ -200,17 +218,49 @@
 // information for the interrupt handler
 typedef struct {
   uint8_t recvpin;           // pin for IR data from detector
+#ifdef IR_FAST_PIN_READ
+  volatile uint8_t *recvreg; // input register of recvpin
+  uint8_t recvmask;          // bit of recvpin in recvreg
+#endif
   uint8_t rcvstate;          // state machine
   uint8_t blinkflag;         // TRUE to enable blinking of pin 13 on IR processing
   unsigned int timer;     // state timer, counts 50uS ticks.
-  unsigned int rawbuf[RAWBUF]; // raw data
+#ifndef IR_HASH_ONLY
+  rawbuf_t rawbuf[RAWBUF]; // raw data
+#endif
   uint8_t rawlen;         // counter of entries in rawbuf
+#ifdef IR_COMPACT_RAWBUF
+  unsigned int rawlong[RAWLONG]; // widths which didn't fit in rawbuf
+  uint8_t rawlongidx[RAWLONG];   // rawbuf index of each rawlong entry
+  uint8_t rawlongcount;          // counter of entries in rawlong
+#endif
+#ifdef IR_HASH_IN_ISR
+  unsigned int hashprev[2]; // last mark and last space, indexed by entry parity
+  unsigned long hash;     // FNV hash of the entries recorded so far
+#endif
 } 
 irparams_t;
 
 // Defined in IRremote.cpp
 extern volatile irparams_t irparams;
 
+#ifdef IR_SEND_ASYNC
+// information for sending from the interrupt handler
+typedef struct {
+  uint8_t compiling;         // TRUE while mark() and space() fill the schedule
+  uint8_t active;            // TRUE while the interrupt handler is sending
+  uint8_t overflow;          // TRUE if the last frame didn't fit in the schedule
+  uint8_t khz;               // carrier frequency of the schedule
+  uint8_t len;               // number of entries in schedule
+  uint8_t index;             // entry being sent; even entries are MARK
+  unsigned int remaining;    // interrupts left for the current entry
+  unsigned int schedule[SENDBUF]; // us while compiling, then interrupts
+}
+irsendparams_t;
+
+extern volatile irsendparams_t irsendparams;
+#endif
+
 // IR detector output is active low
 #define MARK  0
 #define SPACE 1
@@ -239,6 +289,7 @@ extern volatile irparams_t irparams;
 #define TIMER_ENABLE_INTR    (TIMSK2 = _BV(OCIE2A))
 #define TIMER_DISABLE_INTR   (TIMSK2 = 0)
 #define TIMER_INTR_NAME      TIMER2_COMPA_vect
+#define TIMER_INTR_PER_CARRIER 1  /* interrupts per carrier period while sending */
 #define TIMER_CONFIG_KHZ(val) ({ \
   const uint8_t pwmval = SYSCLOCK / 2000 / (val); \
   TCCR2A = _BV(WGM20); \
@@ -254,6 +305,7 @@ extern volatile irparams_t irparams;
   OCR2A = TIMER_COUNT_TOP; \
   TCNT2 = 0; \
 })
+#define TIMER_LATENCY_CYCLES() (TCNT2)
 #else
 #define TIMER_CONFIG_NORMAL() ({ \
   TCCR2A = _BV(WGM21); \
@@ -261,6 +313,7 @@ extern volatile irparams_t irparams;
   OCR2A = TIMER_COUNT_TOP / 8; \
   TCNT2 = 0; \
 })
+#define TIMER_LATENCY_CYCLES() (TCNT2 * 8) // counter restarts from 0 at the match
 #endif
 #if defined(CORE_OC2B_PIN)
 #define TIMER_PWM_PIN        CORE_OC2B_PIN  /* Teensy */
@@ -286,6 +339,7 @@ extern volatile irparams_t irparams;
   #define TIMER_DISABLE_INTR   (TIMSK1 = 0)
 #endif
 #define TIMER_INTR_NAME      TIMER1_COMPA_vect
+#define TIMER_INTR_PER_CARRIER 2  /* interrupts per carrier period while sending */
 #define TIMER_CONFIG_KHZ(val) ({ \
   const uint16_t pwmval = SYSCLOCK / 2000 / (val); \
   TCCR1A = _BV(WGM11); \
@@ -318,6 +372,7 @@ extern volatile irparams_t irparams;
 #define TIMER_ENABLE_INTR    (TIMSK3 = _BV(OCIE3A))
 #define TIMER_DISABLE_INTR   (TIMSK3 = 0)
 #define TIMER_INTR_NAME      TIMER3_COMPA_vect
+#define TIMER_INTR_PER_CARRIER 2  /* interrupts per carrier period while sending */
 #define TIMER_CONFIG_KHZ(val) ({ \
   const uint16_t pwmval = SYSCLOCK / 2000 / (val); \
   TCCR3A = _BV(WGM31); \
@@ -348,6 +403,7 @@ extern volatile irparams_t irparams;
 #define TIMER_ENABLE_INTR    (TIMSK4 = _BV(TOIE4))
 #define TIMER_DISABLE_INTR   (TIMSK4 = 0)
 #define TIMER_INTR_NAME      TIMER4_OVF_vect
+#define TIMER_INTR_PER_CARRIER 1  /* interrupts per carrier period while sending */
 #define TIMER_CONFIG_KHZ(val) ({ \
   const uint16_t pwmval = SYSCLOCK / 2000 / (val); \
   TCCR4A = (1<<PWM4A); \
@@ -388,6 +444,7 @@ extern volatile irparams_t irparams;
 #define TIMER_ENABLE_INTR    (TIMSK4 = _BV(OCIE4A))
 #define TIMER_DISABLE_INTR   (TIMSK4 = 0)
 #define TIMER_INTR_NAME      TIMER4_COMPA_vect
+#define TIMER_INTR_PER_CARRIER 2  /* interrupts per carrier period while sending */
 #define TIMER_CONFIG_KHZ(val) ({ \
   const uint16_t pwmval = SYSCLOCK / 2000 / (val); \
   TCCR4A = _BV(WGM41); \
@@ -418,6 +475,7 @@ extern volatile irparams_t irparams;
 #define TIMER_ENABLE_INTR    (TIMSK5 = _BV(OCIE5A))
 #define TIMER_DISABLE_INTR   (TIMSK5 = 0)
 #define TIMER_INTR_NAME      TIMER5_COMPA_vect
+#define TIMER_INTR_PER_CARRIER 2  /* interrupts per carrier period while sending */
 #define TIMER_CONFIG_KHZ(val) ({ \
   const uint16_t pwmval = SYSCLOCK / 2000 / (val); \
   TCCR5A = _BV(WGM51); \
@@ -492,6 +550,10 @@ extern volatile irparams_t irparams;
 #error "Internal code configuration error, no known IR_USE_TIMER# defined\n"
 #endif
 
+#if defined(IR_SEND_ASYNC) && !defined(TIMER_INTR_PER_CARRIER)
+#error "IR_SEND_ASYNC is not supported with this timer\n"
+#endif
+
 
 // defines for blinking the LED
 #if defined(CORE_LED0_PIN)
@@ -22,21 +22,21 @@
  *        Current Pins Usage
  *  D0  --- Reserved for Serial Rx 
  *  D1  --- Reserved for Serial Tx 
- *  D2  --- Reserved for External Interrupts    (Wakeup from Sleep or something)
- *  D3  --- Used by Motor A Enable
+ *  D2  --- Used by Insomnia, wakes the Robot(PCINT18)
+ *  D3  --- Used by Motor B Phase  (OC2B, no PWM: Timer2 runs the IR Receiver)
  *  D4  --- Used by Motor A Phase
- *  D5  --- Used by Motor B Enable
- *  D6  --- Used by Motor B Phase
+ *  D5  --- Used by Motor B Enable  (OC0B, Timer0 PWM)
+ *  D6  --- Used by Motor A Enable  (OC0A, Timer0 PWM)
  *  D7  --- Used by DRV8834 Sleep Pin
- *  D8  --- 
- *  D9  --- Used to read IR Receiver
- *  D10 --- Reserved for SPI SS(CS) (possible E-Paper?)
- *  D11 --- Reserved for SPI MOSI   (an E-Paper would be nice)
- *  D12 --- Reserved for SPI MISO   (like, you can draw emotions)
- *  D13 --- Reserved for SPI SCK    (on the E-Paper)
+ *  D8  --- Used by E-Paper DC
+ *  D9  --- Used to read IR Receiver, wakes the Robot(PCINT1)
+ *  D10 --- Used by E-Paper CS
+ *  D11 --- Used by E-Paper DIN(SPI MOSI)
+ *  D12 --- Reserved for SPI MISO   (E-Paper doesn't talk back)
+ *  D13 --- Used by E-Paper CLK(SPI SCK)
  *  A0  --- Used to power IR Receiver
- *  A1  ---
- *  A2  ---
+ *  A1  --- Used by E-Paper Reset
+ *  A2  --- Used by E-Paper Busy
  *  A3  --- Used to read Battery Level
  *  A4  --- Reserved for I2C SDA (the laser will be here)
  *  A5  --- Reserved for I2C SCL (and maybe others, who knows)
@@ -51,6 +51,8 @@
  * - Motors need some amperage, doesn't work powered by TTL Serial Programmer, must use a LiPo Battery or similar.
  * - In documentation it is mentioned that when waking up from Sleep the Driver might take up to 1ms to become functional.
  * - Consume aprox 2.5mA when Idle, according to some measurements.
+ * - It sleeps after DRV8834_IDLE_SLEEP_TIME without motors; Motor_EnableMotor() wakes it and Motor_Task() starts the motors 1ms later.
+ *      tools/energysim.cpp gives about 200J a day saved, 4%, against staying awake through the waits of the day.
  */
 
 /* ----- LiPo Battery -----
@@ -64,6 +66,18 @@
 /* ----- Energy Management -----
  * - Voltage measured with Voltage Divider. R1 == R2. Resistence used: 120 Ohm probably 1W. 2W would be better.
  * - Pin Read Voltage drops by 0.05 V when Motors are running. Take in consideration for threshold. 
+ * - The ADC reference is AVCC, which moves with the battery. VCC is measured first against the internal 1.1V bandgap
+ *      and the divider reading is scaled with it, all in integer math.
+ * - The bandgap needs 2ms to settle and two conversions, so VCC is kept for a second and read again after every sleep
+ *      and every motor change. The battery itself is read once a second, and 20ms after a motor step to measure it.
+ * - The bandgap is 1.0 - 1.2V depending on the chip. Calibrate once per board: set BATTERY_CALIBRATE_VCC to the
+ *      multimeter reading of VCC in mV, flash, then set it back to 0. It is kept in EEPROM.
+ * - With the battery wired straight to VCC(regulator bypassed) the divider can go, it draws more than the MCU:
+ *      set BATTERY_MEASURE to BATTERY_MEASURE_VCC and the battery voltage is VCC.
+ * - Sleep and mood follow the state of charge in percent, not the voltage. The motors pull the voltage down by their
+ *      current times the internal resistance of the cell, so the voltage under load would make the Robot sleep too early.
+ * - Internal resistance is measured on the voltage step when the motors start or stop. The charge is counted from the
+ *      estimated current and pulled towards the OCV table(load compensated voltage), slowly while driving.
  * -- Measurements ::
  *  == No Modifications; no Loop Code ==
  *      - Startup : jumps to ~5mA, fluctuates to 4 and 6 a little bit, then it jumps to Idle current of 7.03mA
@@ -90,6 +104,94 @@
  * - In Autonomous State it will walk autonomously and avoid obstacles with sensors.
  * - If IR is not resumed after reading it it will be stuck with the same value forever. Resume let it read the next command.
  * - Consume aprox 0.4mA when Idle, according to some measurements.
+ * - Wake on IR: with ROBOT_SLEEP_LISTEN the receiver stays on while sleeping and its first edge wakes the Robot through
+ *      a pin change interrupt(INT0/INT1 only wake from power down on a low level, and D3 is Motor B Phase).
+ *      The 2ms crystal start-up eats the start of the 9ms NEC header, the receiver is restarted as if it saw it.
+ *      Costs the 0.4mA of the receiver: 1.58mA sleeping becomes about 2mA, 25% more or 10mAh a day.
+ *      Without it the Robot sleeps deaf for up to 5 minutes of hibernation.
+ * - Woken by the remote the Robot stays up for a minute even on a low battery, then hibernates again.
+ * - Remote can be changed without reflashing: press Learn(IR_VALUE_LEARN by default), the builtin LED turns on,
+ *      then press the new buttons for Forward, Backward, Left, Right, Mode and Learn in this order.
+ *      The keymap is kept in EEPROM and only the changed bytes are written.
+ */
+
+/* ----- IR Beacons -----
+ * - Charging spots, sunny spots and other EcoBots can send NEC frames with the reserved address 0xEC.
+ * - Data byte of the frame is the kind of beacon(upper 3 bits) and its ID(lower 5 bits).
+ * - In Autonomous State the robot homes on chargers and sunny spots: it rotates in steps, counts the frames heard on
+ *      each step, turns to the step which heard most, drives for a while and scans again.
+ * - The receiver is directional enough for this because of its plastic lens, nothing else is needed.
+ * - Broadcasting our own beacon needs an IR LED on the IR timer PWM pin, which is D3 for Timer2.
+ *      D3 is Motor B Phase now, so it must be moved before IR_SEND_ASYNC is enabled; the build stops until then.
+ */
+
+/* ----- E-Paper Emotions -----
+ * - 1.54" 200x200 black and white e-paper with SSD1681 controller(Waveshare 1.54" V2 or GDEH0154D67).
+ * - Shows the mood: happy, calm or tired from the battery level, sleeping when the Robot sleeps. And A or M for the mode.
+ * - There is no framebuffer(would be 5000 bytes of 2048): rows are composed from PROGMEM sprites while they are sent.
+ * - Refreshes only when the mood or the mode change. Partial refresh, with a full one every 20 against ghosting.
+ * - Only the dirty rectangles are sent, and a refresh waits 10s after the last one and until the energy budget
+ *      (40uJ per second, about 24 partial refreshes an hour) has room. Refreshes per hour and energy go on telemetry;
+ *      the refresh time ends on the BUSY falling edge(PCINT10), not when the loop polls it.
+ * - Panel is in deep sleep between refreshes, the image stays without power.
+ * - Build Display.cpp on a PC with DISPLAY_HOST to get every refresh as a PBM image. tools/displaysim.cpp checks 30 partial
+ *      refreshes against full renders.
+ * - BUSY stuck high for 100ms after a reset or 3s after a refresh means no panel, the Robot runs on without one.
+ *      Display_Wait() kicks the watchdog(4s) while it waits, a refresh may still be running before the wanted one.
+ */
+
+/* ----- Event Log -----
+ * - Boots, watchdog resets, sleeps, battery threshold crossings and mode switches are kept in the upper half of the EEPROM.
+ * - Events wait in RAM and are written together before sleeping, when 4 are queued or every minute.
+ * - The log is circular and every slot is written once per lap, 100000 writes per byte go a long way like this.
+ * - Read it with an ISP programmer and tools/eventlog.py, the Pro Mini bootloader can't read EEPROM.
+ * - Hibernation ends with battery ok once charged; woken by the remote or Insomnia on a low battery it ends with
+ *      wake by IR or wake insomnia instead.
+ */
+
+/* ----- Supervisor -----
+ * - The watchdog resets the Robot when the loop hangs for 4 seconds.
+ * - Resets are counted by cause(power on, reset button, brownout, watchdog) in EEPROM and logged.
+ * - After 3 watchdog or brownout resets in a row the Robot sleeps for an hour with the Motor Driver asleep, then tries again.
+ *      A minute of running, a power on or the reset button forget the faults.
+ * - Sleeping uses BOD_OFF to save power; the brown-out detector is back on when awake, when the motors pull the battery down.
+ * - Needs Optiboot 8 or later, burn it with an ISP programmer(e.g. MiniCore, ATmega328P, 8MHz external clock).
+ *      The ATmegaBOOT the Pro Mini ships with leaves the watchdog running with its shortest timeout after a watchdog
+ *      reset and resets over and over. Optiboot stops it and passes the reset flags in r2, Supervisor_SaveResetFlags()
+ *      reads them from there. Optiboot before 8 reports the reset button as a watchdog reset, its timeout is one.
+ */
+
+/* ----- Energy Ledger -----
+ * - Energy.cpp keeps the millijoules spent by the board, the Motor Driver, each motor, the IR Receiver and the ADC.
+ * - Each state has a current taken from the measurements above, motors scale with their PWM duty.
+ * - MCU idle isn't measured yet, it is a datasheet guess. The e-paper is not in it, it reports its own refreshes.
+ * - A Dev Build sends one subsystem on telemetry every second. tools/energysim.cpp runs the ledger over a scripted day on a PC.
+ */
+
+/* ----- Clock Governor -----
+ * - After 2 seconds without motors or IR frames the CPU runs at 1MHz(CLKPR /8), about 1.8mA less than at 8MHz.
+ * - Timer prescalers are divided by 8 too, so millis(), delay() and the motor PWM are unchanged. The ADC prescaler keeps its clock.
+ * - The 50us tick of the IR Receiver is too fast at 1MHz, it is stopped; the first edge of a frame(PCINT1, D9) switches back to 8MHz.
+ * - Motors, beacons and sleeping switch back to 8MHz first. SPI to the e-paper and delayMicroseconds() are slower while at 1MHz.
+ * - A Dev Build always runs at 8MHz for Serial. tools/energysim.cpp gives about 144J a day saved, 2.9%, the motors take most of the rest.
+ */
+
+/* ----- Peripheral Power -----
+ * - Power.cpp stops the peripherals nobody holds in PRR: TWI always, SPI between e-paper batches, USART and Timer1 in production.
+ * - Timer0(millis, both motor PWMs), Timer2(IR Receiver, beacons) and the ADC are held while awake and stopped while sleeping.
+ * - DIDR0 turns off the digital inputs of A0, A1 and A3; A2 is the e-paper BUSY pin, the display holds it.
+ * - The pins of the Robot are one table in EcoBot.ino; Robot_Sleep() parks them and Robot_WakeUp() sets them up from it.
+ */
+
+/* ----- Cruise Speed -----
+ * - Once, with no calibration in EEPROM(address 52) and the battery above 30%, the Robot rotates in place at PWM duty 80 - 255.
+ * - Each step reads the battery at rest and under load; the sag gives the current, the PWM voltage less the winding loss the back-EMF.
+ * - Back-EMF per watt of the whole Robot stands in for distance per joule, there is no odometry. The best duty is kept.
+ * - Autonomous driving(beacon approach) uses it. CRUISE_MOTOR_MILLIOHMS is a guess until the motors are measured.
+ * - One ADC step of the divider is 6.4mV, about 32mA at 200mOhm. Each reading averages 64 samples over a few PWM periods with
+ *      one VCC for rest and load, and a sag below 20mV scores nothing. Only a sweep which scored is kept in EEPROM.
+ * - Both motor enables must be Timer0 PWM pins(D5, D6), otherwise there is no sweep and the Robot cruises at full duty.
+ *      Calibrations from before Motor A moved to D6 have the old magic and are swept again.
  */
 
 /* TODO: Don't be blind
@@ -117,6 +219,12 @@
  * - Each Motor has a ENABLE Pin and a PHASE Pin (xENBL and xPHASE).
  * - xPHASE is controlling the direction, while xENBL controlls the motor.
  * - xENBL can be used as PWM to controll the motor.
+ * - Drive_Set(linear, angular) takes Q8 velocities(256 is full speed) and gives each wheel its PWM and direction.
+ *      Motor A is the left wheel. Both wheels scale down together when one saturates; DRIVE_TRIM_A/B correct a faster motor.
+ * - A running wheel is never reversed straight away: Motor_Reverse() brakes it and Motor_Task() switches xPHASE and
+ *      powers it again DRV8834_BRAKE_TIME(50ms) later. Motor_SwitchDirection() keeps track of the direction of each motor.
+ * - Timed moves go on the Motion queue(drive, rotate, pause, brake; 8 steps), Motion_Task() runs them on millis() deadlines.
+ *      Each step may have a callback when it is done; beacon homing uses them for its DRV8834_WALK_TIME scan steps.
  */
 
 /* TODO: RotateRight(degree) and RotateLeft(degree) functions
@@ -128,5 +236,9 @@
  * - Motor Driver put into sleep mode by setting the SLEEP Pin to LOW.
  * - Every other unessential peripheral is powered down.
  * - Arduino will sleep and wake up from time to time to check Battery level.
+ * - Below 5% it hibernates and wakes up at 10%, so a little sun doesn't wake it every few seconds.
+ *      Hibernation sleeps 10s first and twice as long after every measurement, up to 5 minutes.
+ *      tools/hibernatesim.cpp runs an hour of it: 16 wakes instead of one every second.
+ *      Its wakes only measure the battery, the IR Receiver and the Motor Driver stay off.
  * */
 #endif /* NOTES_H */
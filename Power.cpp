@@ -0,0 +1,247 @@
+/***************************************************************************************
+ * Includes
+ **************************************************************************************/
+#include "Power.h"
+#include "Energy.h"
+
+#include <Arduino.h>
+#include <avr/pgmspace.h>
+
+/***************************************************************************************
+ * Macros
+ **************************************************************************************/
+#define POWER_DIGITAL_FIRST     POWER_DIGITAL_A0
+#define POWER_PERIPHERALS_USED  0x0FEFu     /* Bit 4 of PRR is reserved */
+
+/***************************************************************************************
+ * Variables
+ **************************************************************************************/
+static uint8_t powerHolders[POWER_PERIPHERAL_COUNT];
+static const powerPin_t *powerPins = 0;             /* PROGMEM table of Power_Init() */
+static uint8_t powerPinCount = 0u;
+
+/***************************************************************************************
+ * Function: Power_Switch()
+ ***************************************************************************************
+ * Description: Clock a peripheral or stop it.
+ * Parameters:
+ *  - peripheral[in]   :   POWER_* peripheral
+ *  - on[in]           :   1 to clock it, 0 to stop it
+ **************************************************************************************/
+static void Power_Switch(uint8_t peripheral, uint8_t on)
+{
+    if(POWER_DIGITAL_FIRST <= peripheral)
+    {
+        /* DIDR0 disables the buffer, set means off */
+        if(on)
+        {
+            DIDR0 &= ~_BV(peripheral - POWER_DIGITAL_FIRST);
+        }
+        else
+        {
+            DIDR0 |= _BV(peripheral - POWER_DIGITAL_FIRST);
+        }
+    }
+    else if(POWER_ADC == peripheral)
+    {
+        /* ADC is stopped disabled and enabled once it runs again */
+        if(on)
+        {
+            PRR &= ~_BV(PRADC);
+            ADCSRA |= _BV(ADEN);
+            Energy_SetState(ENERGY_ADC, ENERGY_ON);
+        }
+        else
+        {
+            ADCSRA &= ~_BV(ADEN);
+            PRR |= _BV(PRADC);
+            Energy_SetState(ENERGY_ADC, ENERGY_OFF);
+        }
+    }
+    else
+    {
+        if(on)
+        {
+            PRR &= ~_BV(peripheral);
+        }
+        else
+        {
+            PRR |= _BV(peripheral);
+        }
+    }
+}
+
+/***************************************************************************************
+ * Function: Power_Init()
+ ***************************************************************************************
+ * Description: Hold the peripherals of the awake Robot and stop everything nobody
+ *              holds. Holds taken before, like Serial, are kept.
+ * Parameters:
+ *  - pins[in]       :   PROGMEM table of the pins of the Robot
+ *  - pinCount[in]   :   Entries in the table
+ **************************************************************************************/
+void Power_Init(const powerPin_t *pins, uint8_t pinCount)
+{
+    powerPins = pins;
+    powerPinCount = pinCount;
+
+    for(uint8_t peripheral = 0u; peripheral < POWER_PERIPHERAL_COUNT; peripheral++)
+    {
+        if(POWER_ROBOT_PERIPHERALS & (1u << peripheral))
+        {
+            powerHolders[peripheral] |= POWER_HOLDER_ROBOT;
+        }
+        else
+        {
+            /* Do nothing */
+        }
+
+        if(POWER_PERIPHERALS_USED & (1u << peripheral))
+        {
+            Power_Switch(peripheral, (0u != powerHolders[peripheral]));
+        }
+        else
+        {
+            /* Do nothing */
+        }
+    }
+}
+
+/***************************************************************************************
+ * Function: Power_Hold()
+ ***************************************************************************************
+ * Description: A subsystem needs a peripheral, clock it if it was stopped.
+ * Parameters:
+ *  - peripheral[in]   :   POWER_* peripheral
+ *  - holder[in]       :   POWER_HOLDER_* of the subsystem
+ **************************************************************************************/
+void Power_Hold(uint8_t peripheral, uint8_t holder)
+{
+    if(0u == powerHolders[peripheral])
+    {
+        Power_Switch(peripheral, 1u);
+    }
+    else
+    {
+        /* Already clocked */
+    }
+    powerHolders[peripheral] |= holder;
+}
+
+/***************************************************************************************
+ * Function: Power_Release()
+ ***************************************************************************************
+ * Description: A subsystem is done with a peripheral, stop it if it was the last one.
+ * Parameters:
+ *  - peripheral[in]   :   POWER_* peripheral
+ *  - holder[in]       :   POWER_HOLDER_* of the subsystem
+ **************************************************************************************/
+void Power_Release(uint8_t peripheral, uint8_t holder)
+{
+    if(powerHolders[peripheral] == holder)
+    {
+        Power_Switch(peripheral, 0u);
+    }
+    else
+    {
+        /* Somebody else holds it, or it wasn't held */
+    }
+    powerHolders[peripheral] &= ~holder;
+}
+
+/***************************************************************************************
+ * Function: Power_IsOn()
+ ***************************************************************************************
+ * Return: 1 when somebody holds the peripheral, 0 otherwise
+ **************************************************************************************/
+uint8_t Power_IsOn(uint8_t peripheral)
+{
+    return (0u != powerHolders[peripheral]);
+}
+
+/***************************************************************************************
+ * Function: Power_Sleep()
+ ***************************************************************************************
+ * Description: Park the pins as low outputs, floating inputs draw current, and drop the
+ *              peripherals of the awake Robot. Call it before sleeping.
+ * Parameters:
+ *  - keepGroups[in]   :   POWER_GROUP_* of the pins which stay as they are
+ **************************************************************************************/
+void Power_Sleep(uint8_t keepGroups)
+{
+    powerPin_t pin;
+
+    for(uint8_t index = 0u; index < powerPinCount; index++)
+    {
+        memcpy_P(&pin, &powerPins[index], sizeof(pin));
+        if(0u == (pin.group & keepGroups))
+        {
+            pinMode(pin.pin, OUTPUT);
+            digitalWrite(pin.pin, LOW);
+        }
+        else
+        {
+            /* Do nothing */
+        }
+    }
+
+    for(uint8_t peripheral = 0u; peripheral < POWER_PERIPHERAL_COUNT; peripheral++)
+    {
+        if(POWER_ROBOT_PERIPHERALS & (1u << peripheral))
+        {
+            Power_Release(peripheral, POWER_HOLDER_ROBOT);
+        }
+        else
+        {
+            /* Do nothing */
+        }
+    }
+}
+
+/***************************************************************************************
+ * Function: Power_Resume()
+ ***************************************************************************************
+ * Description: Hold the peripherals of the awake Robot again after sleeping; the pins
+ *              stay parked until Power_WakeUp().
+ **************************************************************************************/
+void Power_Resume(void)
+{
+    for(uint8_t peripheral = 0u; peripheral < POWER_PERIPHERAL_COUNT; peripheral++)
+    {
+        if(POWER_ROBOT_PERIPHERALS & (1u << peripheral))
+        {
+            Power_Hold(peripheral, POWER_HOLDER_ROBOT);
+        }
+        else
+        {
+            /* Do nothing */
+        }
+    }
+}
+
+/***************************************************************************************
+ * Function: Power_WakeUp()
+ ***************************************************************************************
+ * Description: Set every pin to its awake mode and level. Outputs get their level first
+ *              so they don't glitch.
+ **************************************************************************************/
+void Power_WakeUp(void)
+{
+    powerPin_t pin;
+
+    Power_Resume();
+
+    for(uint8_t index = 0u; index < powerPinCount; index++)
+    {
+        memcpy_P(&pin, &powerPins[index], sizeof(pin));
+        if(OUTPUT == pin.mode)
+        {
+            digitalWrite(pin.pin, pin.level);
+        }
+        else
+        {
+            /* Do nothing */
+        }
+        pinMode(pin.pin, pin.mode);
+    }
+}
@@ -0,0 +1,63 @@
+#ifndef POWER_H
+#define POWER_H
+/***************************************************************************************
+ * Power
+ ***************************************************************************************
+ * Keeps the peripherals of the MCU clocked only while a subsystem needs them. Each
+ * peripheral has a set of holders; the first Power_Hold() turns it on in PRR, the last
+ * Power_Release() turns it off again. The digital input buffers of A0 - A3 work the same
+ * way with DIDR0, nothing reads those pins digitally unless it holds them.
+ * The pins of the Robot are in a table given to Power_Init(): Power_Sleep() parks them as
+ * low outputs and drops the peripherals of the awake Robot, Power_Resume() brings the
+ * peripherals back and Power_WakeUp() the pins.
+ * The ADC is disabled before it is stopped, as the datasheet asks, and its state goes to
+ * the energy ledger.
+ **************************************************************************************/
+#include <stdint.h>
+
+/* Peripherals; PRR bit numbers, then DIDR0 bit numbers plus 8 */
+#define POWER_ADC               0u
+#define POWER_USART             1u
+#define POWER_SPI               2u
+#define POWER_TIMER1            3u
+#define POWER_TIMER0            5u
+#define POWER_TIMER2            6u
+#define POWER_TWI               7u
+#define POWER_DIGITAL_A0        8u      /* Digital input buffer of A0 */
+#define POWER_DIGITAL_A1        9u
+#define POWER_DIGITAL_A2        10u
+#define POWER_DIGITAL_A3        11u
+#define POWER_PERIPHERAL_COUNT  12u
+
+/* Holders */
+#define POWER_HOLDER_ROBOT      0x01u   /* Awake Robot, dropped by Power_Sleep() */
+#define POWER_HOLDER_DISPLAY    0x02u
+#define POWER_HOLDER_SERIAL     0x04u   /* Dev Builds */
+#define POWER_HOLDER_PROFILER   0x08u   /* Dev Builds */
+
+/* Peripherals of the awake Robot: millis() and the motor PWM, IR Receiver, battery */
+#define POWER_ROBOT_PERIPHERALS ((1u << POWER_TIMER0) | (1u << POWER_TIMER2) | (1u << POWER_ADC))
+
+/* Pin groups, Power_Sleep() can keep some of them as they are */
+#define POWER_GROUP_MOTOR       0x01u
+#define POWER_GROUP_IR          0x02u
+#define POWER_GROUP_LED         0x04u
+
+/* One pin of the Robot, parked low while sleeping */
+typedef struct
+{
+    uint8_t pin;
+    uint8_t mode;               /* INPUT or OUTPUT while awake */
+    uint8_t level;              /* Output level while awake */
+    uint8_t group;              /* POWER_GROUP_* */
+} powerPin_t;
+
+void Power_Init(const powerPin_t *pins, uint8_t pinCount);
+void Power_Hold(uint8_t peripheral, uint8_t holder);
+void Power_Release(uint8_t peripheral, uint8_t holder);
+uint8_t Power_IsOn(uint8_t peripheral);
+void Power_Sleep(uint8_t keepGroups);
+void Power_Resume(void);
+void Power_WakeUp(void);
+
+#endif /* POWER_H */
@@ -0,0 +1,216 @@
+/***************************************************************************************
+ * Includes
+ **************************************************************************************/
+#include "Profiler.h"
+
+#ifdef PROFILER_ENABLE
+#include <Arduino.h>
+#include <avr/interrupt.h>
+#include <util/atomic.h>
+
+/***************************************************************************************
+ * Variables
+ **************************************************************************************/
+static volatile uint16_t profilerOverflows = 0u;        /* Timer1 overflows, upper half of the cycle count */
+static uint32_t profilerOverhead = 0u;                  /* Cycles taken by an empty scope */
+static volatile profilerProbe_t profilerProbes[PROFILER_PROBE_COUNT];
+static uint32_t profilerWindowStart = 0u;               /* Cycle count when the statistics were cleared */
+
+static const char * const profilerNames[PROFILER_PROBE_COUNT] =
+{
+    "IR ISR",
+    "IR Decode",
+    "Power Management",
+    "Explore",
+    "IR ISR Latency",
+    "Telemetry",
+};
+
+/***************************************************************************************
+ * Function: ISR(TIMER1_OVF_vect)
+ ***************************************************************************************
+ * Description: Extends Timer1 to 32 bits; it overflows every 65536 cycles.
+ **************************************************************************************/
+ISR(TIMER1_OVF_vect)
+{
+    profilerOverflows++;
+}
+
+/***************************************************************************************
+ * Function: Profiler_Cycles()
+ ***************************************************************************************
+ * Description: Read the 32 bits cycle counter. Safe inside and outside interrupts.
+ * Return: CPU cycles since Profiler_Init(), wraps after 2^32 cycles
+ **************************************************************************************/
+uint32_t Profiler_Cycles(void)
+{
+    uint16_t low;
+    uint16_t high;
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        low = TCNT1;
+        high = profilerOverflows;
+
+        /* Overflow happened but its interrupt didn't run yet */
+        if((TIFR1 & _BV(TOV1)) && (low < 0x8000u))
+        {
+            high++;
+        }
+    }
+
+    return ((uint32_t)high << 16) | low;
+}
+
+/***************************************************************************************
+ * Function: Profiler_Record()
+ ***************************************************************************************
+ * Description: Add one call to the statistics of a probe.
+ * Parameters:
+ *  - probe[in]   :   PROFILER_PROBE_* which was measured
+ *  - start[in]   :   Profiler_Cycles() when the measured code started
+ **************************************************************************************/
+void Profiler_Record(uint8_t probe, uint32_t start)
+{
+    uint32_t cycles = Profiler_Cycles() - start;
+
+    /* Remove the time taken by the profiler itself */
+    cycles = (cycles > profilerOverhead) ? (cycles - profilerOverhead) : 0u;
+
+    Profiler_RecordValue(probe, cycles);
+}
+
+/***************************************************************************************
+ * Function: Profiler_RecordValue()
+ ***************************************************************************************
+ * Description: Add one sample to the statistics of a probe which is not a scope,
+ *              like an interrupt latency.
+ * Parameters:
+ *  - probe[in]    :   PROFILER_PROBE_* which was measured
+ *  - cycles[in]   :   Measured number of cycles
+ **************************************************************************************/
+void Profiler_RecordValue(uint8_t probe, uint32_t cycles)
+{
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        volatile profilerProbe_t *entry = &profilerProbes[probe];
+
+        entry->count++;
+        entry->sum += cycles;
+        if(cycles < entry->min)
+        {
+            entry->min = cycles;
+        }
+        if(cycles > entry->max)
+        {
+            entry->max = cycles;
+        }
+    }
+}
+
+/***************************************************************************************
+ * Function: Profiler_Reset()
+ ***************************************************************************************
+ * Description: Clear the statistics of all probes.
+ **************************************************************************************/
+void Profiler_Reset(void)
+{
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        for(uint8_t probe = 0u; probe < PROFILER_PROBE_COUNT; probe++)
+        {
+            profilerProbes[probe].count = 0u;
+            profilerProbes[probe].sum = 0u;
+            profilerProbes[probe].min = 0xFFFFFFFFu;
+            profilerProbes[probe].max = 0u;
+        }
+    }
+
+    profilerWindowStart = Profiler_Cycles();
+}
+
+/***************************************************************************************
+ * Function: Profiler_Init()
+ ***************************************************************************************
+ * Description: Start Timer1 at the CPU clock and measure the profiler overhead.
+ *              Timer1 is not used by anything else on the Robot.
+ **************************************************************************************/
+void Profiler_Init(void)
+{
+    /* Normal mode, no prescaler, overflow interrupt */
+    TCCR1A = 0u;
+    TCCR1B = _BV(CS10);
+    TCNT1 = 0u;
+    TIMSK1 |= _BV(TOIE1);
+
+    /* Measure an empty scope */
+    profilerOverhead = 0u;
+    Profiler_Reset();
+    {
+        ProfilerScope emptyScope(PROFILER_PROBE_EXPLORE);
+    }
+    profilerOverhead = profilerProbes[PROFILER_PROBE_EXPLORE].min;
+    Profiler_Reset();
+}
+
+/***************************************************************************************
+ * Function: Profiler_Dump()
+ ***************************************************************************************
+ * Description: Show the statistics of all probes on Serial every PROFILER_DUMP_PERIOD,
+ *              then start a new period so the sums don't overflow.
+ *              Format per probe: name: count min max avg, in cycles.
+ *              Last line is the share of the CPU taken by the IR interrupt.
+ **************************************************************************************/
+void Profiler_Dump(void)
+{
+    static unsigned long dumpTime = 0u;
+    profilerProbe_t entry;
+    uint32_t isrCycles = 0u;
+    uint32_t windowCycles = Profiler_Cycles() - profilerWindowStart;
+
+    /* Check if it is time */
+    if(PROFILER_DUMP_PERIOD > (millis() - dumpTime))
+    {
+        return;
+    }
+    dumpTime = millis();
+
+    for(uint8_t probe = 0u; probe < PROFILER_PROBE_COUNT; probe++)
+    {
+        /* Copy so the interrupts can keep recording while printing */
+        ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+        {
+            entry.count = profilerProbes[probe].count;
+            entry.sum = profilerProbes[probe].sum;
+            entry.min = profilerProbes[probe].min;
+            entry.max = profilerProbes[probe].max;
+        }
+
+        Serial.print(profilerNames[probe]);
+        Serial.print(": ");
+        Serial.print(entry.count);
+        if(0u != entry.count)
+        {
+            Serial.print(" ");
+            Serial.print(entry.min);
+            Serial.print(" ");
+            Serial.print(entry.max);
+            Serial.print(" ");
+            Serial.print(entry.sum / entry.count);
+        }
+        Serial.println();
+
+        if(PROFILER_ISR_PROBES & (1u << probe))
+        {
+            isrCycles += entry.sum;
+        }
+    }
+
+    /* Per mille of the window spent in the IR interrupt; scaled down first so it can't overflow */
+    Serial.print("IR ISR share: ");
+    Serial.print((isrCycles >> 8) * 1000u / ((windowCycles >> 8) | 1u));
+    Serial.println(" permille");
+
+    Profiler_Reset();
+}
+#endif /* PROFILER_ENABLE */
@@ -0,0 +1,74 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+/***************************************************************************************
+ * Profiler
+ ***************************************************************************************
+ * Counts CPU cycles spent in the hot paths with Timer1 running at the CPU clock.
+ * Put PROFILE_SCOPE(probe) at the start of a function or block; the cycles until the
+ * end of the scope are added to the probe. Min, max, sum and call count are kept per
+ * probe and shown on Serial by Profiler_Dump() every PROFILER_DUMP_PERIOD.
+ * Only Dev Builds profile, see Build.h; in production everything compiles to nothing.
+ **************************************************************************************/
+#include "Build.h"
+
+#ifdef DEV_BUILD
+#define PROFILER_ENABLE
+#endif
+
+/* Probes */
+#define PROFILER_PROBE_IR_ISR           0u    /* IR capture interrupt */
+#define PROFILER_PROBE_IR_DECODE        1u    /* IRrecv::decode() */
+#define PROFILER_PROBE_POWER_MANAGEMENT 2u    /* Robot_PowerManagement() */
+#define PROFILER_PROBE_EXPLORE          3u    /* Robot_Explore() */
+#define PROFILER_PROBE_IR_LATENCY       4u    /* Cycles from IR timer match to IR ISR entry */
+#define PROFILER_PROBE_TELEMETRY        5u    /* Telemetry_Send() */
+#define PROFILER_PROBE_COUNT            6u
+
+/* Probes which measure interrupt handlers, their sum is shown as the IR ISR share of the
+ * CPU. Only the IR ISR is probed: millis() of Timer0 is in the Arduino core and the
+ * Timer1 overflow is the profiler itself, neither is in the share */
+#define PROFILER_ISR_PROBES             (1u << PROFILER_PROBE_IR_ISR)
+
+#define PROFILER_DUMP_PERIOD            10000 /* Miliseconds between two dumps */
+
+#ifdef PROFILER_ENABLE
+#include <stdint.h>
+
+/* Statistics of one probe, in CPU cycles */
+typedef struct
+{
+    uint32_t count;
+    uint32_t sum;
+    uint32_t min;
+    uint32_t max;
+} profilerProbe_t;
+
+void Profiler_Init(void);
+uint32_t Profiler_Cycles(void);
+void Profiler_Record(uint8_t probe, uint32_t start);
+void Profiler_RecordValue(uint8_t probe, uint32_t cycles);
+void Profiler_Reset(void);
+void Profiler_Dump(void);
+
+/* Records the lifetime of the scope it is declared in */
+class ProfilerScope
+{
+public:
+    ProfilerScope(uint8_t probe) : probe(probe), start(Profiler_Cycles()) {}
+    ~ProfilerScope() { Profiler_Record(probe, start); }
+private:
+    uint8_t probe;
+    uint32_t start;
+};
+
+#define PROFILE_SCOPE(probe)    ProfilerScope profilerScope_##probe(probe)
+#define PROFILE_VALUE(probe, cycles)    Profiler_RecordValue(probe, cycles)
+#else
+#define PROFILE_SCOPE(probe)
+#define PROFILE_VALUE(probe, cycles)
+#define Profiler_Init()
+#define Profiler_Reset()
+#define Profiler_Dump()
+#endif /* PROFILER_ENABLE */
+
+#endif /* PROFILER_H */
@@ -0,0 +1,249 @@
+/***************************************************************************************
+ * Beacon Homing Simulation
+ ***************************************************************************************
+ * Runs the whole sketch on a PC on a simulated floor with a charger beacon, to check
+ * that Beacon_Home() finds it from anywhere and stops next to it, not as soon as the
+ * beacon is in range.
+ * The Robot moves with the PWM duty and phase of its motor pins. The beacon sends its
+ * frame every BEACON_PERIOD; the receiver hears it when the light falling on it is
+ * bright enough: cosine directivity in front, SIM_BACK_GAIN from reflections behind,
+ * falling with the square of the distance, with some fading from frame to frame.
+ * Exits with 1 when a start doesn't dock within SIM_DOCKED_MAX of the beacon.
+ * Build: g++ -DARDUINO=100 -DTEST -Ihost -I.. -o beaconsim beaconsim.cpp ../IRremote.cpp ../Profiler.cpp ../Display.cpp ../Energy.cpp ../Power.cpp host/Host.cpp
+ **************************************************************************************/
+#include <Arduino.h>
+#include "EcoBot.ino"
+#include <stdio.h>
+#include <math.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#define SIM_WHEEL_SPEED     0.5     /* m/s of a wheel at full duty */
+#define SIM_WHEEL_BASE      0.1     /* m between the wheels */
+#define SIM_RANGE           4.0     /* m the receiver hears the beacon head on */
+#define SIM_BACK_GAIN       0.01    /* Light reaching the receiver from behind, of head on */
+#define SIM_FADING          0.3     /* Frames are up to 30% brighter or darker */
+#define SIM_DOCKED_MAX      0.5     /* m from the beacon, docking further away fails */
+#define SIM_TIMEOUT         600000u /* Miliseconds a start may take */
+#define SIM_BEACON_ID       7u
+#define SIM_BATTERY_MV      3900u
+#define SIM_VCC_MV          3300u
+#define SIM_CRUISE_DUTY     150u
+
+/* Where the Robot starts, the beacon is at 0, 0; homing starts once it hears it */
+typedef struct
+{
+    double x;
+    double y;
+    double heading;         /* Degrees, 0 is along x */
+} simStart_t;
+
+static const simStart_t simStarts[] =
+{
+    { 3.0,   0.0, 150.0 },
+    { 3.0,   0.0, 180.0 },
+    { -2.0,  2.0, 330.0 },
+    { 0.0,  -3.5,  45.0 },
+    { 1.5,   1.0, 270.0 },
+    { -1.0, -0.5,   0.0 }
+};
+
+static double simX;
+static double simY;
+static double simHeading;   /* Radians */
+static uint32_t simFade = 1u;
+
+/***************************************************************************************
+ * Function: Sim_Wheel()
+ ***************************************************************************************
+ * Return: m/s of a wheel from the duty and phase of its motor pins
+ **************************************************************************************/
+static double Sim_Wheel(uint8_t enablePin, uint8_t phasePin)
+{
+    double speed;
+
+    if((HIGH != Host_GetPin(PIN_DRV8834_SLEEP)) || (0 >= hostAnalogWritten[enablePin]))
+    {
+        return 0.0;
+    }
+    else
+    {
+        speed = (SIM_WHEEL_SPEED * hostAnalogWritten[enablePin]) / DRV8834_POWER_FULL;
+        return (HIGH == Host_GetPin(phasePin)) ? speed : -speed;
+    }
+}
+
+/***************************************************************************************
+ * Function: Sim_Move()
+ ***************************************************************************************
+ * Description: Motor A drives the left wheel, Motor B the right one.
+ **************************************************************************************/
+static void Sim_Move(double seconds)
+{
+    double left = Sim_Wheel(PIN_MA_ENABLE, PIN_MA_PHASE);
+    double right = Sim_Wheel(PIN_MB_ENABLE, PIN_MB_PHASE);
+    double speed = (left + right) / 2.0;
+
+    simX += speed * cos(simHeading) * seconds;
+    simY += speed * sin(simHeading) * seconds;
+    simHeading += ((right - left) / SIM_WHEEL_BASE) * seconds;
+}
+
+/***************************************************************************************
+ * Function: Sim_Heard()
+ ***************************************************************************************
+ * Return: 1 when the receiver gets the frame the beacon sends now
+ **************************************************************************************/
+static uint8_t Sim_Heard(void)
+{
+    double distance = sqrt((simX * simX) + (simY * simY));
+    double angle = atan2(-simY, -simX) - simHeading;
+    double gain = cos(angle);
+    double fade;
+
+    simFade = (simFade * 1103515245u) + 12345u;
+    fade = 1.0 + (SIM_FADING * ((((simFade >> 16) % 2001u) / 1000.0) - 1.0));
+    gain = (SIM_BACK_GAIN > gain) ? SIM_BACK_GAIN : gain;
+
+    return ((gain * fade) / (distance * distance)) >= (1.0 / (SIM_RANGE * SIM_RANGE));
+}
+
+/***************************************************************************************
+ * Function: Sim_Send()
+ ***************************************************************************************
+ * Description: The receiver output toggles with the frame; like the hardware the pin
+ *              change interrupt only fires while the slow clock armed it.
+ **************************************************************************************/
+static void Sim_Send(void)
+{
+    static IRsendRecorder recorder;
+
+    if((PCICR & _BV(PCIE0)) && (PCMSK0 & _BV(PCINT1)))
+    {
+        PCINT0_vect();
+    }
+    else
+    {
+        /* Receiver is listening already */
+    }
+
+    recorder.reset(3);
+    recorder.sendNEC(Beacon_Frame(BEACON_KIND_CHARGER, SIM_BEACON_ID), 32);
+    irrecv.replay(recorder.rawbuf, recorder.rawlen);
+}
+
+/***************************************************************************************
+ * Function: Sim_Run()
+ ***************************************************************************************
+ * Description: Run the sketch from one start until it docks or times out.
+ * Return: Distance to the beacon when docked, a negative value otherwise
+ **************************************************************************************/
+static double Sim_Run(const simStart_t *start)
+{
+    unsigned long beaconTime;
+    unsigned long last;
+    byte lastState = BEACON_STATE_IDLE;
+
+    simX = start->x;
+    simY = start->y;
+    simHeading = (start->heading * M_PI) / 180.0;
+
+    /* Healthy battery and a calibrated cruise duty, nothing but homing to do */
+    hostAdc[ADC_MUX_BANDGAP & 0x0Fu] = (1100u * ADC_MAX_VALUE) / SIM_VCC_MV;
+    hostAdc[PIN_BATTERY_LEVEL - A0] = ((SIM_BATTERY_MV / 2u) * ADC_MAX_VALUE) / SIM_VCC_MV;
+    hostEeprom[EEPROM_ADDRESS_CRUISE] = CRUISE_CALIBRATION_MAGIC;
+    hostEeprom[EEPROM_ADDRESS_CRUISE + 1u] = SIM_CRUISE_DUTY;
+    Host_SetPin(PIN_INSOMNIA, HIGH);
+    devStuff = E_NOT_OK;
+    hostSerial = NULL;
+
+    setup();
+    beaconTime = millis();
+    last = micros();
+
+    while(SIM_TIMEOUT > millis())
+    {
+        loop();
+        Host_Advance(1000u);
+        Sim_Move((micros() - last) / 1000000.0);
+        last = micros();
+
+        if(BEACON_PERIOD <= (millis() - beaconTime))
+        {
+            beaconTime += BEACON_PERIOD;
+            if(Sim_Heard())
+            {
+                Sim_Send();
+            }
+            else
+            {
+                /* Too far or facing away */
+            }
+        }
+
+        if(lastState != beaconState)
+        {
+            lastState = beaconState;
+            if(BEACON_STATE_TURN == beaconState)
+            {
+                printf("  %6.1fs at %5.2f, %5.2f  %2u of %u steps heard every frame\n", millis() / 1000.0,
+                       simX, simY, Beacon_Spread(), BEACON_SCAN_STEPS);
+            }
+            else if(BEACON_STATE_DOCKED == beaconState)
+            {
+                printf("  %6.1fs at %5.2f, %5.2f  %2u of %u steps heard every frame, docked\n", millis() / 1000.0,
+                       simX, simY, Beacon_Spread(), BEACON_SCAN_STEPS);
+                return sqrt((simX * simX) + (simY * simY));
+            }
+            else
+            {
+                /* Scanning */
+            }
+        }
+    }
+
+    return -1.0;
+}
+
+int main(void)
+{
+    int status = 0;
+    double distance;
+
+    for(uint8_t index = 0u; index < (sizeof(simStarts) / sizeof(simStarts[0])); index++)
+    {
+        printf("Start %5.2f, %5.2f heading %3.0f, %.2fm from the beacon\n", simStarts[index].x,
+               simStarts[index].y, simStarts[index].heading,
+               sqrt((simStarts[index].x * simStarts[index].x) + (simStarts[index].y * simStarts[index].y)));
+
+        /* Every start is a new process, the sketch keeps its state in statics */
+        fflush(stdout);
+        pid_t child = fork();
+        if(0 == child)
+        {
+            distance = Sim_Run(&simStarts[index]);
+            if((0.0 <= distance) && (SIM_DOCKED_MAX >= distance))
+            {
+                printf("  pass, docked %.2fm from the beacon\n", distance);
+                exit(0);
+            }
+            else if(0.0 <= distance)
+            {
+                printf("  FAIL, docked %.2fm from the beacon\n", distance);
+            }
+            else
+            {
+                printf("  FAIL, not docked after %us\n", SIM_TIMEOUT / 1000u);
+            }
+            exit(1);
+        }
+        else
+        {
+            int childStatus;
+            waitpid(child, &childStatus, 0);
+            status |= (!WIFEXITED(childStatus) || (0 != WEXITSTATUS(childStatus)));
+        }
+    }
+
+    return status;
+}
@@ -0,0 +1,209 @@
+/***************************************************************************************
+ * Display Simulation
+ ***************************************************************************************
+ * Drives Display.cpp on a PC with the emulated SSD1681 of DISPLAY_HOST. Alternating
+ * moods give a long run of partial refreshes; after every refresh the emulated panel
+ * must match a fresh full render of the screen, or the partial refreshes lost pixels.
+ * The loop calls Display_Task() every SIM_LOOP_TIME, the energy per refresh must still
+ * be that of the refresh time alone. Before that BUSY is held high, once during a
+ * refresh and once after a reset: the display must give the panel up and never block,
+ * and Display_Wait() must return within the watchdog period of the Robot, or kick it.
+ * Every refresh is also saved as display_NNN_*.pbm in the working directory.
+ * Exits with 1 when a check fails.
+ * Build: g++ -DDISPLAY_HOST -I.. -o displaysim displaysim.cpp ../Display.cpp
+ **************************************************************************************/
+#include "Display.h"
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#define SIM_LOOP_TIME           37u     /* Miliseconds of one loop of the sketch, not a divider of the refresh time */
+#define SIM_PARTIALS            30u     /* Partial refreshes to check */
+#define SIM_MOOD_TIME           10000u  /* Miliseconds between checks of the panel */
+#define SIM_REFRESH_MAX         1000000u /* Miliseconds a refresh may wait for the budget, a full one needs 740s */
+#define SIM_WATCHDOG_TIME       4000u   /* Miliseconds, SUPERVISOR_WATCHDOG_TIMEOUT of EcoBot.ino */
+#define SIM_PARTIAL_MICROJOULES 5920u   /* 400ms at 3.7V and 4mA */
+#define SIM_FULL_MICROJOULES    29600u  /* 2000ms at 3.7V and 4mA */
+
+static unsigned long simMillis = 0u;
+static unsigned long simKickTime = 0u;      /* Last wdt_reset() */
+static unsigned long simKickGap = 0u;       /* Longest time without wdt_reset() */
+
+unsigned long millis(void)
+{
+    return simMillis;
+}
+
+void delay(unsigned long milliSeconds)
+{
+    simMillis += milliSeconds;
+}
+
+void wdt_reset(void)
+{
+    simKickGap = (simKickGap < (simMillis - simKickTime)) ? (simMillis - simKickTime) : simKickGap;
+    simKickTime = simMillis;
+}
+
+/***************************************************************************************
+ * Function: Sim_Run()
+ ***************************************************************************************
+ * Description: Run the loop for a while.
+ **************************************************************************************/
+static void Sim_Run(unsigned long milliSeconds)
+{
+    for(unsigned long elapsed = 0u; elapsed < milliSeconds; elapsed += SIM_LOOP_TIME)
+    {
+        simMillis += SIM_LOOP_TIME;
+        Display_Task();
+    }
+}
+
+/***************************************************************************************
+ * Function: Sim_Matches()
+ ***************************************************************************************
+ * Return: 1 when the emulated panel shows what a full refresh of the screen would
+ **************************************************************************************/
+static uint8_t Sim_Matches(uint8_t mood, uint8_t icon)
+{
+    static uint8_t image[DISPLAY_HOST_IMAGE_SIZE];
+
+    Display_HostRender(mood, icon, image);
+
+    return (0 == memcmp(image, Display_HostPanel(), sizeof(image))) ? 1u : 0u;
+}
+
+/***************************************************************************************
+ * Function: Sim_Stuck()
+ ***************************************************************************************
+ * Description: Hold BUSY high, during a refresh or from the next reset on, and check
+ *              that Display_Wait() returns before the watchdog would bite, the panel is
+ *              left alone from then on and Display_Task() doesn't block.
+ * Return: 0 when the display gave the panel up, 1 otherwise
+ **************************************************************************************/
+static int Sim_Stuck(uint8_t duringRefresh)
+{
+    static uint8_t before[DISPLAY_HOST_IMAGE_SIZE];
+    unsigned long start;
+    unsigned long waited;
+
+    Display_Init();
+    Display_Show(DISPLAY_MOOD_HAPPY, DISPLAY_ICON_AUTOMATE);
+    if(duringRefresh)
+    {
+        Display_HostBusyStuck(1u);
+        start = simMillis;
+        simKickTime = start;
+        Display_Wait();
+    }
+    else
+    {
+        Display_Wait();
+        Display_HostBusyStuck(1u);
+        start = simMillis;
+        simKickTime = start;
+        Display_Show(DISPLAY_MOOD_SLEEPING, DISPLAY_ICON_AUTOMATE);
+        Display_Wait();
+    }
+
+    /* Supervisor_Task() kicked the watchdog right before */
+    waited = simMillis - start;
+    wdt_reset();
+    if(SIM_WATCHDOG_TIME <= waited)
+    {
+        printf("Stuck BUSY: Display_Wait() took %lums, the watchdog would reset the Robot\n", waited);
+        return 1;
+    }
+    else if(SIM_WATCHDOG_TIME <= simKickGap)
+    {
+        printf("Stuck BUSY: %lums without a watchdog kick\n", simKickGap);
+        return 1;
+    }
+
+    /* BUSY works again, but the panel was given up */
+    memcpy(before, Display_HostPanel(), sizeof(before));
+    Display_HostBusyStuck(0u);
+    Display_Show(DISPLAY_MOOD_TIRED, DISPLAY_ICON_MANUAL);
+    Sim_Run(SIM_MOOD_TIME);
+    if(0 != memcmp(before, Display_HostPanel(), sizeof(before)))
+    {
+        printf("Stuck BUSY: the panel was refreshed after it hung\n");
+        return 1;
+    }
+
+    printf("Stuck BUSY %s: Display_Wait() returned after %lums, %lums without a kick, panel left alone\n",
+           duringRefresh ? "during a refresh" : "after a reset", waited, simKickGap);
+    return 0;
+}
+
+int main(void)
+{
+    displayStats_t stats;
+    uint16_t partials = 0u;
+    uint16_t fulls = 0u;
+    uint16_t sinceFull = 0u;
+    uint32_t expected;
+    unsigned long waited;
+    int status = 0;
+
+    /* Every case of stuck BUSY is a new process, the display keeps its state in statics */
+    for(uint8_t duringRefresh = 0u; duringRefresh < 2u; duringRefresh++)
+    {
+        int childStatus;
+        pid_t child;
+
+        fflush(stdout);
+        child = fork();
+        if(0 == child)
+        {
+            exit(Sim_Stuck(duringRefresh));
+        }
+        waitpid(child, &childStatus, 0);
+        status |= (!WIFEXITED(childStatus) || (0 != WEXITSTATUS(childStatus)));
+    }
+
+
+    Display_Init();
+    for(uint16_t step = 0u; partials < SIM_PARTIALS; step++)
+    {
+        uint8_t mood = (step & 1u) ? DISPLAY_MOOD_CALM : DISPLAY_MOOD_HAPPY;
+        uint8_t icon = (2u == (step % 5u)) ? DISPLAY_ICON_MANUAL : DISPLAY_ICON_AUTOMATE;
+
+        /* Wait until the budget allowed the refresh and the panel shows the screen */
+        Display_Show(mood, icon);
+        for(waited = 0u; (SIM_REFRESH_MAX > waited) && !Sim_Matches(mood, icon); waited += SIM_MOOD_TIME)
+        {
+            Sim_Run(SIM_MOOD_TIME);
+        }
+        if(SIM_REFRESH_MAX <= waited)
+        {
+            printf("Panel differs from a full render after refresh %u\n", partials + fulls);
+            return 1;
+        }
+
+        /* Same rule as Display_Task() */
+        if((0u == step) || (DISPLAY_FULL_REFRESH_EVERY <= sinceFull))
+        {
+            fulls++;
+            sinceFull = 0u;
+        }
+        else
+        {
+            partials++;
+            sinceFull++;
+        }
+    }
+    Sim_Run(SIM_MOOD_TIME);
+
+    /* Refreshes take 400ms or 2s, polling every SIM_LOOP_TIME must not add to it */
+    Display_GetStats(&stats);
+    expected = (((uint32_t)partials * SIM_PARTIAL_MICROJOULES) + ((uint32_t)fulls * SIM_FULL_MICROJOULES)) /
+               (partials + fulls);
+    printf("%u partial and %u full refreshes, the panel matched a full render after each\n", partials, fulls);
+    printf("Energy per refresh %luuJ, %luuJ expected\n", (unsigned long)stats.energyPerRefresh, (unsigned long)expected);
+    status |= (expected != stats.energyPerRefresh);
+
+    return status;
+}
@@ -0,0 +1,139 @@
+/***************************************************************************************
+ * Energy Simulation
+ ***************************************************************************************
+ * Runs the energy ledger on a PC over a scripted day, to see which subsystem uses the
+ * battery before tuning anything on the Robot.
+ * Build: g++ -DENERGY_HOST -I.. -o energysim energysim.cpp ../Energy.cpp
+ **************************************************************************************/
+#include "Energy.h"
+#include <stdio.h>
+
+#define SIM_BATTERY_MILLIAMP_HOURS  1200u
+#define SIM_MILLIVOLTS              3700u
+#define SIM_DRV8834_IDLE_SECONDS    3u      /* DRV8834_IDLE_SLEEP_TIME of EcoBot.ino */
+
+/* millis() doesn't move, the script advances time with Energy_Elapse() */
+unsigned long millis(void)
+{
+    return 0u;
+}
+
+/* One step of the script: states held for some time */
+typedef struct
+{
+    const char *name;
+    uint32_t seconds;
+    uint8_t mcu;
+    uint8_t drv8834;
+    uint8_t motorA;         /* PWM duty */
+    uint8_t motorB;         /* PWM duty */
+    uint8_t ir;
+    uint8_t adc;
+} simStep_t;
+
+/* A sunny day: explore in the morning and afternoon, sleep when the battery is low and at night.
+ * While waiting the clock governor runs the MCU at 1MHz. The DRV8834 is awake when the motors stop,
+ * Motor_Task() puts it to sleep SIM_DRV8834_IDLE_SECONDS later */
+static const simStep_t simDay[] =
+{
+    { "night sleep",    8u * 3600u, ENERGY_MCU_POWER_DOWN, ENERGY_DRV8834_SLEEP, 0u,   0u,   ENERGY_OFF, ENERGY_OFF },
+    { "explore drive",  1u * 3600u, ENERGY_MCU_ACTIVE,     ENERGY_DRV8834_AWAKE, 255u, 255u, ENERGY_ON,  ENERGY_ON },
+    { "explore wait",   3u * 3600u, ENERGY_MCU_ACTIVE_SLOW, ENERGY_DRV8834_AWAKE, 0u,  0u,   ENERGY_ON,  ENERGY_ON },
+    { "noon nap",       2u * 3600u, ENERGY_MCU_POWER_DOWN, ENERGY_DRV8834_SLEEP, 0u,   0u,   ENERGY_OFF, ENERGY_OFF },
+    { "manual drive",   1u * 3600u, ENERGY_MCU_ACTIVE,     ENERGY_DRV8834_AWAKE, 127u, 127u, ENERGY_ON,  ENERGY_ON },
+    { "manual wait",    3u * 3600u, ENERGY_MCU_ACTIVE_SLOW, ENERGY_DRV8834_AWAKE, 0u,  0u,   ENERGY_ON,  ENERGY_ON },
+    { "evening sleep",  6u * 3600u, ENERGY_MCU_POWER_DOWN, ENERGY_DRV8834_SLEEP, 0u,   0u,   ENERGY_OFF, ENERGY_OFF },
+};
+
+/* Play the day, without the governor the MCU stays at 8MHz and without the idle sleep the DRV8834 stays
+ * awake while waiting; returns the seconds played */
+static uint32_t Sim_Run(bool governor, bool driverSleep, bool print)
+{
+    uint32_t seconds = 0u;
+
+    Energy_Init();
+    Energy_SetVoltage(SIM_MILLIVOLTS);
+
+    for(unsigned step = 0u; step < sizeof(simDay) / sizeof(simDay[0]); step++)
+    {
+        const simStep_t *s = &simDay[step];
+        uint8_t mcu = s->mcu;
+        uint32_t awakeSeconds = s->seconds;
+
+        if(!governor && (ENERGY_MCU_ACTIVE_SLOW == mcu))
+        {
+            mcu = ENERGY_MCU_ACTIVE;
+        }
+
+        Energy_SetState(ENERGY_MCU, mcu);
+        Energy_SetState(ENERGY_DRV8834, s->drv8834);
+        Energy_SetLevel(ENERGY_MOTOR_A, s->motorA);
+        Energy_SetLevel(ENERGY_MOTOR_B, s->motorB);
+        Energy_SetState(ENERGY_IR, s->ir);
+        Energy_SetState(ENERGY_ADC, s->adc);
+        if(driverSleep && (ENERGY_DRV8834_AWAKE == s->drv8834) && (0u == s->motorA) && (0u == s->motorB) &&
+           (SIM_DRV8834_IDLE_SECONDS < s->seconds))
+        {
+            awakeSeconds = SIM_DRV8834_IDLE_SECONDS;
+        }
+        Energy_Elapse(awakeSeconds * 1000u);
+        Energy_SetState(ENERGY_DRV8834, ENERGY_DRV8834_SLEEP);
+        Energy_Elapse((s->seconds - awakeSeconds) * 1000u);
+        seconds += s->seconds;
+        if(print && (s->seconds != awakeSeconds))
+        {
+            printf("%-14s %6u s, DRV8834 asleep after %u s\n", s->name, (unsigned)s->seconds, (unsigned)awakeSeconds);
+        }
+        else if(print)
+        {
+            printf("%-14s %6u s\n", s->name, (unsigned)s->seconds);
+        }
+    }
+
+    return seconds;
+}
+
+static uint32_t Sim_Total(void)
+{
+    uint32_t total = 0u;
+
+    for(uint8_t subsystem = 0u; subsystem < ENERGY_SUBSYSTEM_COUNT; subsystem++)
+    {
+        total += Energy_MilliJoules(subsystem);
+    }
+
+    return total;
+}
+
+int main(void)
+{
+    uint32_t seconds = Sim_Run(false, true, false);
+    uint32_t fullSpeed = Sim_Total();
+    uint32_t driverAwake;
+    uint32_t total;
+
+    Sim_Run(true, false, false);
+    driverAwake = Sim_Total();
+
+    seconds = Sim_Run(true, true, true);
+    total = Sim_Total();
+
+    printf("\n%-10s %10s %6s\n", "Subsystem", "Joules", "Share");
+    for(uint8_t subsystem = 0u; subsystem < ENERGY_SUBSYSTEM_COUNT; subsystem++)
+    {
+        uint32_t milliJoules = Energy_MilliJoules(subsystem);
+
+        printf("%-10s %10.1f %5.1f%%\n", Energy_Name(subsystem), milliJoules / 1000.0, (100.0 * milliJoules) / total);
+    }
+
+    /* Battery holds mAh * 3.6 * V joules */
+    double average = (total / 1000.0) / seconds / (SIM_MILLIVOLTS / 1000.0) * 1000.0;
+    printf("%-10s %10.1f\n\nAverage %.2f mA, a %u mAh battery lasts %.1f days like this\n", "Total", total / 1000.0,
+           average, SIM_BATTERY_MILLIAMP_HOURS, SIM_BATTERY_MILLIAMP_HOURS / average / 24.0);
+    printf("Clock governor saves %.1f J a day, %.1f%% (%.1f J at 8MHz all the time)\n", (fullSpeed - total) / 1000.0,
+           (100.0 * (fullSpeed - total)) / fullSpeed, fullSpeed / 1000.0);
+    printf("DRV8834 idle sleep saves %.1f J a day, %.1f%% (%.1f J awake while waiting)\n", (driverAwake - total) / 1000.0,
+           (100.0 * (driverAwake - total)) / driverAwake, driverAwake / 1000.0);
+
+    return 0;
+}
@@ -0,0 +1,79 @@
+#!/usr/bin/env python3
+"""
+EcoBot event log reader.
+
+Prints the event log kept in EEPROM by Log_Event(), oldest event first.
+The input is a raw image of the whole EEPROM, for example read with an ISP programmer:
+    avrdude -c usbasp -p m328p -U eeprom:r:eeprom.bin:r
+    eventlog.py eeprom.bin
+"""
+import argparse
+import struct
+
+EEPROM_ADDRESS_LOG = 512
+LOG_RECORD_COUNT = 48
+LOG_EEPROM_MAGIC = 0x5A
+LOG_SEQUENCE_EMPTY = 0xFFFF
+
+# logRecord_t: time, sequence, data, type, checksum; AVR doesn't pad
+RECORD = struct.Struct("<IHHBB")
+
+EXPLORE_STATES = {0: "automate", 1: "manual"}
+
+# LOG_EVENT_*: (name, how to print the data)
+EVENTS = {
+    1: ("boot", lambda data: "reset flags 0x%02X" % data),
+    2: ("watchdog reset", lambda data: "reset flags 0x%02X" % data),
+    3: ("sleep", lambda data: "%.3f V" % (data / 1000.0)),
+    4: ("wake", lambda data: "slept %d s" % data),
+    5: ("battery low", lambda data: "%.3f V" % (data / 1000.0)),
+    6: ("battery ok", lambda data: "%.3f V" % (data / 1000.0)),
+    7: ("mode", lambda data: EXPLORE_STATES.get(data, str(data))),
+    8: ("brownout reset", lambda data: "reset flags 0x%02X" % data),
+    9: ("safe state", lambda data: "%d faults in a row" % data),
+    10: ("wake by IR", lambda data: "%.3f V" % (data / 1000.0)),
+    11: ("wake insomnia", lambda data: "%.3f V" % (data / 1000.0)),
+}
+
+
+def read_records(image):
+    """Return the valid records as (sequence, time, type, data), oldest first."""
+    records = []
+    for slot in range(LOG_RECORD_COUNT):
+        offset = EEPROM_ADDRESS_LOG + slot * RECORD.size
+        raw = image[offset:offset + RECORD.size]
+        if len(raw) < RECORD.size:
+            break
+        time, sequence, data, event_type, checksum = RECORD.unpack(raw)
+        expected = LOG_EEPROM_MAGIC
+        for byte in raw[:-1]:
+            expected ^= byte
+        if sequence == LOG_SEQUENCE_EMPTY or expected != checksum:
+            continue
+        records.append((sequence, time, event_type, data))
+    if not records:
+        return records
+
+    # Sequence wraps: the oldest record follows the biggest gap
+    records.sort()
+    gaps = [(records[(i + 1) % len(records)][0] - records[i][0]) % 0x10000 for i in range(len(records))]
+    start = (gaps.index(max(gaps)) + 1) % len(records)
+    return records[start:] + records[:start]
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("image", help="raw EEPROM image")
+    args = parser.parse_args()
+
+    with open(args.image, "rb") as image_file:
+        image = image_file.read()
+
+    for sequence, time, event_type, data in read_records(image):
+        name, describe = EVENTS.get(event_type, ("event %d" % event_type, str))
+        # Time restarts at every boot
+        print("%5d %7d:%02d:%02d  %-15s %s" % (sequence, time // 3600, time // 60 % 60, time % 60, name, describe(data)))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,103 @@
+/***************************************************************************************
+ * Hibernation Simulation
+ ***************************************************************************************
+ * Runs the whole sketch on a PC with the battery below HIBERNATE_ENTER_PERCENT and
+ * Insomnia away, to check that hibernation wakes with the backoff and not every second.
+ * The battery stays low for SIM_DARK_TIME of sleep, then the sun charged it to
+ * SIM_CHARGED_MV; the Robot must wake up on the first measurement after that.
+ * A wake is a run of the sketch between two power downs, Robot_Sleep() powers down a
+ * few times back to back for one sleep and no time passes between those.
+ * Exits with 1 when the wakes differ from the schedule of HIBERNATE_SLEEP_MIN doubling
+ * up to HIBERNATE_SLEEP_MAX, or the Robot doesn't wake up once charged.
+ * Build: g++ -DARDUINO=100 -DTEST -Ihost -I.. -o hibernatesim hibernatesim.cpp ../IRremote.cpp ../Profiler.cpp ../Display.cpp ../Energy.cpp ../Power.cpp host/Host.cpp
+ **************************************************************************************/
+#include <Arduino.h>
+#include "EcoBot.ino"
+#include <stdio.h>
+
+#define SIM_DARK_TIME       3600000ul   /* Miliseconds slept before the battery is charged */
+#define SIM_LOW_MV          3400u       /* Below HIBERNATE_ENTER_PERCENT */
+#define SIM_CHARGED_MV      3750u       /* Above HIBERNATE_EXIT_PERCENT */
+#define SIM_VCC_MV          3300u
+#define SIM_TIMEOUT         10000u      /* Miliseconds awake before hibernation must have started */
+
+static uint16_t simWakes = 0u;          /* Wakes while the battery is low */
+static uint32_t simLastMicros = 0xFFFFFFFFul;
+
+/***************************************************************************************
+ * Function: Sim_Battery()
+ ***************************************************************************************
+ * Description: ADC readings of the bandgap and the divider for a battery voltage.
+ **************************************************************************************/
+static void Sim_Battery(uint16_t milliVolts)
+{
+    hostAdc[ADC_MUX_BANDGAP & 0x0Fu] = (1100u * ADC_MAX_VALUE) / SIM_VCC_MV;
+    hostAdc[PIN_BATTERY_LEVEL - A0] = ((milliVolts / 2u) * ADC_MAX_VALUE) / SIM_VCC_MV;
+}
+
+/***************************************************************************************
+ * Function: Sim_PowerDown()
+ ***************************************************************************************
+ * Description: Counts a wake when the sketch ran since the last power down, and charges
+ *              the battery once SIM_DARK_TIME was slept.
+ **************************************************************************************/
+static void Sim_PowerDown(uint32_t milliSeconds)
+{
+    if((simLastMicros != micros()) && (SIM_DARK_TIME >= (Host_SleptMillis() - milliSeconds)))
+    {
+        simWakes++;
+    }
+    else
+    {
+        /* Same sleep, or the battery is charged */
+    }
+    simLastMicros = micros();
+
+    if(SIM_DARK_TIME <= Host_SleptMillis())
+    {
+        Sim_Battery(SIM_CHARGED_MV);
+    }
+    else
+    {
+        /* Still dark */
+    }
+}
+
+int main(void)
+{
+    uint16_t expected = 0u;
+    uint32_t slept = 0u;
+    uint16_t sleepTime = HIBERNATE_SLEEP_MIN;
+    int status = 0;
+
+    /* Sleeps of the schedule which start in the dark */
+    while(SIM_DARK_TIME > slept)
+    {
+        expected++;
+        slept += sleepTime * 1000ul;
+        sleepTime = min(sleepTime * 2u, HIBERNATE_SLEEP_MAX);
+    }
+
+    Sim_Battery(SIM_LOW_MV);
+    Host_SetPin(PIN_INSOMNIA, LOW);
+    devStuff = E_NOT_OK;
+    hostSerial = NULL;
+    hostPowerDown = Sim_PowerDown;
+
+    setup();
+    while((0u == Host_SleptMillis()) && (SIM_TIMEOUT > millis()))
+    {
+        loop();
+        Host_Advance(1000u);
+    }
+
+    printf("%u wakes in %lus of hibernation, %u expected; waking every second would be %lu\n", simWakes,
+           SIM_DARK_TIME / 1000ul, expected, SIM_DARK_TIME / 1000ul);
+    printf("Awake again after %lus asleep at %u%%\n", (unsigned long)(Host_SleptMillis() / 1000u), socPercent);
+
+    status |= (expected != simWakes);
+    status |= (SIM_DARK_TIME > Host_SleptMillis()) || (slept < Host_SleptMillis());
+    status |= (HIBERNATE_EXIT_PERCENT > socPercent);
+
+    return status;
+}
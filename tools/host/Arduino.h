@@ -0,0 +1,170 @@
+#ifndef ARDUINO_H
+#define ARDUINO_H
+/***************************************************************************************
+ * Host Arduino
+ ***************************************************************************************
+ * The part of the Arduino core and of the ATmega328P registers the sketch uses, for
+ * building it on a PC. See Host.h.
+ **************************************************************************************/
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "Host.h"
+
+#ifndef F_CPU
+#define F_CPU                   8000000UL
+#endif
+
+typedef uint8_t byte;
+typedef bool boolean;
+
+#define HIGH                    1
+#define LOW                     0
+#define INPUT                   0
+#define OUTPUT                  1
+#define INPUT_PULLUP            2
+#define CHANGE                  1
+#define FALLING                 2
+#define RISING                  3
+#define LED_BUILTIN             13
+#define A0                      14
+#define A1                      15
+#define A2                      16
+#define A3                      17
+#define A4                      18
+#define A5                      19
+#define DEC                     10
+#define HEX                     16
+#define DEFAULT                 1
+#define INTERNAL                3
+#define EXTERNAL                0
+#define NOT_AN_INTERRUPT        -1
+
+/* Flash is plain memory on a PC */
+#define PROGMEM
+#define F(string)               (string)
+#define pgm_read_byte(address)  (*(const uint8_t *)(address))
+#define pgm_read_word(address)  (*(const uint16_t *)(address))
+#define pgm_read_dword(address) (*(const uint32_t *)(address))
+#define pgm_read_ptr(address)   (*(void * const *)(address))
+#define memcpy_P                memcpy
+
+#define _BV(bit)                (1u << (bit))
+#define _SFR_BYTE(sfr)          (sfr)
+#define bit_is_set(sfr, bit)    Host_BitIsSet(&(sfr), (bit))
+#define bit_is_clear(sfr, bit)  (!Host_BitIsSet(&(sfr), (bit)))
+#define ISR(vector)             extern "C" void vector(void)
+#define constrain(amount, low, high) ((amount) < (low) ? (low) : ((amount) > (high) ? (high) : (amount)))
+template<class T, class U> inline T min(T a, U b) { return (a < (T)b) ? a : (T)b; }
+template<class T, class U> inline T max(T a, U b) { return (a > (T)b) ? a : (T)b; }
+
+#define B00000001               0x01u
+#define B00100000               0x20u
+#define B01111111               0x7Fu
+#define B10000000               0x80u
+#define B11011111               0xDFu
+#define B11111110               0xFEu
+
+/* Registers */
+#define HOST_REGISTER(name)     extern volatile uint8_t name;
+HOST_REGISTER(TCCR0A) HOST_REGISTER(TCCR0B) HOST_REGISTER(TCNT0) HOST_REGISTER(OCR0A) HOST_REGISTER(OCR0B)
+HOST_REGISTER(TIMSK0) HOST_REGISTER(TIFR0)
+HOST_REGISTER(TCCR1A) HOST_REGISTER(TCCR1B) HOST_REGISTER(TCCR1C) HOST_REGISTER(TIMSK1) HOST_REGISTER(TIFR1)
+HOST_REGISTER(TCCR2A) HOST_REGISTER(TCCR2B) HOST_REGISTER(TCNT2) HOST_REGISTER(OCR2A) HOST_REGISTER(OCR2B)
+HOST_REGISTER(TIMSK2) HOST_REGISTER(TIFR2)
+HOST_REGISTER(PINB) HOST_REGISTER(PINC) HOST_REGISTER(PIND)
+HOST_REGISTER(PORTB) HOST_REGISTER(PORTC) HOST_REGISTER(PORTD)
+HOST_REGISTER(DDRB) HOST_REGISTER(DDRC) HOST_REGISTER(DDRD)
+HOST_REGISTER(PRR) HOST_REGISTER(DIDR0) HOST_REGISTER(DIDR1)
+HOST_REGISTER(ADMUX) HOST_REGISTER(ADCSRA) HOST_REGISTER(ADCSRB)
+HOST_REGISTER(MCUSR) HOST_REGISTER(MCUCR) HOST_REGISTER(WDTCSR) HOST_REGISTER(CLKPR) HOST_REGISTER(SMCR)
+HOST_REGISTER(OSCCAL) HOST_REGISTER(SREG)
+HOST_REGISTER(EICRA) HOST_REGISTER(EIMSK) HOST_REGISTER(EIFR)
+HOST_REGISTER(PCICR) HOST_REGISTER(PCIFR) HOST_REGISTER(PCMSK0) HOST_REGISTER(PCMSK1) HOST_REGISTER(PCMSK2)
+HOST_REGISTER(UCSR0A) HOST_REGISTER(UCSR0B) HOST_REGISTER(UCSR0C) HOST_REGISTER(UDR0)
+HOST_REGISTER(SPCR) HOST_REGISTER(SPSR) HOST_REGISTER(SPDR)
+extern volatile uint16_t TCNT1, OCR1A, OCR1B, ICR1, ADC, UBRR0;
+
+enum { CS00 = 0, CS01 = 1, CS02 = 2, WGM00 = 0, WGM01 = 1, WGM02 = 3, TOIE0 = 0, OCIE0A = 1 };
+enum { CS10 = 0, CS11 = 1, CS12 = 2, WGM10 = 0, WGM11 = 1, WGM12 = 3, WGM13 = 4, COM1A1 = 7, COM1B1 = 5,
+       TOIE1 = 0, OCIE1A = 1, OCIE1B = 2, TOV1 = 0, OCF1A = 1, OCF1B = 2 };
+enum { CS20 = 0, CS21 = 1, CS22 = 2, WGM20 = 0, WGM21 = 1, WGM22 = 3, COM2A1 = 7, COM2B1 = 5,
+       TOIE2 = 0, OCIE2A = 1, OCIE2B = 2, OCF2A = 1 };
+enum { PRADC = 0, PRUSART0 = 1, PRSPI = 2, PRTIM1 = 3, PRTIM0 = 5, PRTIM2 = 6, PRTWI = 7 };
+enum { ADC0D = 0, ADC1D = 1, ADC2D = 2, ADC3D = 3, ADC4D = 4, ADC5D = 5 };
+enum { MUX0 = 0, MUX1 = 1, MUX2 = 2, MUX3 = 3, ADLAR = 5, REFS0 = 6, REFS1 = 7 };
+enum { ADPS0 = 0, ADPS1 = 1, ADPS2 = 2, ADIE = 3, ADIF = 4, ADATE = 5, ADSC = 6, ADEN = 7 };
+enum { PORF = 0, EXTRF = 1, BORF = 2, WDRF = 3 };
+enum { WDP0 = 0, WDP1 = 1, WDP2 = 2, WDE = 3, WDCE = 4, WDP3 = 5, WDIE = 6, WDIF = 7 };
+enum { CLKPCE = 7 };
+enum { ISC00 = 0, ISC01 = 1, ISC10 = 2, ISC11 = 3, INT0 = 0, INT1 = 1, INTF0 = 0, INTF1 = 1 };
+enum { PCIE0 = 0, PCIE1 = 1, PCIE2 = 2, PCIF0 = 0, PCIF1 = 1, PCIF2 = 2 };
+enum { PCINT0 = 0, PCINT1 = 1, PCINT2 = 2, PCINT18 = 2 };
+enum { U2X0 = 1, UCSZ00 = 1, UCSZ01 = 2, TXEN0 = 3, RXEN0 = 4, UDRIE0 = 5, UDRE0 = 5, TXC0 = 6 };
+enum { SPR0 = 0, SPI2X = 0, MSTR = 4, SPE = 6, SPIF = 7 };
+
+/* Pins */
+#define digitalPinToInterrupt(pin)  ((2 == (pin)) ? 0 : ((3 == (pin)) ? 1 : NOT_AN_INTERRUPT))
+#define digitalPinToPCICR(pin)      (&PCICR)
+#define digitalPinToPCICRbit(pin)   (((pin) < 8) ? 2 : (((pin) < 14) ? 0 : 1))
+#define digitalPinToPCMSK(pin)      (((pin) < 8) ? &PCMSK2 : (((pin) < 14) ? &PCMSK0 : &PCMSK1))
+#define digitalPinToPCMSKbit(pin)   (((pin) < 8) ? (pin) : (((pin) < 14) ? ((pin) - 8) : ((pin) - 14)))
+
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t level);
+int digitalRead(uint8_t pin);
+int analogRead(uint8_t pin);
+void analogWrite(uint8_t pin, int value);
+void analogReference(uint8_t mode);
+uint8_t digitalPinToPort(uint8_t pin);
+uint8_t digitalPinToBitMask(uint8_t pin);
+volatile uint8_t *portInputRegister(uint8_t port);
+volatile uint8_t *portOutputRegister(uint8_t port);
+void attachInterrupt(uint8_t interrupt, void (*handler)(void), int mode);
+void detachInterrupt(uint8_t interrupt);
+uint8_t Host_BitIsSet(volatile uint8_t *sfr, uint8_t bit);
+
+/* Time */
+unsigned long millis(void);
+unsigned long micros(void);
+void delay(unsigned long milliSeconds);
+void delayMicroseconds(unsigned int microSeconds);
+
+void cli(void);
+void sei(void);
+void noInterrupts(void);
+void interrupts(void);
+long random(long low, long high);
+long random(long high);
+void randomSeed(unsigned long seed);
+
+/* Serial, text to hostSerial */
+class HardwareSerial
+{
+public:
+    void begin(unsigned long baud) { (void)baud; }
+    void end(void) {}
+    void flush(void) { if(hostSerial) fflush(hostSerial); }
+    int available(void) { return 0; }
+    int read(void) { return -1; }
+    int availableForWrite(void) { return 63; }
+    operator bool(void) { return true; }
+    size_t write(uint8_t data) { if(hostSerial) fputc(data, hostSerial); return 1u; }
+    size_t write(const uint8_t *data, size_t length) { for(size_t i = 0u; i < length; i++) write(data[i]); return length; }
+    void print(const char *text) { if(hostSerial) fputs(text, hostSerial); }
+    void print(char character) { write((uint8_t)character); }
+    void print(unsigned long value, int base = DEC) { if(hostSerial) fprintf(hostSerial, (HEX == base) ? "%lX" : "%lu", value); }
+    void print(long value, int base = DEC) { if(HEX == base) print((unsigned long)value, base); else if(hostSerial) fprintf(hostSerial, "%ld", value); }
+    void print(unsigned int value, int base = DEC) { print((unsigned long)value, base); }
+    void print(int value, int base = DEC) { print((long)value, base); }
+    void print(unsigned char value, int base = DEC) { print((unsigned long)value, base); }
+    void print(double value) { if(hostSerial) fprintf(hostSerial, "%.2f", value); }
+    void println(void) { print("\n"); }
+    template<class T> void println(T value) { print(value); println(); }
+    template<class T> void println(T value, int base) { print(value, base); println(); }
+};
+extern HardwareSerial Serial;
+
+#endif /* ARDUINO_H */
@@ -0,0 +1,30 @@
+#ifndef EEPROM_H
+#define EEPROM_H
+/***************************************************************************************
+ * Host EEPROM
+ ***************************************************************************************
+ * EEPROM library on hostEeprom[], see Host.h.
+ **************************************************************************************/
+#include "Host.h"
+
+class EEPROMClass
+{
+public:
+    uint8_t read(int address) { return hostEeprom[address]; }
+    void write(int address, uint8_t value) { hostEeprom[address] = value; }
+    void update(int address, uint8_t value) { hostEeprom[address] = value; }
+    uint16_t length(void) { return HOST_EEPROM_SIZE; }
+    template<class T> T &get(int address, T &value)
+    {
+        memcpy(&value, &hostEeprom[address], sizeof(T));
+        return value;
+    }
+    template<class T> const T &put(int address, const T &value)
+    {
+        memcpy(&hostEeprom[address], &value, sizeof(T));
+        return value;
+    }
+};
+extern EEPROMClass EEPROM;
+
+#endif /* EEPROM_H */
@@ -0,0 +1,306 @@
+/***************************************************************************************
+ * Includes
+ **************************************************************************************/
+#include "Host.h"
+#include <Arduino.h>
+#include <EEPROM.h>
+#include <LowPower.h>
+#include <SPI.h>
+#include <avr/wdt.h>
+
+/***************************************************************************************
+ * Variables
+ **************************************************************************************/
+#define HOST_REGISTER_DEFINE(name)  volatile uint8_t name;
+HOST_REGISTER_DEFINE(TCCR0A) HOST_REGISTER_DEFINE(TCCR0B) HOST_REGISTER_DEFINE(TCNT0) HOST_REGISTER_DEFINE(OCR0A)
+HOST_REGISTER_DEFINE(OCR0B) HOST_REGISTER_DEFINE(TIMSK0) HOST_REGISTER_DEFINE(TIFR0)
+HOST_REGISTER_DEFINE(TCCR1A) HOST_REGISTER_DEFINE(TCCR1B) HOST_REGISTER_DEFINE(TCCR1C) HOST_REGISTER_DEFINE(TIMSK1)
+HOST_REGISTER_DEFINE(TIFR1)
+HOST_REGISTER_DEFINE(TCCR2A) HOST_REGISTER_DEFINE(TCCR2B) HOST_REGISTER_DEFINE(TCNT2) HOST_REGISTER_DEFINE(OCR2A)
+HOST_REGISTER_DEFINE(OCR2B) HOST_REGISTER_DEFINE(TIMSK2) HOST_REGISTER_DEFINE(TIFR2)
+HOST_REGISTER_DEFINE(PINB) HOST_REGISTER_DEFINE(PINC) HOST_REGISTER_DEFINE(PIND)
+HOST_REGISTER_DEFINE(PORTB) HOST_REGISTER_DEFINE(PORTC) HOST_REGISTER_DEFINE(PORTD)
+HOST_REGISTER_DEFINE(DDRB) HOST_REGISTER_DEFINE(DDRC) HOST_REGISTER_DEFINE(DDRD)
+HOST_REGISTER_DEFINE(PRR) HOST_REGISTER_DEFINE(DIDR0) HOST_REGISTER_DEFINE(DIDR1)
+HOST_REGISTER_DEFINE(ADMUX) HOST_REGISTER_DEFINE(ADCSRA) HOST_REGISTER_DEFINE(ADCSRB)
+HOST_REGISTER_DEFINE(MCUSR) HOST_REGISTER_DEFINE(MCUCR) HOST_REGISTER_DEFINE(WDTCSR) HOST_REGISTER_DEFINE(CLKPR)
+HOST_REGISTER_DEFINE(SMCR) HOST_REGISTER_DEFINE(OSCCAL) HOST_REGISTER_DEFINE(SREG)
+HOST_REGISTER_DEFINE(EICRA) HOST_REGISTER_DEFINE(EIMSK) HOST_REGISTER_DEFINE(EIFR)
+HOST_REGISTER_DEFINE(PCICR) HOST_REGISTER_DEFINE(PCIFR) HOST_REGISTER_DEFINE(PCMSK0) HOST_REGISTER_DEFINE(PCMSK1)
+HOST_REGISTER_DEFINE(PCMSK2)
+HOST_REGISTER_DEFINE(UCSR0A) HOST_REGISTER_DEFINE(UCSR0B) HOST_REGISTER_DEFINE(UCSR0C) HOST_REGISTER_DEFINE(UDR0)
+HOST_REGISTER_DEFINE(SPCR) HOST_REGISTER_DEFINE(SPSR) HOST_REGISTER_DEFINE(SPDR)
+volatile uint16_t TCNT1, OCR1A, OCR1B, ICR1, ADC, UBRR0;
+
+HardwareSerial Serial;
+EEPROMClass EEPROM;
+LowPowerClass LowPower;
+SPIClass SPI;
+
+uint8_t hostEeprom[HOST_EEPROM_SIZE];
+uint16_t hostAdc[HOST_ADC_CHANNELS];
+int16_t hostAnalogWritten[HOST_PIN_COUNT];
+FILE *hostSerial = stdout;
+void (*hostPowerDown)(uint32_t milliSeconds) = 0;
+
+static uint32_t hostMicros = 0u;
+static uint32_t hostSlept = 0u;                     /* Milliseconds powered down */
+static uint8_t hostWatchdog = 0u;
+static uint32_t hostRandom = 1u;
+
+/* Milliseconds of each LowPower period */
+static const uint32_t hostPeriods[] = { 15u, 30u, 60u, 120u, 250u, 500u, 1000u, 2000u, 4000u, 8000u, 0u };
+
+/***************************************************************************************
+ * Function: Host_Init()
+ ***************************************************************************************
+ * Description: Erased EEPROM and no analogWrite() yet, before main() runs.
+ **************************************************************************************/
+static struct HostInit
+{
+    HostInit(void)
+    {
+        memset(hostEeprom, 0xFF, sizeof(hostEeprom));
+        for(uint8_t pin = 0u; pin < HOST_PIN_COUNT; pin++)
+        {
+            hostAnalogWritten[pin] = -1;
+        }
+    }
+} hostInit;
+
+/***************************************************************************************
+ * Function: Host_Port()
+ ***************************************************************************************
+ * Return: PINx, PORTx or DDRx of an Arduino pin; 0 for PIN, 1 for PORT and 2 for DDR
+ **************************************************************************************/
+static volatile uint8_t *Host_Port(uint8_t pin, uint8_t kind)
+{
+    static volatile uint8_t *const ports[3][3] =
+    {
+        { &PIND, &PINB, &PINC },
+        { &PORTD, &PORTB, &PORTC },
+        { &DDRD, &DDRB, &DDRC }
+    };
+
+    return ports[kind][(pin < 8u) ? 0u : ((pin < 14u) ? 1u : 2u)];
+}
+
+uint8_t digitalPinToPort(uint8_t pin)
+{
+    return (pin < 8u) ? 4u : ((pin < 14u) ? 2u : 3u);
+}
+
+uint8_t digitalPinToBitMask(uint8_t pin)
+{
+    return (uint8_t)_BV((pin < 8u) ? pin : ((pin < 14u) ? (pin - 8u) : (pin - 14u)));
+}
+
+volatile uint8_t *portInputRegister(uint8_t port)
+{
+    return (2u == port) ? &PINB : ((3u == port) ? &PINC : &PIND);
+}
+
+volatile uint8_t *portOutputRegister(uint8_t port)
+{
+    return (2u == port) ? &PORTB : ((3u == port) ? &PORTC : &PORTD);
+}
+
+void Host_SetPin(uint8_t pin, uint8_t level)
+{
+    if(level)
+    {
+        *Host_Port(pin, 0u) |= digitalPinToBitMask(pin);
+    }
+    else
+    {
+        *Host_Port(pin, 0u) &= ~digitalPinToBitMask(pin);
+    }
+}
+
+uint8_t Host_GetPin(uint8_t pin)
+{
+    return (*Host_Port(pin, 0u) & digitalPinToBitMask(pin)) ? HIGH : LOW;
+}
+
+uint8_t Host_PinMode(uint8_t pin)
+{
+    return (*Host_Port(pin, 2u) & digitalPinToBitMask(pin)) ? OUTPUT : INPUT;
+}
+
+void pinMode(uint8_t pin, uint8_t mode)
+{
+    if(OUTPUT == mode)
+    {
+        *Host_Port(pin, 2u) |= digitalPinToBitMask(pin);
+        Host_SetPin(pin, (*Host_Port(pin, 1u) & digitalPinToBitMask(pin)) ? HIGH : LOW);
+    }
+    else
+    {
+        *Host_Port(pin, 2u) &= ~digitalPinToBitMask(pin);
+    }
+}
+
+/* An output reads back what it drives */
+void digitalWrite(uint8_t pin, uint8_t level)
+{
+    if(level)
+    {
+        *Host_Port(pin, 1u) |= digitalPinToBitMask(pin);
+    }
+    else
+    {
+        *Host_Port(pin, 1u) &= ~digitalPinToBitMask(pin);
+    }
+
+    if(OUTPUT == Host_PinMode(pin))
+    {
+        Host_SetPin(pin, level);
+    }
+    else
+    {
+        /* Pull up, the input keeps what drives it */
+    }
+}
+
+int digitalRead(uint8_t pin)
+{
+    return Host_GetPin(pin);
+}
+
+void analogWrite(uint8_t pin, int value)
+{
+    hostAnalogWritten[pin] = (int16_t)value;
+    digitalWrite(pin, (value >= 128) ? HIGH : LOW);
+}
+
+void analogReference(uint8_t mode)
+{
+    (void)mode;
+}
+
+int analogRead(uint8_t pin)
+{
+    return hostAdc[((pin >= A0) ? (pin - A0) : pin) & 0x0Fu];
+}
+
+/* A started conversion has already finished */
+uint8_t Host_BitIsSet(volatile uint8_t *sfr, uint8_t bit)
+{
+    if((&ADCSRA == sfr) && (ADSC == bit) && (ADCSRA & _BV(ADSC)))
+    {
+        ADC = hostAdc[ADMUX & 0x0Fu];
+        ADCSRA &= ~_BV(ADSC);
+    }
+    else
+    {
+        /* Plain register */
+    }
+
+    return (*sfr & _BV(bit)) ? 1u : 0u;
+}
+
+void attachInterrupt(uint8_t interrupt, void (*handler)(void), int mode)
+{
+    (void)interrupt;
+    (void)handler;
+    (void)mode;
+}
+
+void detachInterrupt(uint8_t interrupt)
+{
+    (void)interrupt;
+}
+
+/***************************************************************************************
+ * Time
+ **************************************************************************************/
+void Host_Advance(uint32_t microSeconds)
+{
+    hostMicros += microSeconds;
+}
+
+uint32_t Host_SleptMillis(void)
+{
+    return hostSlept;
+}
+
+unsigned long millis(void)
+{
+    return hostMicros / 1000u;
+}
+
+unsigned long micros(void)
+{
+    return hostMicros;
+}
+
+void delay(unsigned long milliSeconds)
+{
+    Host_Advance(milliSeconds * 1000u);
+}
+
+void delayMicroseconds(unsigned int microSeconds)
+{
+    Host_Advance(microSeconds);
+}
+
+void LowPowerClass::powerDown(period_t period, adc_t adc, bod_t bod)
+{
+    (void)adc;
+    (void)bod;
+
+    hostSlept += hostPeriods[period];
+    if(hostPowerDown)
+    {
+        hostPowerDown(hostPeriods[period]);
+    }
+    else
+    {
+        /* Nothing wakes it early */
+    }
+}
+
+void wdt_enable(uint8_t timeout)
+{
+    (void)timeout;
+    hostWatchdog = 1u;
+}
+
+void wdt_disable(void)
+{
+    hostWatchdog = 0u;
+}
+
+void wdt_reset(void)
+{
+}
+
+uint8_t Host_WatchdogOn(void)
+{
+    return hostWatchdog;
+}
+
+/***************************************************************************************
+ * Misc
+ **************************************************************************************/
+void cli(void) {}
+void sei(void) {}
+void noInterrupts(void) {}
+void interrupts(void) {}
+
+/* Same sequence on every PC */
+long random(long low, long high)
+{
+    hostRandom = (hostRandom * 1103515245u) + 12345u;
+    return low + (long)((hostRandom >> 16) % (uint32_t)(high - low));
+}
+
+long random(long high)
+{
+    return random(0, high);
+}
+
+void randomSeed(unsigned long seed)
+{
+    hostRandom = (uint32_t)seed;
+}
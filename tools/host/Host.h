@@ -0,0 +1,40 @@
+#ifndef HOST_H
+#define HOST_H
+/***************************************************************************************
+ * Host
+ ***************************************************************************************
+ * Runs the sketch and its modules on a PC. tools/host holds just enough of the Arduino
+ * core, avr-libc, LowPower, EEPROM and SPI for them to build; this header is what the
+ * harnesses in tools/ drive it with.
+ * Time is simulated: millis() and micros() only move with delay(), delayMicroseconds()
+ * and Host_Advance(), so every run gives the same result. Like on the MCU, millis()
+ * stands still while powered down; Host_SleptMillis() has the time slept.
+ * Pins are the PINx, PORTx and DDRx registers of the ATmega328P, ADC channels read
+ * hostAdc[] and EEPROM is hostEeprom[], erased to 0xFF.
+ * Build a harness with -I tools/host -I . and link tools/host/Host.cpp.
+ **************************************************************************************/
+#include <stdint.h>
+#include <stdio.h>
+
+#define HOST_EEPROM_SIZE        1024u
+#define HOST_ADC_CHANNELS       16u
+#define HOST_PIN_COUNT          20u
+
+extern uint8_t hostEeprom[HOST_EEPROM_SIZE];
+extern uint16_t hostAdc[HOST_ADC_CHANNELS];         /* Result of each ADMUX channel */
+extern int16_t hostAnalogWritten[HOST_PIN_COUNT];   /* Last analogWrite(), -1 if none */
+extern FILE *hostSerial;                            /* Serial output, NULL drops it */
+
+/* Called by LowPower.powerDown() with the milliseconds of the period, SLEEP_FOREVER
+ * gives 0. The harness wakes the sketch from there, e.g. with Host_SetPin() and the
+ * pin change ISR. */
+extern void (*hostPowerDown)(uint32_t milliSeconds);
+
+void Host_Advance(uint32_t microSeconds);
+uint32_t Host_SleptMillis(void);
+void Host_SetPin(uint8_t pin, uint8_t level);
+uint8_t Host_GetPin(uint8_t pin);
+uint8_t Host_PinMode(uint8_t pin);
+uint8_t Host_WatchdogOn(void);
+
+#endif /* HOST_H */
@@ -0,0 +1,31 @@
+#ifndef SPI_H
+#define SPI_H
+/***************************************************************************************
+ * Host SPI
+ ***************************************************************************************
+ * Nothing is connected, transfer() reads 0.
+ **************************************************************************************/
+#include <stdint.h>
+
+#define MSBFIRST                1
+#define SPI_MODE0               0
+
+class SPISettings
+{
+public:
+    SPISettings(void) {}
+    SPISettings(uint32_t clock, uint8_t order, uint8_t mode) { (void)clock; (void)order; (void)mode; }
+};
+
+class SPIClass
+{
+public:
+    void begin(void) {}
+    void end(void) {}
+    void beginTransaction(SPISettings settings) { (void)settings; }
+    void endTransaction(void) {}
+    uint8_t transfer(uint8_t data) { (void)data; return 0u; }
+};
+extern SPIClass SPI;
+
+#endif /* SPI_H */
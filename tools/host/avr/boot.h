@@ -0,0 +1 @@
+/* Host: nothing is used from boot.h */
@@ -0,0 +1,2 @@
+/* Host: ISR(), cli() and sei() are in Arduino.h */
+#include <Arduino.h>
@@ -0,0 +1,2 @@
+/* Host: PROGMEM and pgm_read_*() are in Arduino.h */
+#include <Arduino.h>
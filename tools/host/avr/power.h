@@ -0,0 +1,2 @@
+/* Host: the sketch writes PRR and CLKPR itself */
+#include <Arduino.h>
@@ -0,0 +1,11 @@
+#ifndef AVR_SLEEP_H
+#define AVR_SLEEP_H
+/* Host: sleeping is LowPower.powerDown() */
+#define SLEEP_MODE_IDLE         0
+#define SLEEP_MODE_PWR_DOWN     2
+inline void set_sleep_mode(uint8_t mode) { (void)mode; }
+inline void sleep_enable(void) {}
+inline void sleep_disable(void) {}
+inline void sleep_cpu(void) {}
+inline void sleep_bod_disable(void) {}
+#endif /* AVR_SLEEP_H */
@@ -0,0 +1,17 @@
+#ifndef AVR_WDT_H
+#define AVR_WDT_H
+/* Host: the watchdog never fires, Host_WatchdogOn() tells if it is on */
+#define WDTO_15MS               0
+#define WDTO_30MS               1
+#define WDTO_60MS               2
+#define WDTO_120MS              3
+#define WDTO_250MS              4
+#define WDTO_500MS              5
+#define WDTO_1S                 6
+#define WDTO_2S                 7
+#define WDTO_4S                 8
+#define WDTO_8S                 9
+void wdt_enable(uint8_t timeout);
+void wdt_disable(void);
+void wdt_reset(void);
+#endif /* AVR_WDT_H */
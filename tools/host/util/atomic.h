@@ -0,0 +1,7 @@
+#ifndef UTIL_ATOMIC_H
+#define UTIL_ATOMIC_H
+/* Host: nothing interrupts a block */
+#define ATOMIC_RESTORESTATE     0
+#define ATOMIC_FORCEON          1
+#define ATOMIC_BLOCK(type)      for(uint8_t hostAtomic = 1u; hostAtomic; hostAtomic = 0u)
+#endif /* UTIL_ATOMIC_H */
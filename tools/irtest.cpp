@@ -0,0 +1,407 @@
+/***************************************************************************************
+ * IR Decoder Test
+ ***************************************************************************************
+ * Replays a corpus of captures through IRrecv::decode() on a PC and prints the decode
+ * accuracy and the false positives of damaged frames. Used to judge changes of the IR
+ * decoders; exits with 1 when a case fails.
+ * With -v every decode is printed; irtest.sh builds both rawbuf formats and checks
+ * that they decode the corpus the same.
+ * With -d it checks instead how far the clock of an NEC remote can drift, with
+ * IR_CALIBRATE or, built with -DIR_FIXED_TIMING, with the fixed MARK_EXCESS.
+ * Built with -DIR_SEND_ASYNC, -s sends an NEC frame with the async engine and decodes
+ * what it sent.
+ * Build: g++ -DARDUINO=100 -DTEST -DIR_SEND_ASYNC -Ihost -I.. -o irtest irtest.cpp ../IRremote.cpp ../Profiler.cpp host/Host.cpp
+ *        add -DIR_COMPACT_RAWBUF for the one byte rawbuf
+ **************************************************************************************/
+#include "IRremote.h"
+#include "IRremoteInt.h"
+#include <stdio.h>
+#include <string.h>
+#include <chrono>
+
+#define IR_TEST_CLEAN       0u    /* Frame as the remote sends it */
+#define IR_TEST_JITTER      1u    /* Every mark and space is off by up to IR_TEST_JITTER_MAX */
+#define IR_TEST_TRUNCATED   2u    /* Second half of the frame is lost, must not decode */
+#define IR_TEST_NOISE       3u    /* Random short pulses, must not decode */
+#define IR_TEST_GAP         4u    /* A long space in the middle of the frame, must not decode */
+#define IR_TEST_JITTER_MAX  15    /* Percent; decoders tolerate TOLERANCE */
+#define IR_TEST_GAP_TICKS   400u  /* 20ms, stored as a long width in the compact rawbuf */
+#define IR_TEST_PASSES      10u   /* Each case is decoded this many times, with new jitter */
+#define IR_TEST_DRIFT_MAX   30u   /* Percent the clock of the remote drifts to */
+#define IR_TEST_DRIFT_FRAMES 20u  /* Frames sent at each percent */
+#define IR_TEST_DRIFT_JITTER 3    /* Percent */
+#define IR_TEST_DRIFT_NEEDED 25u  /* Percent NEC must keep decoding to with IR_CALIBRATE */
+#define IR_TEST_ASYNC_INTERRUPTS 10000u /* An NEC frame takes about 2500 at 38kHz */
+
+/* One case of the corpus. Most are synthesized; captures of real remotes, e.g. printed
+ * by the IRrecvDump example, go in as RECORDED cases */
+typedef struct
+{
+    int protocol;
+    unsigned long value;
+    uint8_t bits;
+    uint8_t damage;
+    const unsigned int *capture;        /* Ticks, gap first; NULL to synthesize with IRsendRecorder */
+    uint8_t captureLength;
+} irTestCase_t;
+
+/* Mitsubishi RM 75501 capture from IRremoteInt.h, there is no sender for it */
+static const unsigned int irTestMitsubishi[] =
+{
+    14200, 7, 41, 7, 42, 7, 42, 7, 17, 7, 17, 7, 18, 7, 41, 7, 18, 7, 17,
+    7, 17, 7, 18, 7, 41, 8, 17, 7, 17, 7, 18, 7, 17, 7
+};
+
+#define RECORDED(capture)   capture, (sizeof(capture) / sizeof(capture[0]))
+
+static const irTestCase_t irTestCorpus[] =
+{
+    { NEC,        0xFF18E7,   32u, IR_TEST_CLEAN,     NULL, 0u },
+    { NEC,        0xFF38C7,   32u, IR_TEST_JITTER,    NULL, 0u },
+    { NEC,        REPEAT,     0u,  IR_TEST_CLEAN,     NULL, 0u },
+    { NEC,        REPEAT,     0u,  IR_TEST_JITTER,    NULL, 0u },
+    { NEC,        0xFF10EF,   32u, IR_TEST_TRUNCATED, NULL, 0u },
+    { NEC,        0xFF10EF,   32u, IR_TEST_GAP,       NULL, 0u },
+    { SONY,       0xA90,      12u, IR_TEST_CLEAN,     NULL, 0u },
+    { SONY,       0x2D0,      12u, IR_TEST_JITTER,    NULL, 0u },
+    { RC5,        0x1A0C,     13u, IR_TEST_CLEAN,     NULL, 0u },
+    { RC5,        0x1A0C,     13u, IR_TEST_JITTER,    NULL, 0u },
+    { RC6,        0x1000C,    20u, IR_TEST_CLEAN,     NULL, 0u },
+    { PANASONIC,  0x0100BCBD, 48u, IR_TEST_CLEAN,     NULL, 0u },
+    { JVC,        0xC5E8,     16u, IR_TEST_JITTER,    NULL, 0u },
+    { SAMSUNG,    0xE0E040BF, 32u, IR_TEST_CLEAN,     NULL, 0u },
+    { SAMSUNG,    0xE0E0E01F, 32u, IR_TEST_JITTER,    NULL, 0u },
+    { MITSUBISHI, 0xE210,     16u, IR_TEST_CLEAN,     RECORDED(irTestMitsubishi) },
+    { MITSUBISHI, 0xE210,     16u, IR_TEST_TRUNCATED, RECORDED(irTestMitsubishi) },
+    { UNKNOWN,    0u,         0u,  IR_TEST_NOISE,     NULL, 0u },
+};
+
+static IRrecv irrecv(9);
+static decode_results results;
+static IRsendRecorder irTestRecorder;
+
+/***************************************************************************************
+ * Function: IR_RecordTestCase()
+ ***************************************************************************************
+ * Description: Put the capture of one corpus case in irTestRecorder, damaged as asked.
+ * Parameters:
+ *  - testCase[in]   :   Corpus case to record
+ **************************************************************************************/
+static void IR_RecordTestCase(const irTestCase_t *testCase)
+{
+    irTestRecorder.reset((IR_TEST_JITTER == testCase->damage) ? IR_TEST_JITTER_MAX : 0);
+
+    if(NULL != testCase->capture)
+    {
+        /* Recorded capture, already in ticks */
+        irTestRecorder.rawlen = testCase->captureLength;
+        memcpy(irTestRecorder.rawbuf, testCase->capture, testCase->captureLength * sizeof(testCase->capture[0]));
+    }
+    else
+    {
+        /* Let IRsend encode the frame */
+        switch(testCase->protocol)
+        {
+            case NEC:
+                if(REPEAT == testCase->value)
+                {
+                    irTestRecorder.mark(NEC_HDR_MARK);
+                    irTestRecorder.space(NEC_RPT_SPACE);
+                    irTestRecorder.mark(NEC_BIT_MARK);
+                    irTestRecorder.space(0);
+                }
+                else
+                {
+                    irTestRecorder.sendNEC(testCase->value, testCase->bits);
+                }
+                break;
+            case SONY:
+                irTestRecorder.sendSony(testCase->value, testCase->bits);
+                break;
+            case RC5:
+                irTestRecorder.sendRC5(testCase->value, testCase->bits);
+                break;
+            case RC6:
+                irTestRecorder.sendRC6(testCase->value, testCase->bits);
+                break;
+            case PANASONIC:
+                irTestRecorder.sendPanasonic(0x4004, testCase->value);
+                break;
+            case JVC:
+                irTestRecorder.sendJVC(testCase->value, testCase->bits, 0);
+                break;
+            case SAMSUNG:
+                irTestRecorder.sendSAMSUNG(testCase->value, testCase->bits);
+                break;
+            default:
+                /* Noise: short random pulses, like sunlight or a lamp on the receiver */
+                for(uint8_t index = 0u; index < 20u; index++)
+                {
+                    irTestRecorder.mark(USECPERTICK * random(2, 12));
+                    irTestRecorder.space(USECPERTICK * random(2, 40));
+                }
+                irTestRecorder.mark(USECPERTICK * 4);
+                irTestRecorder.space(0);
+                break;
+        }
+    }
+
+    if(IR_TEST_TRUNCATED == testCase->damage)
+    {
+        /* Lose the end of the frame */
+        irTestRecorder.rawlen /= 2;
+    }
+    else if(IR_TEST_GAP == testCase->damage)
+    {
+        /* Receiver blinded in the middle of the frame, a space of the data bits gets long */
+        irTestRecorder.rawbuf[(irTestRecorder.rawlen / 2) | 1] = IR_TEST_GAP_TICKS;
+    }
+    else
+    {
+        /* Keep full frame */
+    }
+}
+
+/***************************************************************************************
+ * Function: IR_TestCorpus()
+ ***************************************************************************************
+ * Description: Replay every case of the corpus IR_TEST_PASSES times and print the
+ *              results.
+ * Parameters:
+ *  - verbose[in]   :   Print every decode too
+ * Return: Number of cases which failed
+ **************************************************************************************/
+static unsigned int IR_TestCorpus(bool verbose)
+{
+    unsigned int validFrames = 0u;
+    unsigned int validDecoded = 0u;
+    unsigned int damagedFrames = 0u;
+    unsigned int falsePositives = 0u;
+    unsigned int failedCases = 0u;
+    double decodeTime = 0.0;
+
+    randomSeed(1);
+
+    for(uint8_t index = 0u; index < (sizeof(irTestCorpus) / sizeof(irTestCorpus[0])); index++)
+    {
+        const irTestCase_t *testCase = &irTestCorpus[index];
+        uint8_t passed = 0u;
+
+        for(uint8_t pass = 0u; pass < IR_TEST_PASSES; pass++)
+        {
+            IR_RecordTestCase(testCase);
+            irrecv.replay(irTestRecorder.rawbuf, irTestRecorder.rawlen);
+
+            /* Time only the decoding; PC time, only good to compare decoders */
+            std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+            int decoded = irrecv.decode(&results);
+            decodeTime += std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+
+            if(verbose)
+            {
+                printf("case %2u pass %u: %s type %d value 0x%lX bits %d rawlen %d\n", index, pass,
+                       decoded ? "decoded" : "no frame", decoded ? results.decode_type : 0,
+                       decoded ? (unsigned long)(uint32_t)results.value : 0ul, decoded ? results.bits : 0, results.rawlen);
+            }
+
+            /* Check result */
+            if(IR_TEST_JITTER < testCase->damage)
+            {
+                /* Damaged frames must never look like a known protocol */
+                damagedFrames++;
+                if(decoded && (UNKNOWN != results.decode_type))
+                {
+                    falsePositives++;
+                }
+                else
+                {
+                    passed++;
+                }
+            }
+            else
+            {
+                validFrames++;
+                /* unsigned long is 32 bits on the AVR, a PC keeps more of the Panasonic frame */
+                if(decoded && (testCase->protocol == results.decode_type) && (testCase->value == (uint32_t)results.value))
+                {
+                    validDecoded++;
+                    passed++;
+                }
+                else
+                {
+                    /* Wrong decode */
+                }
+            }
+            irrecv.resume();
+        }
+
+        failedCases += (IR_TEST_PASSES != passed);
+        printf("IR case %2u: %2u/%u%s\n", index, passed, IR_TEST_PASSES, (IR_TEST_PASSES != passed) ? "  FAILED" : "");
+    }
+
+    printf("IR accuracy: %u/%u\n", validDecoded, validFrames);
+    printf("IR false positives: %u/%u\n", falsePositives, damagedFrames);
+    fprintf(stderr, "IR decode avg %.2f us on this PC\n", decodeTime / (validFrames + damagedFrames));
+
+    return failedCases;
+}
+
+/***************************************************************************************
+ * Function: IR_TestDrift()
+ ***************************************************************************************
+ * Description: Send NEC frames while the clock of the remote drifts slow, one percent
+ *              every IR_TEST_DRIFT_FRAMES frames, like a cooling RC oscillator or a
+ *              sagging supply. The receiver keeps what it learned between frames.
+ * Return: Drift in percent up to which every frame decoded
+ **************************************************************************************/
+static unsigned int IR_TestDrift(void)
+{
+    unsigned int limit = IR_TEST_DRIFT_MAX;
+
+    for(unsigned int drift = 0u; drift <= IR_TEST_DRIFT_MAX; drift++)
+    {
+        unsigned int decodedFrames = 0u;
+
+        for(unsigned int frame = 0u; frame < IR_TEST_DRIFT_FRAMES; frame++)
+        {
+            irTestRecorder.reset(IR_TEST_DRIFT_JITTER);
+            irTestRecorder.sendNEC(0xFF18E7, 32);
+
+            /* Every mark and space gets longer, the gap stays long */
+            for(int index = 1; index < irTestRecorder.rawlen; index++)
+            {
+                irTestRecorder.rawbuf[index] = ((irTestRecorder.rawbuf[index] * (100u + drift)) + 50u) / 100u;
+            }
+            irrecv.replay(irTestRecorder.rawbuf, irTestRecorder.rawlen);
+            if(irrecv.decode(&results) && (NEC == results.decode_type) && (0xFF18E7 == results.value))
+            {
+                decodedFrames++;
+            }
+            else
+            {
+                /* Lost frame */
+            }
+            irrecv.resume();
+        }
+
+        if((IR_TEST_DRIFT_FRAMES != decodedFrames) && (IR_TEST_DRIFT_MAX == limit))
+        {
+            limit = (0u == drift) ? 0u : (drift - 1u);
+        }
+        else
+        {
+            /* Do nothing */
+        }
+        if(0u == (drift % 5u))
+        {
+            printf("IR drift %2u%%: %2u/%u\n", drift, decodedFrames, IR_TEST_DRIFT_FRAMES);
+        }
+        else
+        {
+            /* Do nothing */
+        }
+    }
+
+    return limit;
+}
+
+#ifdef IR_SEND_ASYNC
+ISR(TIMER_INTR_NAME);
+
+/***************************************************************************************
+ * Function: IR_TestSendAsync()
+ ***************************************************************************************
+ * Description: Send an NEC frame with IRsend's async engine, run its timer interrupt
+ *              and record the carrier of OC2B as the receiver would see it. The
+ *              recorded frame must decode and the receiver must be idle afterwards.
+ * Return: 0 if it worked, 1 otherwise
+ **************************************************************************************/
+static unsigned int IR_TestSendAsync(void)
+{
+    IRsend irsend;
+    unsigned long interrupts = 0u;
+    unsigned long run = 0u;
+    uint8_t carrier;
+    uint8_t entries;
+    int started;
+
+    irrecv.enableIRIn();
+    irsend.beginAsync();
+    irsend.sendNEC(0xFF18E7, 32);
+    entries = irsendparams.len;
+    started = irsend.sendAsync();
+
+    /* Every switch of the PWM output ends a mark or a space */
+    irTestRecorder.reset(0);
+    carrier = TCCR2A & _BV(COM2B1);
+    while(irsend.busy() && (interrupts < IR_TEST_ASYNC_INTERRUPTS))
+    {
+        TIMER_INTR_NAME();
+        interrupts++;
+        run++;
+        if((TCCR2A & _BV(COM2B1)) != carrier)
+        {
+            int usec = (int)((run * 1000u) / (irsendparams.khz * TIMER_INTR_PER_CARRIER));
+
+            if(carrier)
+            {
+                irTestRecorder.mark(usec);
+            }
+            else
+            {
+                irTestRecorder.space(usec);
+            }
+            carrier = TCCR2A & _BV(COM2B1);
+            run = 0u;
+        }
+        else
+        {
+            /* Same level */
+        }
+    }
+    irTestRecorder.space(0);
+
+    uint8_t idle = (STATE_IDLE == irparams.rcvstate) && (TIMSK2 & _BV(OCIE2A));
+    irrecv.replay(irTestRecorder.rawbuf, irTestRecorder.rawlen);
+    int decoded = irrecv.decode(&results) && (NEC == results.decode_type) && (0xFF18E7 == results.value);
+    irrecv.resume();
+
+    printf("IR async: %s, %u schedule entries, %.1f ms of carrier, frame %s, receiver %s\n",
+           (DECODED == started) ? "started" : "not started", entries,
+           interrupts / (irsendparams.khz * TIMER_INTR_PER_CARRIER * 1.0), decoded ? "decodes" : "lost",
+           idle ? "idle" : "not receiving");
+
+    return ((DECODED == started) && decoded && idle) ? 0u : 1u;
+}
+#endif
+
+int main(int argc, char **argv)
+{
+#ifdef IR_SEND_ASYNC
+    if((argc > 1) && (0 == strcmp(argv[1], "-s")))
+    {
+        return IR_TestSendAsync();
+    }
+    else
+    {
+        /* Other checks */
+    }
+#endif
+
+    if((argc > 1) && (0 == strcmp(argv[1], "-d")))
+    {
+        unsigned int limit = IR_TestDrift();
+
+#ifdef IR_CALIBRATE
+        printf("IR drift: NEC decodes every frame up to %u%% slow with IR_CALIBRATE\n", limit);
+        return (IR_TEST_DRIFT_NEEDED <= limit) ? 0 : 1;
+#else
+        printf("IR drift: NEC decodes every frame up to %u%% slow with fixed timing\n", limit);
+        return 0;
+#endif
+    }
+    else
+    {
+        return (0u == IR_TestCorpus((argc > 1) && (0 == strcmp(argv[1], "-v")))) ? 0 : 1;
+    }
+}
@@ -0,0 +1,29 @@
+#!/bin/sh
+# Builds tools/irtest.cpp with the 16 bit and the one byte rawbuf, runs both and checks
+# that they decode the IR corpus the same. Then compares how far an NEC remote can
+# drift with IR_CALIBRATE and with fixed timing, and sends a frame with the async
+# engine. Run from tools/.
+set -e
+CXX=${CXX:-g++}
+SOURCES="irtest.cpp ../IRremote.cpp ../Profiler.cpp host/Host.cpp"
+FLAGS="-DARDUINO=100 -DTEST -DIR_SEND_ASYNC -Ihost -I.."
+$CXX $FLAGS -o irtest $SOURCES
+$CXX $FLAGS -DIR_COMPACT_RAWBUF -o irtest_compact $SOURCES
+$CXX $FLAGS -DIR_FIXED_TIMING -o irtest_fixed $SOURCES
+
+status=0
+./irtest -v > irtest.out || status=1
+./irtest_compact -v > irtest_compact.out || status=1
+if diff irtest.out irtest_compact.out; then
+    echo "Both rawbuf formats decode the corpus the same"
+else
+    echo "rawbuf formats decode differently"
+    status=1
+fi
+grep -v "pass" irtest.out
+./irtest -d > irtest_drift.out || status=1
+./irtest_fixed -d > irtest_fixed_drift.out
+tail -n 1 irtest_drift.out irtest_fixed_drift.out
+./irtest -s || status=1
+./irtest_compact -s || status=1
+exit $status
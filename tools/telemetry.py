@@ -0,0 +1,140 @@
+#!/usr/bin/env python3
+"""
+EcoBot telemetry decoder.
+
+Reads the Serial output of a Dev Build, decodes the binary telemetry frames sent
+by Telemetry_Send() and prints them. Text printed by the robot is shown as is.
+
+Usage:
+    telemetry.py /dev/ttyUSB0          read from the robot (115200 baud)
+    telemetry.py capture.bin           read a saved capture
+    telemetry.py /dev/ttyUSB0 --plot   also plot the values when stopped with Ctrl+C
+"""
+import argparse
+import os
+import struct
+import sys
+import termios
+
+SERIAL_BRATE = termios.B115200
+
+# Frame id: (names of the values, struct format of the data, scales to print)
+FRAMES = {
+    1: (("battery",), "<H", (0.001,)),      # TELEMETRY_ID_BATTERY, mV
+    2: (("dropped",), "<H", (1,)),          # TELEMETRY_ID_DROPPED
+    3: (("display_refreshes_per_hour", "display_skipped", "display_mj_per_refresh"),
+        "<HHI", (1, 1, 0.001)),             # TELEMETRY_ID_DISPLAY, displayStats_t
+    4: (("energy_subsystem", "energy"), "<BI", (1, 0.001)),    # TELEMETRY_ID_ENERGY, J
+    5: (("soc", "resistance"), "<BH", (1, 0.001)),             # TELEMETRY_ID_SOC, %, Ohm
+}
+TELEMETRY_ID_ENERGY = 4
+
+# ENERGY_* subsystems of Energy.h, each gets its own value
+ENERGY_SUBSYSTEMS = ("mcu", "drv8834", "motor_a", "motor_b", "ir", "adc")
+
+
+def cobs_decode(data):
+    """Decode one COBS block, None if it is not valid COBS."""
+    out = bytearray()
+    index = 0
+    while index < len(data):
+        code = data[index]
+        if code == 0 or index + code > len(data) + 1:
+            return None
+        out += data[index + 1:index + code]
+        index += code
+        if code < 0xFF and index < len(data):
+            out.append(0)
+    return bytes(out)
+
+
+def parse_frame(block):
+    """Return (time ms, [(name, value)]) or None if the block is not a telemetry frame."""
+    frame = cobs_decode(block)
+    if frame is None or len(frame) < 4:
+        return None
+    if sum(frame[:-1]) & 0xFF != frame[-1]:
+        return None
+    frame_id = frame[0]
+    if frame_id not in FRAMES:
+        return None
+    names, fmt, scales = FRAMES[frame_id]
+    if struct.calcsize(fmt) != len(frame) - 4:
+        return None
+    time_ms = frame[1] | (frame[2] << 8)
+    values = struct.unpack(fmt, frame[3:-1])
+    if frame_id == TELEMETRY_ID_ENERGY:
+        if values[0] >= len(ENERGY_SUBSYSTEMS):
+            return None
+        return time_ms, [("energy_" + ENERGY_SUBSYSTEMS[values[0]], values[1] * scales[1])]
+    return time_ms, [(name, value * scale) for name, value, scale in zip(names, values, scales)]
+
+
+def open_input(path):
+    fd = os.open(path, os.O_RDONLY | os.O_NOCTTY)
+    if os.isatty(fd):
+        attrs = termios.tcgetattr(fd)
+        attrs[0] = 0                                    # iflag: raw
+        attrs[1] = 0                                    # oflag
+        attrs[2] = termios.CS8 | termios.CREAD | termios.CLOCAL
+        attrs[3] = 0                                    # lflag: no echo, no canonical
+        attrs[4] = attrs[5] = SERIAL_BRATE
+        termios.tcsetattr(fd, termios.TCSANOW, attrs)
+    return fd
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("input", help="serial device or capture file")
+    parser.add_argument("--plot", action="store_true", help="plot values at the end (needs matplotlib)")
+    args = parser.parse_args()
+
+    fd = open_input(args.input)
+    series = {}
+    time_base = {}
+    block = bytearray()
+    try:
+        while True:
+            chunk = os.read(fd, 256)
+            if not chunk:
+                break
+            for byte in chunk:
+                if byte != 0:
+                    block.append(byte)
+                    continue
+                if block:
+                    parsed = parse_frame(bytes(block))
+                    if parsed is None:
+                        # Not a frame: text from the robot
+                        sys.stdout.write(block.decode("ascii", "replace"))
+                    else:
+                        time_ms, values = parsed
+                        # Time is 16 bits, unwrap it
+                        name = values[0][0]
+                        last, offset = time_base.get(name, (time_ms, 0))
+                        if time_ms < last:
+                            offset += 0x10000
+                        time_base[name] = (time_ms, offset)
+                        seconds = (time_ms + offset) / 1000.0
+                        for name, value in values:
+                            print("%10.3f %s %g" % (seconds, name, value))
+                            series.setdefault(name, []).append((seconds, value))
+                    block = bytearray()
+            sys.stdout.flush()
+    except KeyboardInterrupt:
+        pass
+    # Text left after the last frame
+    sys.stdout.write(block.decode("ascii", "replace"))
+
+    if args.plot and series:
+        import matplotlib.pyplot as plt
+        fig, axes = plt.subplots(len(series), 1, sharex=True, squeeze=False)
+        for axis, (name, points) in zip(axes[:, 0], sorted(series.items())):
+            axis.plot([p[0] for p in points], [p[1] for p in points])
+            axis.set_ylabel(name)
+        axes[-1, 0].set_xlabel("s")
+        plt.show()
+
+
+if __name__ == "__main__":
+    main()